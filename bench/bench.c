@@ -0,0 +1,566 @@
+#include "lzw.h"
+#include "corpus.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INIT_BITS 8
+#define BLOCK_SIZE (64 * 1024)
+
+// the largest number of results a baseline file can hold
+#define MAX_RESULTS 256
+
+static unsigned int const widths[] = { 12, 16, 24 };
+
+static char const* program_name;
+
+/*
+ * The measurements of a single corpus at a single maximum width. The
+ * throughputs are both in MB of uncompressed data per second.
+ */
+
+struct result {
+    char corpus[16];
+    unsigned int max_bits;
+
+    double ratio;
+    double encode_mbs;
+    double decode_mbs;
+    long peak_rss_kb;
+
+    bool ok;
+};
+
+/*
+ * The settings of a run.
+ */
+
+struct options {
+    size_t size;
+    unsigned int repetitions;
+    double tolerance;
+
+    char const* corpus;
+    char const* baseline;
+    char const* save;
+};
+
+/*
+ * An in-memory stream: bytes are read from input and written to output.
+ */
+
+struct buffer {
+    unsigned char const* input;
+    size_t input_length;
+    size_t position;
+
+    unsigned char* output;
+    size_t output_length;
+    size_t output_capacity;
+    bool failed;
+};
+
+static void usage(FILE* stream)
+{
+    fprintf(stream, "Usage: %s [-c CORPUS] [-s MB] [-r N] [-b FILE] "
+                    "[-t PERCENT] [-w FILE]\n\n", program_name);
+
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "\t-c CORPUS\tOnly run the given corpus: text, logs, "
+                    "json,\n\t\t\trandom, runs or binary\n");
+    fprintf(stream, "\t-s MB\t\tSize of each corpus (default 4)\n");
+    fprintf(stream, "\t-r N\t\tTime each case N times and keep the best "
+                    "(default 3)\n");
+    fprintf(stream, "\t-b FILE\t\tCompare the results against the "
+                    "baseline in FILE\n");
+    fprintf(stream, "\t-t PERCENT\tSlowdown or memory growth treated as "
+                    "a regression\n\t\t\t(default 20)\n");
+    fprintf(stream, "\t-w FILE\t\tWrite the results to FILE as a new "
+                    "baseline\n");
+}
+
+static int read_buffer(void* context)
+{
+    struct buffer* buf = context;
+
+    if (buf->position == buf->input_length) {
+        return EOF;
+    }
+
+    return buf->input[buf->position++];
+}
+
+static void write_buffer(unsigned char c, void* context)
+{
+    struct buffer* buf = context;
+
+    if (buf->output_length == buf->output_capacity) {
+        size_t const new_capacity = buf->output_capacity * 2 + 4096;
+        unsigned char* new_output = realloc(buf->output, new_capacity);
+
+        if (new_output == NULL) {
+            buf->failed = true;
+            return;
+        }
+
+        buf->output = new_output;
+        buf->output_capacity = new_capacity;
+    }
+
+    buf->output[buf->output_length++] = c;
+}
+
+/*
+ * now: Get the time on a monotonic clock, in seconds.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * time_encode: Encode the input a block at a time into out, returning the
+ *              time taken, or a negative number on failure.
+ */
+
+static double time_encode(unsigned char const* input, size_t length,
+        unsigned int max_bits, struct buffer* out)
+{
+    out->output_length = 0;
+
+    double const start = now();
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, max_bits,
+                                               write_buffer, out);
+    bool success = enc != NULL;
+
+    for (size_t i = 0; success && i < length; i += BLOCK_SIZE) {
+        size_t const block = (length - i < BLOCK_SIZE) ?
+            length - i :
+            BLOCK_SIZE;
+
+        success = lzw_encoder_write(enc, input + i, block);
+    }
+
+    success = success && lzw_encoder_finish(enc);
+    lzw_encoder_destroy(enc);
+
+    double const elapsed = now() - start;
+    return (success && !out->failed) ? elapsed : -1;
+}
+
+/*
+ * time_decode: Decode the encoded bytes through a reader into output,
+ *              returning the time taken, or a negative number on failure.
+ */
+
+static double time_decode(unsigned char const* encoded, size_t encoded_length,
+        unsigned int max_bits, unsigned char* output, size_t length)
+{
+    struct buffer in = { encoded, encoded_length, 0, NULL, 0, 0, false };
+
+    double const start = now();
+    struct lzw_reader* reader = lzw_reader_open(INIT_BITS, max_bits,
+                                                read_buffer, &in);
+
+    if (reader == NULL) {
+        return -1;
+    }
+
+    size_t done = 0;
+    size_t n;
+
+    while ((n = lzw_reader_read(reader, output + done,
+                                (length - done < BLOCK_SIZE) ?
+                                length - done + 1 :
+                                BLOCK_SIZE)) > 0) {
+        done += n;
+
+        if (done > length) {
+            break;
+        }
+    }
+
+    bool const success = !lzw_reader_error(reader) && done == length;
+    lzw_reader_close(reader);
+
+    double const elapsed = now() - start;
+    return success ? elapsed : -1;
+}
+
+/*
+ * measure: Generate a corpus, then time the best of several encodes and
+ *          decodes, checking that the data survives the round trip.
+ */
+
+static struct result measure(struct corpus const* corpus,
+        unsigned int max_bits, struct options const* options)
+{
+    struct result result;
+    memset(&result, 0, sizeof(result));
+
+    snprintf(result.corpus, sizeof(result.corpus), "%s", corpus->name);
+    result.max_bits = max_bits;
+
+    size_t const length = options->size;
+    unsigned char* input = corpus_generate(corpus, length);
+
+    // one spare byte lets the decoder show that it would have written more
+    unsigned char* decoded = malloc(length + 1);
+    struct buffer out = { NULL, 0, 0, NULL, 0, 0, false };
+    double best_encode = -1;
+    double best_decode = -1;
+
+    result.ok = input != NULL && decoded != NULL;
+
+    for (unsigned int i = 0; result.ok && i < options->repetitions; ++i) {
+        double const t = time_encode(input, length, max_bits, &out);
+
+        result.ok = t >= 0;
+
+        if (best_encode < 0 || t < best_encode) {
+            best_encode = t;
+        }
+    }
+
+    for (unsigned int i = 0; result.ok && i < options->repetitions; ++i) {
+        double const t = time_decode(out.output, out.output_length, max_bits,
+                                     decoded, length);
+
+        result.ok = t >= 0 && memcmp(decoded, input, length) == 0;
+
+        if (best_decode < 0 || t < best_decode) {
+            best_decode = t;
+        }
+    }
+
+    if (result.ok) {
+        double const mb = length / 1e6;
+
+        result.ratio = (double) out.output_length / length;
+        result.encode_mbs = (best_encode > 0) ? mb / best_encode : 0;
+        result.decode_mbs = (best_decode > 0) ? mb / best_decode : 0;
+    }
+
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        result.peak_rss_kb = usage.ru_maxrss;
+    }
+
+    free(out.output);
+    free(decoded);
+    free(input);
+
+    return result;
+}
+
+/*
+ * run_case: Measure a case in a child process, so that its peak memory use
+ *           isn't mixed up with that of the cases before it.
+ */
+
+static bool run_case(struct corpus const* corpus, unsigned int max_bits,
+        struct options const* options, struct result* result)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t const pid = fork();
+
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+
+        struct result const r = measure(corpus, max_bits, options);
+        bool const written = write(fds[1], &r, sizeof(r)) == sizeof(r);
+
+        _exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+
+    bool const received = read(fds[0], result, sizeof(*result))
+        == sizeof(*result);
+    int status;
+
+    close(fds[0]);
+
+    return waitpid(pid, &status, 0) == pid
+        && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS
+        && received && result->ok;
+}
+
+/*
+ * load_baseline: Read the results stored in a baseline file, one per line,
+ *                skipping comments. Returns the number read, or -1 if the
+ *                file can't be opened.
+ */
+
+static int load_baseline(char const* path, struct result* results,
+        size_t capacity)
+{
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    char line[256];
+    size_t count = 0;
+
+    while (count < capacity && fgets(line, sizeof(line), file) != NULL) {
+        struct result* const r = &results[count];
+
+        if (line[0] == '#') {
+            continue;
+        }
+
+        if (sscanf(line, "%15s %u %lf %lf %lf %ld", r->corpus, &r->max_bits,
+                   &r->ratio, &r->encode_mbs, &r->decode_mbs,
+                   &r->peak_rss_kb) == 6) {
+            r->ok = true;
+            ++count;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+/*
+ * save_baseline: Write the results in the format load_baseline() reads.
+ */
+
+static bool save_baseline(char const* path, struct result const* results,
+        size_t count)
+{
+    FILE* file = fopen(path, "w");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    fprintf(file, "# corpus max_bits ratio encode_mb/s decode_mb/s "
+                  "peak_rss_kb\n");
+
+    for (size_t i = 0; i < count; ++i) {
+        struct result const* r = &results[i];
+
+        fprintf(file, "%s %u %.6f %.1f %.1f %ld\n", r->corpus, r->max_bits,
+                r->ratio, r->encode_mbs, r->decode_mbs, r->peak_rss_kb);
+    }
+
+    return fclose(file) == 0;
+}
+
+/*
+ * find_result: Find the baseline result for the same case, or NULL.
+ */
+
+static struct result const* find_result(struct result const* results,
+        size_t count, struct result const* r)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(results[i].corpus, r->corpus) == 0
+                && results[i].max_bits == r->max_bits) {
+            return &results[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * change: Get the relative change from old to new, in percent.
+ */
+
+static double change(double old_value, double new_value)
+{
+    return (old_value > 0) ? 100 * (new_value - old_value) / old_value : 0;
+}
+
+/*
+ * compare: Print how a result differs from its baseline and count the
+ *          regressions. The ratio is deterministic, so any growth counts.
+ *          Memory gets a megabyte of slack, since small cases are mostly
+ *          the process itself.
+ */
+
+static unsigned int compare(struct result const* base,
+        struct result const* r, double tolerance)
+{
+    double const encode = change(base->encode_mbs, r->encode_mbs);
+    double const decode = change(base->decode_mbs, r->decode_mbs);
+    double const rss = change(base->peak_rss_kb, r->peak_rss_kb);
+
+    bool const slow_encode = encode < -tolerance;
+    bool const slow_decode = decode < -tolerance;
+    bool const bigger = r->ratio > base->ratio + 1e-6;
+    bool const heavier = rss > tolerance
+        && r->peak_rss_kb - base->peak_rss_kb > 1024;
+
+    printf("  %+6.1f%%%s %+6.1f%%%s %+6.1f%%%s%s", encode,
+           slow_encode ? "!" : " ", decode, slow_decode ? "!" : " ",
+           rss, heavier ? "!" : " ", bigger ? "  ratio!" : "");
+
+    return slow_encode + slow_decode + bigger + heavier;
+}
+
+/*
+ * parse_options: Read the command line into options.
+ */
+
+static bool parse_options(int argc, char** argv, struct options* options)
+{
+    int opt;
+
+    options->size = 4;
+    options->repetitions = 3;
+    options->tolerance = 20;
+    options->corpus = NULL;
+    options->baseline = NULL;
+    options->save = NULL;
+
+    while ((opt = getopt(argc, argv, "b:c:hr:s:t:w:")) != -1) {
+        switch (opt) {
+        case 'b':
+            options->baseline = optarg;
+            break;
+        case 'c':
+            options->corpus = optarg;
+            break;
+        case 'h':
+            usage(stdout);
+            exit(EXIT_SUCCESS);
+        case 'r':
+            options->repetitions = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            options->size = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            options->tolerance = strtod(optarg, NULL);
+            break;
+        case 'w':
+            options->save = optarg;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (options->corpus != NULL && corpus_find(options->corpus) == NULL) {
+        fprintf(stderr, "%s: unknown corpus %s\n", program_name,
+                options->corpus);
+        return false;
+    }
+
+    options->size *= 1000 * 1000;
+    return optind == argc && options->size > 0 && options->repetitions > 0;
+}
+
+int main(int argc, char** argv)
+{
+    program_name = argv[0];
+
+    struct options options;
+
+    if (!parse_options(argc, argv, &options)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    static struct result baseline[MAX_RESULTS];
+    static struct result results[MAX_RESULTS];
+    int baseline_count = 0;
+    size_t result_count = 0;
+
+    if (options.baseline != NULL) {
+        baseline_count = load_baseline(options.baseline, baseline,
+                                       MAX_RESULTS);
+
+        if (baseline_count < 0) {
+            perror(options.baseline);
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t corpus_count;
+    struct corpus const* corpora = corpus_all(&corpus_count);
+    unsigned int failures = 0;
+    unsigned int regressions = 0;
+
+    printf("%-8s %4s %8s %10s %10s %10s", "corpus", "bits", "ratio",
+           "enc MB/s", "dec MB/s", "peak KB");
+
+    if (baseline_count > 0) {
+        printf("  %8s %8s %8s", "enc", "dec", "rss");
+    }
+
+    printf("\n");
+
+    for (size_t i = 0; i < corpus_count; ++i) {
+        if (options.corpus != NULL
+                && strcmp(options.corpus, corpora[i].name) != 0) {
+            continue;
+        }
+
+        for (size_t j = 0; j < sizeof(widths) / sizeof(widths[0]); ++j) {
+            struct result* const r = &results[result_count];
+
+            if (!run_case(&corpora[i], widths[j], &options, r)) {
+                printf("%-8s %4u failed\n", corpora[i].name, widths[j]);
+                ++failures;
+                continue;
+            }
+
+            ++result_count;
+            printf("%-8s %4u %8.4f %10.1f %10.1f %10ld", r->corpus,
+                   r->max_bits, r->ratio, r->encode_mbs, r->decode_mbs,
+                   r->peak_rss_kb);
+
+            struct result const* base = find_result(baseline, baseline_count,
+                                                    r);
+
+            if (base != NULL) {
+                regressions += compare(base, r, options.tolerance);
+            }
+
+            printf("\n");
+        }
+    }
+
+    if (options.save != NULL
+            && !save_baseline(options.save, results, result_count)) {
+        perror(options.save);
+        return EXIT_FAILURE;
+    }
+
+    if (baseline_count > 0) {
+        printf("\n%u regression%s against %s\n", regressions,
+               (regressions == 1) ? "" : "s", options.baseline);
+    }
+
+    return (failures == 0 && regressions == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
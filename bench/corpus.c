@@ -0,0 +1,428 @@
+#include "corpus.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+
+#define ARRAY_LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+
+/*
+ * A xorshift generator, which is all the randomness the corpora need and
+ * gives the same sequence everywhere.
+ */
+
+struct rng {
+    uint32_t state;
+};
+
+/*
+ * rng_init: Start the sequence of a generator's given variant. Variant 0
+ *           starts from the seed itself.
+ */
+
+static struct rng rng_init(uint32_t seed, uint32_t variant)
+{
+    struct rng rng = { seed ^ (variant * UINT32_C(0x9E3779B9)) };
+
+    // xorshift never leaves zero
+    if (rng.state == 0) {
+        rng.state = seed;
+    }
+
+    return rng;
+}
+
+static uint32_t rng_next(struct rng* rng)
+{
+    uint32_t x = rng->state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return rng->state = x;
+}
+
+/*
+ * rng_below: Get a number in [0, n).
+ */
+
+static uint32_t rng_below(struct rng* rng, uint32_t n)
+{
+    return rng_next(rng) % n;
+}
+
+/*
+ * rng_skewed: Get a number in [0, n) that is more often small, roughly
+ *             following the way word and value frequencies fall off.
+ */
+
+static uint32_t rng_skewed(struct rng* rng, uint32_t n)
+{
+    return rng_below(rng, rng_below(rng, n) + 1);
+}
+
+/*
+ * The output of a text-based generator. Anything past the end is dropped,
+ * so generators simply write until full.
+ */
+
+struct writer {
+    unsigned char* out;
+    size_t length;
+    size_t position;
+};
+
+static bool writer_full(struct writer const* w)
+{
+    return w->position == w->length;
+}
+
+static void put_bytes(struct writer* w, void const* bytes, size_t length)
+{
+    size_t const room = w->length - w->position;
+
+    if (length > room) {
+        length = room;
+    }
+
+    memcpy(w->out + w->position, bytes, length);
+    w->position += length;
+}
+
+static void put_byte(struct writer* w, unsigned char c)
+{
+    put_bytes(w, &c, 1);
+}
+
+static void put_text(struct writer* w, char const* format, ...)
+{
+    char buffer[512];
+    va_list args;
+
+    va_start(args, format);
+    int const length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length > 0) {
+        put_bytes(w, buffer, ((size_t) length < sizeof(buffer)) ?
+                  (size_t) length :
+                  sizeof(buffer) - 1);
+    }
+}
+
+static char const* const words[] = {
+    "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "for",
+    "on", "are", "with", "as", "his", "they", "be", "at", "one", "have",
+    "this", "from", "or", "had", "by", "word", "but", "what", "some", "we",
+    "can", "out", "other", "were", "all", "there", "when", "up", "use",
+    "your", "how", "said", "an", "each", "she", "which", "do", "their",
+    "time", "if", "will", "way", "about", "many", "then", "them", "write",
+    "would", "like", "so", "these", "her", "long", "make", "thing", "see",
+    "him", "two", "has", "look", "more", "day", "could", "go", "come",
+    "did", "number", "sound", "no", "most", "people", "my", "over", "know",
+    "water", "than", "call", "first", "who", "may", "down", "side", "been",
+    "now", "find", "compression", "dictionary", "variable", "algorithm",
+    "stream", "buffer", "encoder", "decoder", "throughput", "memory"
+};
+
+static char const* const names[] = {
+    "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi",
+    "ivan", "judy", "mallory", "niaj", "olivia", "peggy", "rupert", "sybil",
+    "trent", "victor", "walter", "yolanda"
+};
+
+static char const* const components[] = {
+    "http", "db", "cache", "auth", "scheduler", "worker-1", "worker-2",
+    "worker-3", "gateway", "billing"
+};
+
+static char const* const paths[] = {
+    "/", "/login", "/logout", "/api/v1/users", "/api/v1/orders",
+    "/api/v1/orders/search", "/api/v2/items", "/static/app.js",
+    "/static/style.css", "/health"
+};
+
+/*
+ * generate_text: Sentences of common words, in paragraphs.
+ */
+
+static void generate_text(unsigned char* out, size_t length,
+        uint32_t variant)
+{
+    struct writer w = { out, length, 0 };
+    struct rng rng = rng_init(0x54455854, variant);
+
+    while (!writer_full(&w)) {
+        size_t const sentences = 2 + rng_below(&rng, 6);
+
+        for (size_t i = 0; i < sentences; ++i) {
+            size_t const count = 4 + rng_below(&rng, 16);
+
+            for (size_t j = 0; j < count; ++j) {
+                char const* word = words[rng_skewed(&rng,
+                                                    ARRAY_LENGTH(words))];
+
+                if (j == 0) {
+                    put_byte(&w, word[0] - 'a' + 'A');
+                    put_text(&w, "%s", word + 1);
+                } else {
+                    put_text(&w, (rng_below(&rng, 12) == 0) ?
+                             ", %s" : " %s", word);
+                }
+            }
+
+            put_text(&w, (i + 1 < sentences) ? ". " : ".\n\n");
+        }
+    }
+}
+
+/*
+ * generate_logs: Timestamped service log lines with a handful of levels,
+ *                components and fields.
+ */
+
+static void generate_logs(unsigned char* out, size_t length,
+        uint32_t variant)
+{
+    static char const* const levels[] = {
+        "INFO", "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR"
+    };
+    static int const statuses[] = { 200, 200, 200, 200, 201, 304, 404, 500 };
+
+    struct writer w = { out, length, 0 };
+    struct rng rng = rng_init(0x4C4F4753, variant);
+    unsigned long long ms = 0;
+
+    while (!writer_full(&w)) {
+        ms += rng_skewed(&rng, 2000);
+
+        unsigned long long const seconds = ms / 1000;
+
+        put_text(&w, "2024-03-%02llu %02llu:%02llu:%02llu.%03llu %-5s [%s] ",
+                 1 + seconds / 86400 % 28, seconds / 3600 % 24,
+                 seconds / 60 % 60, seconds % 60, ms % 1000,
+                 levels[rng_below(&rng, ARRAY_LENGTH(levels))],
+                 components[rng_skewed(&rng, ARRAY_LENGTH(components))]);
+
+        put_text(&w, "request id=%08x user=%s method=%s path=%s status=%d "
+                 "latency=%ums\n", rng_next(&rng),
+                 names[rng_skewed(&rng, ARRAY_LENGTH(names))],
+                 rng_below(&rng, 4) == 0 ? "POST" : "GET",
+                 paths[rng_skewed(&rng, ARRAY_LENGTH(paths))],
+                 statuses[rng_below(&rng, ARRAY_LENGTH(statuses))],
+                 1 + rng_skewed(&rng, 900));
+    }
+}
+
+/*
+ * generate_json: One JSON record per line, as from an export or an API.
+ */
+
+static void generate_json(unsigned char* out, size_t length,
+        uint32_t variant)
+{
+    struct writer w = { out, length, 0 };
+    struct rng rng = rng_init(0x4A534F4E, variant);
+
+    for (unsigned int id = 1; !writer_full(&w); ++id) {
+        char const* name = names[rng_below(&rng, ARRAY_LENGTH(names))];
+
+        put_text(&w, "{\"id\":%u,\"user\":\"%s\",\"email\":\"%s%u@example.com\","
+                 "\"active\":%s,\"score\":%u.%02u,\"tags\":[",
+                 id, name, name, rng_below(&rng, 100),
+                 rng_below(&rng, 3) == 0 ? "false" : "true",
+                 rng_below(&rng, 100), rng_below(&rng, 100));
+
+        size_t const tags = rng_below(&rng, 4);
+
+        for (size_t i = 0; i < tags; ++i) {
+            put_text(&w, "%s\"%s\"", (i == 0) ? "" : ",",
+                     words[rng_skewed(&rng, ARRAY_LENGTH(words))]);
+        }
+
+        put_text(&w, "],\"created\":\"2024-%02u-%02uT%02u:%02u:%02uZ\"}\n",
+                 1 + rng_below(&rng, 12), 1 + rng_below(&rng, 28),
+                 rng_below(&rng, 24), rng_below(&rng, 60),
+                 rng_below(&rng, 60));
+    }
+}
+
+/*
+ * generate_random: Uniformly random bytes, which can't be compressed.
+ */
+
+static void generate_random(unsigned char* out, size_t length,
+        uint32_t variant)
+{
+    struct rng rng = rng_init(0x52414E44, variant);
+
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = rng_next(&rng) >> 24;
+    }
+}
+
+/*
+ * generate_runs: Runs of repeated bytes, mostly short with the occasional
+ *                very long one, as in sparse files and bitmaps.
+ */
+
+static void generate_runs(unsigned char* out, size_t length,
+        uint32_t variant)
+{
+    struct rng rng = rng_init(0x52554E53, variant);
+    size_t i = 0;
+
+    while (i < length) {
+        unsigned char const c = (rng_below(&rng, 2) == 0) ?
+            0 :
+            rng_next(&rng) >> 24;
+        size_t run = (rng_below(&rng, 16) == 0) ?
+            256 + rng_below(&rng, 65536) :
+            1 + rng_below(&rng, 64);
+
+        if (run > length - i) {
+            run = length - i;
+        }
+
+        memset(out + i, c, run);
+        i += run;
+    }
+}
+
+/*
+ * generate_binary: Something like an executable: machine code made of
+ *                  common instruction patterns, tables of small integers,
+ *                  a string table and zero padding between sections.
+ */
+
+static void generate_binary(unsigned char* out, size_t length,
+        uint32_t variant)
+{
+    static unsigned char const prologue[] = { 0x55, 0x48, 0x89, 0xE5 };
+    static unsigned char const epilogue[] = { 0x5D, 0xC3 };
+    static unsigned char const loads[][3] = {
+        { 0x48, 0x8B, 0x45 }, { 0x48, 0x89, 0x7D }, { 0x8B, 0x45, 0xFC },
+        { 0x48, 0x83, 0xEC }, { 0x89, 0x45, 0xF8 }, { 0x48, 0x8D, 0x05 }
+    };
+
+    struct writer w = { out, length, 0 };
+    struct rng rng = rng_init(0x42494E41, variant);
+
+    while (!writer_full(&w)) {
+        // code: functions of loads and stores between calls
+        size_t const functions = 8 + rng_below(&rng, 32);
+
+        for (size_t i = 0; i < functions; ++i) {
+            put_bytes(&w, prologue, sizeof(prologue));
+
+            size_t const steps = 4 + rng_below(&rng, 24);
+
+            for (size_t j = 0; j < steps; ++j) {
+                if (rng_below(&rng, 5) == 0) {
+                    uint32_t const target = rng_skewed(&rng, 1 << 16);
+
+                    put_byte(&w, 0xE8);
+                    put_bytes(&w, (unsigned char[]) {
+                        target, target >> 8, 0, 0
+                    }, 4);
+                } else {
+                    put_bytes(&w, loads[rng_skewed(&rng,
+                                                   ARRAY_LENGTH(loads))], 3);
+                    put_byte(&w, 0xF0 + 4 * rng_below(&rng, 4));
+                }
+            }
+
+            put_bytes(&w, epilogue, sizeof(epilogue));
+        }
+
+        // data: a table of increasing little-endian offsets
+        size_t const entries = 16 + rng_below(&rng, 256);
+        uint32_t offset = rng_below(&rng, 1 << 20);
+
+        for (size_t i = 0; i < entries; ++i) {
+            offset += rng_skewed(&rng, 256);
+            put_bytes(&w, (unsigned char[]) {
+                offset, offset >> 8, offset >> 16, offset >> 24
+            }, 4);
+        }
+
+        // strings: symbol names
+        size_t const symbols = 4 + rng_below(&rng, 32);
+
+        for (size_t i = 0; i < symbols; ++i) {
+            put_text(&w, "%s_%s", components[rng_below(&rng,
+                                         ARRAY_LENGTH(components))],
+                     words[rng_skewed(&rng, ARRAY_LENGTH(words))]);
+            put_byte(&w, 0);
+        }
+
+        // padding up to the next 512-byte boundary
+        while (w.position % 512 != 0 && !writer_full(&w)) {
+            put_byte(&w, 0);
+        }
+    }
+}
+
+static struct corpus const corpora[] = {
+    { "text", generate_text },
+    { "logs", generate_logs },
+    { "json", generate_json },
+    { "random", generate_random },
+    { "runs", generate_runs },
+    { "binary", generate_binary }
+};
+
+/*
+ * corpus_all: Get the table of corpora.
+ */
+
+struct corpus const* corpus_all(size_t* count)
+{
+    *count = ARRAY_LENGTH(corpora);
+    return corpora;
+}
+
+/*
+ * corpus_find: Look a corpus up by name.
+ */
+
+struct corpus const* corpus_find(char const* name)
+{
+    for (size_t i = 0; i < ARRAY_LENGTH(corpora); ++i) {
+        if (strcmp(corpora[i].name, name) == 0) {
+            return &corpora[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * corpus_generate: Allocate a buffer and let the corpus fill it.
+ */
+
+unsigned char* corpus_generate(struct corpus const* corpus, size_t length)
+{
+    unsigned char* out = malloc((length > 0) ? length : 1);
+
+    if (out != NULL) {
+        corpus_fill(corpus, out, length, 0);
+    }
+
+    return out;
+}
+
+/*
+ * corpus_fill: Let the corpus fill the buffer with the given variant.
+ */
+
+void corpus_fill(struct corpus const* corpus, unsigned char* out,
+        size_t length, uint32_t variant)
+{
+    (corpus->generate)(out, length, variant);
+}
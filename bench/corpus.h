@@ -0,0 +1,42 @@
+/*
+ * corpus.h: Deterministic sample inputs for the benchmarks. A corpus of a
+ *           given kind, length and variant is the same on every run and
+ *           machine, so results can be compared across builds. Variants
+ *           are independent samples of the same kind of data.
+ */
+
+#ifndef CORPUS_H_
+#define CORPUS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct corpus {
+    char const* name;
+    void (*generate)(unsigned char* out, size_t length, uint32_t variant);
+};
+
+/*
+ * corpus_all: Get every kind of corpus, storing their number in count.
+ */
+struct corpus const* corpus_all(size_t* count);
+
+/*
+ * corpus_find: Get the corpus with the given name, or NULL.
+ */
+struct corpus const* corpus_find(char const* name);
+
+/*
+ * corpus_generate: Allocate and fill length bytes of the given corpus.
+ *                  Returns NULL if allocation fails.
+ */
+unsigned char* corpus_generate(struct corpus const* corpus, size_t length);
+
+/*
+ * corpus_fill: Fill out with length bytes of the given variant of the
+ *              corpus. Variant 0 is what corpus_generate() produces.
+ */
+void corpus_fill(struct corpus const* corpus, unsigned char* out,
+        size_t length, uint32_t variant);
+
+#endif // CORPUS_H_
@@ -0,0 +1,855 @@
+#include "trie.h"
+#include "dict.h"
+#include "instream.h"
+#include "outstream.h"
+#include "sequence.h"
+#include "config.h"
+#include "lzw.h"
+#include "corpus.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICK_UNIT "cycles"
+#else
+#define TICK_UNIT "ns"
+#endif
+
+// a repetition runs for at least this many ticks once calibrated
+#define MIN_TICKS 2000000
+
+#define MAX_REPETITIONS 64
+
+// keys are drawn from a small alphabet, so that they share prefixes the
+// way LZW strings do and the trie stays small
+#define TRIE_KEYS 256
+#define TRIE_ALPHABET 4
+
+#define STREAM_SIZE 4096
+
+// the batch cases split this much log data into streams of a given length,
+// and encode them at the command-line tool's width
+#define BATCH_TOTAL (8 << 20)
+#define BATCH_MAX_BITS 24
+
+static char const* program_name;
+
+/*
+ * ticks: Read the time stamp counter where there is one, and a monotonic
+ *        clock in nanoseconds elsewhere.
+ */
+
+static uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * A xorshift generator, so that every run measures the same work.
+ */
+
+static uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return *state = x;
+}
+
+/*
+ * Results are folded into this so that the compiler can't drop the work
+ * that produced them.
+ */
+
+static volatile uint64_t sink;
+
+/*
+ * A benchmark of one primitive. setup() builds the state for a parameter
+ * value, and run() performs the primitive at least ops times, as many
+ * times as the harness likes, returning the number of times it did.
+ */
+
+struct micro {
+    char const* name;
+    char const* param_name;
+    unsigned int params[4];
+
+    void* (*setup)(unsigned int param);
+    size_t (*run)(void* state, size_t ops);
+    void (*teardown)(void* state);
+};
+
+/*
+ * Trie state: a trie holding every prefix of TRIE_KEYS keys of the same
+ * length, the keys themselves, and the distinct prefixes in the order
+ * they were inserted.
+ */
+
+struct trie_state {
+    struct trie* trie;
+    char* keys;
+    size_t key_length;
+
+    size_t* prefix_ends;
+    size_t prefix_count;
+};
+
+/*
+ * build_trie: Insert the distinct prefixes, each of which is given by the
+ *             offset of its end in the keys.
+ */
+
+static struct trie* build_trie(struct trie_state const* state)
+{
+    struct trie* trie = trie_init(-1);
+
+    for (size_t i = 0; trie != NULL && i < state->prefix_count; ++i) {
+        size_t const end = state->prefix_ends[i];
+        size_t const length = end % state->key_length + 1;
+
+        trie_insert(trie, state->keys + end + 1 - length, length, i);
+    }
+
+    return trie;
+}
+
+/*
+ * find_prefixes: List the prefixes of the keys that aren't prefixes of an
+ *                earlier key, using a trie built along the way.
+ */
+
+static bool find_prefixes(struct trie_state* state)
+{
+    size_t const length = state->key_length;
+    struct trie* trie = trie_init(-1);
+
+    state->prefix_ends = malloc(sizeof(size_t) * TRIE_KEYS * length);
+    state->prefix_count = 0;
+
+    if (trie == NULL || state->prefix_ends == NULL) {
+        trie_destroy(trie);
+        return false;
+    }
+
+    for (size_t i = 0; i < TRIE_KEYS; ++i) {
+        char const* const key = state->keys + i * length;
+
+        for (size_t j = 1; j <= length; ++j) {
+            if (!trie_contains(trie, key, j)) {
+                trie_insert(trie, key, j, i);
+                state->prefix_ends[state->prefix_count++] = i * length + j - 1;
+            }
+        }
+    }
+
+    trie_destroy(trie);
+    return true;
+}
+
+static void* setup_trie(unsigned int key_length)
+{
+    struct trie_state* state = malloc(sizeof(*state));
+    uint32_t seed = 0x54524945;
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    state->key_length = key_length;
+    state->keys = malloc(TRIE_KEYS * key_length);
+
+    if (state->keys == NULL) {
+        free(state);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < TRIE_KEYS * key_length; ++i) {
+        state->keys[i] = 'a' + next_random(&seed) % TRIE_ALPHABET;
+    }
+
+    if (!find_prefixes(state)) {
+        free(state->prefix_ends);
+        free(state->keys);
+        free(state);
+        return NULL;
+    }
+
+    state->trie = build_trie(state);
+    return state;
+}
+
+static void teardown_trie(void* s)
+{
+    struct trie_state* state = s;
+
+    trie_destroy(state->trie);
+    free(state->prefix_ends);
+    free(state->keys);
+    free(state);
+}
+
+static size_t run_trie_lookup(void* s, size_t ops)
+{
+    struct trie_state* state = s;
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < ops; ++i) {
+        char const* key = state->keys + (i % TRIE_KEYS) * state->key_length;
+        value_t const* value = trie_lookup(state->trie, key,
+                                           state->key_length);
+
+        total += *value;
+    }
+
+    sink += total;
+    return ops;
+}
+
+/*
+ * run_trie_insert: Build whole tries from scratch. An op is one insert,
+ *                  and the cost includes freeing the trie again.
+ */
+
+static size_t run_trie_insert(void* s, size_t ops)
+{
+    struct trie_state* state = s;
+    size_t done = 0;
+
+    while (done < ops) {
+        struct trie* trie = build_trie(state);
+
+        sink += trie != NULL;
+        trie_destroy(trie);
+        done += state->prefix_count;
+    }
+
+    return done;
+}
+
+/*
+ * Dictionary state: a table filled with the given number of entries, each
+ * extending an earlier one as LZW entries do, and the keys to probe.
+ */
+
+struct dict_state {
+    struct dict* dict;
+    size_t fill;
+    code_t* prefixes;
+    unsigned char* bytes;
+};
+
+/*
+ * fill_dict: Insert the entries in code order, skipping any that repeat.
+ */
+
+static void fill_dict(struct dict* dict, struct dict_state const* state)
+{
+    for (size_t i = 0; i < state->fill; ++i) {
+        dict_insert(dict, state->prefixes[i], state->bytes[i],
+                    LZW_CHAR_RANGE + i);
+    }
+}
+
+static void* setup_dict(unsigned int fill)
+{
+    struct dict_state* state = malloc(sizeof(*state));
+    uint32_t seed = 0x44494354;
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    state->fill = fill;
+    state->prefixes = malloc(sizeof(*state->prefixes) * fill);
+    state->bytes = malloc(fill);
+    state->dict = dict_init(LZW_CHAR_RANGE);
+
+    if (state->prefixes == NULL || state->bytes == NULL
+            || state->dict == NULL) {
+        free(state->prefixes);
+        free(state->bytes);
+        dict_destroy(state->dict);
+        free(state);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < fill; ++i) {
+        state->prefixes[i] = next_random(&seed) % (LZW_CHAR_RANGE + i);
+        state->bytes[i] = next_random(&seed);
+    }
+
+    fill_dict(state->dict, state);
+    return state;
+}
+
+static void teardown_dict(void* s)
+{
+    struct dict_state* state = s;
+
+    dict_destroy(state->dict);
+    free(state->prefixes);
+    free(state->bytes);
+    free(state);
+}
+
+/*
+ * run_dict_lookup: Probe for the entries in a scattered order, as the
+ *                  encoder does.
+ */
+
+static size_t run_dict_lookup(void* s, size_t ops)
+{
+    struct dict_state* state = s;
+    uint64_t total = 0;
+    size_t i = 0;
+
+    for (size_t done = 0; done < ops; ++done) {
+        i = (i + 7919) % state->fill;
+        total += dict_lookup(state->dict, state->prefixes[i],
+                             state->bytes[i]);
+    }
+
+    sink += total;
+    return ops;
+}
+
+/*
+ * run_dict_insert: Fill a fresh table, so that growing it is included.
+ */
+
+static size_t run_dict_insert(void* s, size_t ops)
+{
+    struct dict_state* state = s;
+    size_t done = 0;
+
+    while (done < ops) {
+        struct dict* dict = dict_init(LZW_CHAR_RANGE);
+
+        if (dict == NULL) {
+            break;
+        }
+
+        fill_dict(dict, state);
+        sink += dict_size(dict);
+        dict_destroy(dict);
+        done += state->fill;
+    }
+
+    return done;
+}
+
+/*
+ * Bit stream state: the width to read or write at, and a block of bytes
+ * that the input stream reads over and over.
+ */
+
+struct stream_state {
+    unsigned int bits;
+    unsigned char bytes[STREAM_SIZE];
+    size_t position;
+};
+
+static void* setup_stream(unsigned int bits)
+{
+    struct stream_state* state = malloc(sizeof(*state));
+    uint32_t seed = 0x42495453;
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    state->bits = bits;
+    state->position = 0;
+
+    for (size_t i = 0; i < STREAM_SIZE; ++i) {
+        state->bytes[i] = next_random(&seed);
+    }
+
+    return state;
+}
+
+static void teardown_stream(void* state)
+{
+    free(state);
+}
+
+static int read_cycling(void* context)
+{
+    struct stream_state* state = context;
+
+    state->position = (state->position + 1) % STREAM_SIZE;
+    return state->bytes[state->position];
+}
+
+static void write_discarding(unsigned char c, void* context)
+{
+    (void) context;
+    sink += c;
+}
+
+static size_t run_outs_write_bits(void* s, size_t ops)
+{
+    struct stream_state* state = s;
+    struct outstream* outs = outs_init(NULL, write_discarding);
+    uint32_t const mask = (UINT32_C(1) << state->bits) - 1;
+
+    if (outs == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ops; ++i) {
+        outs_write_bits(outs, (i * 2654435761u) & mask, state->bits);
+    }
+
+    outs_destroy(outs);
+    return ops;
+}
+
+static size_t run_ins_read_bits(void* s, size_t ops)
+{
+    struct stream_state* state = s;
+    struct instream* ins = ins_init(state, read_cycling);
+    uint64_t total = 0;
+
+    if (ins == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ops; ++i) {
+        total += ins_read_bits(ins, state->bits);
+    }
+
+    sink += total;
+    ins_destroy(ins);
+
+    return ops;
+}
+
+/*
+ * Sequence state: the length to build sequences up to, and a sequence of
+ * that length to read from.
+ */
+
+struct seq_state {
+    size_t length;
+    struct sequence* seq;
+};
+
+static void* setup_seq(unsigned int length)
+{
+    struct seq_state* state = malloc(sizeof(*state));
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    state->length = length;
+    state->seq = seq_init(1);
+
+    for (size_t i = 0; state->seq != NULL && i < length; ++i) {
+        seq_push(state->seq, 'a' + i % 26);
+    }
+
+    if (state->seq == NULL) {
+        free(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+static void teardown_seq(void* s)
+{
+    struct seq_state* state = s;
+
+    seq_destroy(state->seq);
+    free(state);
+}
+
+/*
+ * run_seq_push: Build sequences up to the length from empty, so that
+ *               growing them is included.
+ */
+
+static size_t run_seq_push(void* s, size_t ops)
+{
+    struct seq_state* state = s;
+    size_t done = 0;
+
+    while (done < ops) {
+        struct sequence* seq = seq_init(1);
+
+        if (seq == NULL) {
+            break;
+        }
+
+        for (size_t i = 0; i < state->length; ++i) {
+            seq_push(seq, 'a' + i % 26);
+        }
+
+        sink += seq_length(seq);
+        seq_destroy(seq);
+        done += state->length;
+    }
+
+    return done;
+}
+
+static size_t run_seq_get(void* s, size_t ops)
+{
+    struct seq_state* state = s;
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < ops; ++i) {
+        total += seq_get(state->seq, i % state->length);
+    }
+
+    sink += total;
+    return ops;
+}
+
+static size_t run_seq_to_cstr(void* s, size_t ops)
+{
+    struct seq_state* state = s;
+
+    for (size_t i = 0; i < ops; ++i) {
+        char* cstr = seq_to_cstr(state->seq);
+
+        sink += (cstr != NULL) ? (unsigned char) cstr[0] : 0;
+        free(cstr);
+    }
+
+    return ops;
+}
+
+/*
+ * Batch state: the streams, each with its own input and position, and the
+ * lzw_stream descriptions of them.
+ */
+
+struct batch_input {
+    unsigned char const* bytes;
+    size_t length;
+    size_t position;
+};
+
+struct batch_state {
+    unsigned char* data;
+    size_t count;
+    struct batch_input* inputs;
+    struct lzw_stream* streams;
+};
+
+static int read_batch_input(void* context)
+{
+    struct batch_input* input = context;
+
+    return (input->position < input->length) ?
+        input->bytes[input->position++] :
+        EOF;
+}
+
+static void teardown_batch(void* s)
+{
+    struct batch_state* state = s;
+
+    free(state->data);
+    free(state->inputs);
+    free(state->streams);
+    free(state);
+}
+
+static void* setup_batch(unsigned int length)
+{
+    struct batch_state* state = malloc(sizeof(*state));
+
+    if (state == NULL) {
+        return NULL;
+    }
+
+    state->count = BATCH_TOTAL / length;
+    state->data = malloc(BATCH_TOTAL);
+    state->inputs = malloc(sizeof(*state->inputs) * state->count);
+    state->streams = malloc(sizeof(*state->streams) * state->count);
+
+    if (state->data == NULL || state->inputs == NULL
+            || state->streams == NULL) {
+        teardown_batch(state);
+        return NULL;
+    }
+
+    // each stream is a sample of its own, as independent requests would be
+    for (size_t i = 0; i < state->count; ++i) {
+        unsigned char* const bytes = state->data + i * length;
+
+        corpus_fill(corpus_find("logs"), bytes, length, i);
+
+        state->inputs[i].bytes = bytes;
+        state->inputs[i].length = length;
+        state->streams[i].read_byte = read_batch_input;
+        state->streams[i].write_byte = write_discarding;
+        state->streams[i].context = &state->inputs[i];
+    }
+
+    return state;
+}
+
+/*
+ * rewind_batch: Start every stream over, returning their total length.
+ */
+
+static size_t rewind_batch(struct batch_state* state)
+{
+    for (size_t i = 0; i < state->count; ++i) {
+        state->inputs[i].position = 0;
+    }
+
+    return BATCH_TOTAL / state->count * state->count;
+}
+
+/*
+ * run_encode_seq: Encode the streams one after the other, an op being a
+ *                 byte of input.
+ */
+
+static size_t run_encode_seq(void* s, size_t ops)
+{
+    struct batch_state* state = s;
+    size_t done = 0;
+
+    while (done < ops) {
+        size_t const total = rewind_batch(state);
+
+        for (size_t i = 0; i < state->count; ++i) {
+            if (!lzw_encode(LZW_MINIMUM_BITS, BATCH_MAX_BITS,
+                            read_batch_input, write_discarding,
+                            &state->inputs[i])) {
+                return 0;
+            }
+        }
+
+        done += total;
+    }
+
+    return done;
+}
+
+/*
+ * run_encode_batch: Encode the same streams with lzw_encode_batch().
+ */
+
+static size_t run_encode_batch(void* s, size_t ops)
+{
+    struct batch_state* state = s;
+    size_t done = 0;
+
+    while (done < ops) {
+        size_t const total = rewind_batch(state);
+
+        if (!lzw_encode_batch(LZW_MINIMUM_BITS, BATCH_MAX_BITS,
+                              state->streams, state->count)) {
+            return 0;
+        }
+
+        done += total;
+    }
+
+    return done;
+}
+
+static struct micro const micros[] = {
+    { "trie_lookup", "key", { 1, 4, 16, 32 },
+      setup_trie, run_trie_lookup, teardown_trie },
+    { "trie_insert", "key", { 1, 4, 16, 32 },
+      setup_trie, run_trie_insert, teardown_trie },
+    { "dict_lookup", "fill", { 1 << 8, 1 << 12, 1 << 16, 1 << 20 },
+      setup_dict, run_dict_lookup, teardown_dict },
+    { "dict_insert", "fill", { 1 << 8, 1 << 12, 1 << 16, 1 << 20 },
+      setup_dict, run_dict_insert, teardown_dict },
+    { "outs_write_bits", "bits", { 8, 9, 16, 24 },
+      setup_stream, run_outs_write_bits, teardown_stream },
+    { "ins_read_bits", "bits", { 8, 9, 16, 24 },
+      setup_stream, run_ins_read_bits, teardown_stream },
+    { "seq_push", "length", { 16, 256, 4096, 65536 },
+      setup_seq, run_seq_push, teardown_seq },
+    { "seq_get", "length", { 16, 256, 4096, 65536 },
+      setup_seq, run_seq_get, teardown_seq },
+    { "seq_to_cstr", "length", { 16, 256, 4096, 65536 },
+      setup_seq, run_seq_to_cstr, teardown_seq },
+    { "encode_seq", "length", { 256, 4096, 65536, 1 << 20 },
+      setup_batch, run_encode_seq, teardown_batch },
+    { "encode_batch", "length", { 256, 4096, 65536, 1 << 20 },
+      setup_batch, run_encode_batch, teardown_batch }
+};
+
+/*
+ * compare_costs: qsort() comparison of per-op costs.
+ */
+
+static int compare_costs(void const* a, void const* b)
+{
+    double const x = *(double const*) a;
+    double const y = *(double const*) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * measure: Find an op count that takes at least MIN_TICKS, which doubles as
+ *          the warmup, then time the given number of repetitions. Stores
+ *          the fastest and median cost per op.
+ */
+
+static bool measure(struct micro const* micro, unsigned int param,
+        unsigned int repetitions, double* best, double* median)
+{
+    void* state = (micro->setup)(param);
+
+    if (state == NULL) {
+        return false;
+    }
+
+    size_t ops = 1;
+
+    while (true) {
+        uint64_t const start = ticks();
+        size_t const done = (micro->run)(state, ops);
+
+        if (done == 0) {
+            (micro->teardown)(state);
+            return false;
+        }
+
+        if (ticks() - start >= MIN_TICKS) {
+            break;
+        }
+
+        ops = done * 2;
+    }
+
+    double costs[MAX_REPETITIONS];
+
+    for (unsigned int i = 0; i < repetitions; ++i) {
+        uint64_t const start = ticks();
+        size_t const done = (micro->run)(state, ops);
+
+        costs[i] = (double) (ticks() - start) / done;
+    }
+
+    (micro->teardown)(state);
+
+    qsort(costs, repetitions, sizeof(costs[0]), compare_costs);
+    *best = costs[0];
+    *median = costs[repetitions / 2];
+
+    return true;
+}
+
+static void usage(FILE* stream)
+{
+    fprintf(stream, "Usage: %s [-r N] [NAME...]\n\n", program_name);
+
+    fprintf(stream, "Times each primitive in " TICK_UNIT " per op, at "
+                    "several sizes.\n");
+    fprintf(stream, "If NAMEs are given, only the benchmarks whose names "
+                    "start\nwith one of them are run.\n\n");
+
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "\t-r N\tTime each case N times, up to %d "
+                    "(default 7)\n", MAX_REPETITIONS);
+}
+
+/*
+ * selected: Check if a benchmark was asked for on the command line.
+ */
+
+static bool selected(char const* name, char* const* names, size_t count)
+{
+    if (count == 0) {
+        return true;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (strncmp(name, names[i], strlen(names[i])) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    program_name = argv[0];
+
+    unsigned int repetitions = 7;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hr:")) != -1) {
+        switch (opt) {
+        case 'h':
+            usage(stdout);
+            return EXIT_SUCCESS;
+        case 'r':
+            repetitions = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (repetitions == 0 || repetitions > MAX_REPETITIONS) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-16s %-14s %12s %12s\n", "benchmark", "parameter",
+           "best", "median");
+
+    for (size_t i = 0; i < sizeof(micros) / sizeof(micros[0]); ++i) {
+        struct micro const* micro = &micros[i];
+
+        if (!selected(micro->name, argv + optind, argc - optind)) {
+            continue;
+        }
+
+        for (size_t j = 0; j < 4; ++j) {
+            char param[32];
+            double best;
+            double median;
+
+            snprintf(param, sizeof(param), "%s=%u", micro->param_name,
+                     micro->params[j]);
+
+            if (!measure(micro, micro->params[j], repetitions, &best,
+                         &median)) {
+                printf("%-16s %-14s failed\n", micro->name, param);
+                continue;
+            }
+
+            printf("%-16s %-14s %12.2f %12.2f %s/op\n", micro->name, param,
+                   best, median, TICK_UNIT);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,471 @@
+#include "lzw.h"
+#include "corpus.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INIT_BITS 8
+
+// wider tables than this outgrow the default memory ceiling, so they're
+// only tested when asked for
+#define DEFAULT_MAX_BITS 24
+#define BLOCK_SIZE (1024 * 1024)
+#define READ_SIZE (64 * 1024)
+
+static char const* program_name;
+
+/*
+ * The settings of a run. The size is that of the input streamed through
+ * each width.
+ */
+
+struct options {
+    unsigned long long size;
+    unsigned int min_bits;
+    unsigned int max_bits;
+    double min_mbs;
+    long max_rss_kb;
+};
+
+/*
+ * The outcome of streaming the input through a single width.
+ */
+
+struct result {
+    unsigned int max_bits;
+    unsigned long long compressed;
+    double mbs;
+    long peak_rss_kb;
+
+    // the first thing that went wrong, or empty
+    char error[32];
+};
+
+/*
+ * A synthetic input of any length, generated a block at a time. Successive
+ * blocks cycle through the kinds of corpus, each block a new variant, so
+ * the dictionary keeps seeing different data. Two sources of the same size
+ * produce the same bytes, so one can feed the encoder while the other
+ * checks the decoder's output.
+ */
+
+struct source {
+    struct corpus const* corpora;
+    size_t corpus_count;
+
+    unsigned long long remaining;
+    unsigned long block_index;
+
+    unsigned char* block;
+    size_t length;
+    size_t position;
+};
+
+/*
+ * The encoding half of a round trip: the decoder pulls compressed bytes,
+ * and the encoder is given more input whenever they run out. Only a block
+ * of input and its compressed bytes are held at a time.
+ */
+
+struct pipe {
+    struct source input;
+    struct lzw_encoder* enc;
+    bool finished;
+    bool failed;
+
+    unsigned char* compressed;
+    size_t length;
+    size_t capacity;
+    size_t position;
+    unsigned long long total;
+};
+
+static void usage(FILE* stream)
+{
+    fprintf(stream, "Usage: %s [-s MB] [-b BITS | -B MIN-MAX] [-t MB/S] "
+                    "[-m MB]\n\n", program_name);
+
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "\t-s MB\t\tInput to stream through each width "
+                    "(default 2048)\n");
+    fprintf(stream, "\t-b BITS\t\tOnly test the given maximum width\n");
+    fprintf(stream, "\t-B MIN-MAX\tTest the maximum widths from MIN to MAX "
+                    "(default 9-%d)\n", DEFAULT_MAX_BITS);
+    fprintf(stream, "\t-t MB/S\t\tSlowest acceptable round trip "
+                    "(default 1)\n");
+    fprintf(stream, "\t-m MB\t\tLargest acceptable peak memory use "
+                    "(default 768)\n");
+}
+
+/*
+ * now: Get the time on a monotonic clock, in seconds.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool source_init(struct source* src, unsigned long long size)
+{
+    src->corpora = corpus_all(&src->corpus_count);
+    src->remaining = size;
+    src->block_index = 0;
+    src->block = malloc(BLOCK_SIZE);
+    src->length = 0;
+    src->position = 0;
+
+    return src->block != NULL;
+}
+
+/*
+ * source_next: Generate the next block, returning its length, which is 0
+ *              at the end of the input.
+ */
+
+static size_t source_next(struct source* src)
+{
+    size_t const length = (src->remaining < BLOCK_SIZE) ?
+        src->remaining :
+        BLOCK_SIZE;
+    struct corpus const* corpus =
+        &src->corpora[src->block_index % src->corpus_count];
+
+    corpus_fill(corpus, src->block, length,
+                src->block_index / src->corpus_count);
+
+    src->remaining -= length;
+    ++src->block_index;
+    src->length = length;
+    src->position = 0;
+
+    return length;
+}
+
+static void write_compressed(unsigned char c, void* context)
+{
+    struct pipe* p = context;
+
+    if (p->length == p->capacity) {
+        size_t const new_capacity = p->capacity * 2 + 4096;
+        unsigned char* new_compressed = realloc(p->compressed, new_capacity);
+
+        if (new_compressed == NULL) {
+            p->failed = true;
+            return;
+        }
+
+        p->compressed = new_compressed;
+        p->capacity = new_capacity;
+    }
+
+    p->compressed[p->length++] = c;
+}
+
+/*
+ * read_compressed: Hand the decoder the next compressed byte, encoding
+ *                  blocks of input until there is one.
+ */
+
+static int read_compressed(void* context)
+{
+    struct pipe* p = context;
+
+    while (p->position == p->length) {
+        if (p->finished || p->failed) {
+            return EOF;
+        }
+
+        p->position = 0;
+        p->length = 0;
+
+        size_t const length = source_next(&p->input);
+
+        if (length == 0) {
+            p->failed = !lzw_encoder_finish(p->enc);
+            p->finished = true;
+        } else {
+            p->failed = !lzw_encoder_write(p->enc, p->input.block, length);
+        }
+
+        p->total += p->length;
+    }
+
+    return p->compressed[p->position++];
+}
+
+/*
+ * check_output: Compare decoded bytes against the input they should match.
+ *               Returns false at the first difference.
+ */
+
+static bool check_output(struct source* expected, unsigned char const* bytes,
+        size_t length)
+{
+    while (length > 0) {
+        if (expected->position == expected->length
+                && source_next(expected) == 0) {
+            return false;
+        }
+
+        size_t n = expected->length - expected->position;
+
+        if (n > length) {
+            n = length;
+        }
+
+        if (memcmp(expected->block + expected->position, bytes, n) != 0) {
+            return false;
+        }
+
+        expected->position += n;
+        bytes += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+/*
+ * round_trip: Stream the input through an encoder and a reader at the
+ *             given maximum width, checking every decoded byte.
+ */
+
+static struct result round_trip(unsigned int max_bits,
+        struct options const* options)
+{
+    struct result result;
+    memset(&result, 0, sizeof(result));
+    result.max_bits = max_bits;
+
+    struct pipe p;
+    struct source expected;
+    memset(&p, 0, sizeof(p));
+    memset(&expected, 0, sizeof(expected));
+
+    unsigned char* buffer = malloc(READ_SIZE);
+    bool const ready = source_init(&p.input, options->size)
+        && source_init(&expected, options->size)
+        && buffer != NULL;
+
+    double const start = now();
+    struct lzw_reader* reader = NULL;
+
+    p.enc = ready ?
+        lzw_encoder_init(INIT_BITS, max_bits, write_compressed, &p) :
+        NULL;
+    reader = (p.enc != NULL) ?
+        lzw_reader_open(INIT_BITS, max_bits, read_compressed, &p) :
+        NULL;
+
+    char const* error = (reader == NULL) ? "out of memory" : NULL;
+    unsigned long long decoded = 0;
+    size_t n;
+
+    while (error == NULL
+            && (n = lzw_reader_read(reader, buffer, READ_SIZE)) > 0) {
+        if (!check_output(&expected, buffer, n)) {
+            error = "output differs from input";
+        }
+
+        decoded += n;
+    }
+
+    if (error == NULL) {
+        if (p.failed) {
+            error = "encoding failed";
+        } else if (lzw_reader_error(reader)) {
+            error = "decoding failed";
+        } else if (decoded != options->size) {
+            error = "output is too short";
+        }
+    }
+
+    if (error != NULL) {
+        snprintf(result.error, sizeof(result.error), "%s", error);
+    }
+
+    double const elapsed = now() - start;
+
+    result.compressed = p.total;
+    result.mbs = (elapsed > 0) ? decoded / 1e6 / elapsed : 0;
+
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        result.peak_rss_kb = usage.ru_maxrss;
+    }
+
+    lzw_reader_close(reader);
+    lzw_encoder_destroy(p.enc);
+    free(p.compressed);
+    free(p.input.block);
+    free(expected.block);
+    free(buffer);
+
+    return result;
+}
+
+/*
+ * run_width: Run a round trip in a child process, so that its peak memory
+ *            use isn't mixed up with that of the widths before it.
+ */
+
+static bool run_width(unsigned int max_bits, struct options const* options,
+        struct result* result)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t const pid = fork();
+
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+
+        struct result const r = round_trip(max_bits, options);
+        bool const written = write(fds[1], &r, sizeof(r)) == sizeof(r);
+
+        _exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+
+    bool const received = read(fds[0], result, sizeof(*result))
+        == sizeof(*result);
+    int status;
+
+    close(fds[0]);
+
+    return waitpid(pid, &status, 0) == pid
+        && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS
+        && received;
+}
+
+/*
+ * parse_options: Read the command line into options.
+ */
+
+static bool parse_options(int argc, char** argv, struct options* options)
+{
+    int opt;
+
+    options->size = 2048;
+    options->min_bits = 9;
+    options->max_bits = DEFAULT_MAX_BITS;
+    options->min_mbs = 1;
+    options->max_rss_kb = 768;
+
+    while ((opt = getopt(argc, argv, "B:b:hm:s:t:")) != -1) {
+        switch (opt) {
+        case 'B':
+            if (sscanf(optarg, "%u-%u", &options->min_bits,
+                       &options->max_bits) != 2) {
+                return false;
+            }
+            break;
+        case 'b':
+            options->min_bits = strtoul(optarg, NULL, 10);
+            options->max_bits = options->min_bits;
+            break;
+        case 'h':
+            usage(stdout);
+            exit(EXIT_SUCCESS);
+        case 'm':
+            options->max_rss_kb = strtol(optarg, NULL, 10);
+            break;
+        case 's':
+            options->size = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            options->min_mbs = strtod(optarg, NULL);
+            break;
+        default:
+            return false;
+        }
+    }
+
+    options->size *= 1024 * 1024;
+    options->max_rss_kb *= 1024;
+
+    return optind == argc && options->size > 0
+        && options->min_bits > INIT_BITS
+        && options->min_bits <= options->max_bits
+        && options->max_bits <= LZW_MAXIMUM_BITS;
+}
+
+int main(int argc, char** argv)
+{
+    program_name = argv[0];
+
+    struct options options;
+
+    if (!parse_options(argc, argv, &options)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    unsigned int failures = 0;
+
+    printf("%4s %10s %8s %10s %10s\n", "bits", "MB", "ratio", "MB/s",
+           "peak MB");
+
+    for (unsigned int bits = options.min_bits; bits <= options.max_bits;
+            ++bits) {
+        struct result r;
+
+        if (!run_width(bits, &options, &r)) {
+            printf("%4u failed to run\n", bits);
+            ++failures;
+            continue;
+        }
+
+        printf("%4u %10.0f %8.4f %10.1f %10.1f", bits,
+               options.size / 1048576.0, (double) r.compressed / options.size,
+               r.mbs, r.peak_rss_kb / 1024.0);
+
+        if (r.error[0] == '\0' && r.mbs < options.min_mbs) {
+            snprintf(r.error, sizeof(r.error), "too slow");
+        }
+
+        if (r.error[0] == '\0' && r.peak_rss_kb > options.max_rss_kb) {
+            snprintf(r.error, sizeof(r.error), "too much memory");
+        }
+
+        if (r.error[0] != '\0') {
+            printf("  FAIL: %s", r.error);
+            ++failures;
+        }
+
+        printf("\n");
+    }
+
+    if (failures > 0) {
+        printf("%u of %u widths failed\n", failures,
+               options.max_bits - options.min_bits + 1);
+    }
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,10 +7,26 @@
 #define BITOPS_H_
 
 #include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /*
  * BITS_IN(x): Evaluates to the number of bits in x.
  */
 #define BITS_IN(x) (CHAR_BIT * sizeof(x))
 
+/*
+ * phased_width: The fewest bits, no more than bit_count, that can tell
+ *               range values apart. This is the length of the longer
+ *               codes of a truncated binary code for range values.
+ */
+static inline size_t phased_width(uint64_t range, size_t bit_count)
+{
+    while (bit_count > 1 && range <= (uint64_t) 1 << (bit_count - 1)) {
+        --bit_count;
+    }
+
+    return bit_count;
+}
+
 #endif // BITOPS_H_
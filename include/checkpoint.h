@@ -0,0 +1,48 @@
+/*
+ * checkpoint.h: Reading and writing the fields of a saved coder state.
+ *
+ * Checkpoint format, with integers in little-endian order:
+ *  - the magic bytes "LZWK"
+ *  - a byte naming the kind of coder: 'E' for an encoder, 'D' for a decoder
+ *  - a version byte, currently 1
+ *  - the coder's own fields, as written by encoder.c or decoder.c. Codes
+ *      that may be -1 are stored plus one, so that every field is unsigned.
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHECKPOINT_MAGIC "LZWK"
+#define CHECKPOINT_VERSION 1
+
+#define CHECKPOINT_ENCODER 'E'
+#define CHECKPOINT_DECODER 'D'
+
+struct checkpoint_writer {
+    void (*write_byte)(unsigned char c, void* context);
+    void* context;
+};
+
+/*
+ * A failed read leaves the reader failed, and every later read returns 0,
+ * so a whole checkpoint can be read before checking for errors once.
+ */
+
+struct checkpoint_reader {
+    int (*read_byte)(void* context);
+    void* context;
+    bool failed;
+};
+
+void checkpoint_put_header(struct checkpoint_writer* w, char kind);
+void checkpoint_put(struct checkpoint_writer* w, uint32_t value,
+        size_t byte_count);
+
+bool checkpoint_check_header(struct checkpoint_reader* r, char kind);
+uint32_t checkpoint_get(struct checkpoint_reader* r, size_t byte_count);
+
+#endif // CHECKPOINT_H_
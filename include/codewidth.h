@@ -0,0 +1,55 @@
+/*
+ * codewidth.h: The rules for growing the code width and handing out new
+ *              codes, shared by everything that has to stay in step with
+ *              the encoder.
+ */
+
+#ifndef CODEWIDTH_H_
+#define CODEWIDTH_H_
+
+#include "lzw.h"
+#include "config.h"
+
+struct codewidth {
+    code_t next_code;
+    unsigned int cur_bits;
+    unsigned int max_bits;
+};
+
+void cw_init(struct codewidth* cw, unsigned int start_bits,
+        unsigned int max_bits);
+
+/*
+ * cw_advance: Update the state after a code has been written at cur_bits.
+ *             Returns the code assigned to the new dictionary entry, or -1
+ *             if the dictionary is full.
+ */
+code_t cw_advance(struct codewidth* cw);
+
+/*
+ * cw_sync_marker: Get the code that marks a sync flush, which is the largest
+ *                 value at the current width. cw_advance() never hands it
+ *                 out, so past the first code it can't be mistaken for one.
+ */
+code_t cw_sync_marker(struct codewidth const* cw);
+
+/*
+ * Phase-in codes:
+ *  - phased_range() is the number of values the next code can take: every
+ *      code handed out so far and the sync marker, as long as they fit at
+ *      the current width.
+ *  - to_phased() numbers the marker just past the codes, so that every
+ *      value is below the range, and from_phased() undoes it.
+ */
+uint64_t cw_phased_range(struct codewidth const* cw);
+code_t cw_to_phased(struct codewidth const* cw, code_t code);
+code_t cw_from_phased(struct codewidth const* cw, code_t value);
+
+/*
+ * cw_stats: Fill in the statistics that follow from the code width state
+ *           and the per-width code counts.
+ */
+void cw_stats(struct codewidth const* cw, unsigned int start_bits,
+        struct lzw_stats* stats);
+
+#endif // CODEWIDTH_H_
@@ -8,9 +8,21 @@
 #include <stdint.h>
 
 #define LZW_MINIMUM_BITS 8
-#define LZW_MAXIMUM_BITS 24
 #define LZW_CHAR_RANGE 256
 
+// the longest string the LZMW and LZAP growth policies add to the table
+#define LZW_GROWTH_MAX_LENGTH 65536
+
+// building with WIDE=1 defines LZW_WIDE_CODES, which allows codes of up to
+// 32 bits for very large inputs. Codes then need 64 bits to leave room for
+// -1, which makes every table that holds them wider, so it's left off by
+// default.
+#ifdef LZW_WIDE_CODES
+#define LZW_MAXIMUM_BITS 32
+typedef int64_t code_t;
+#else
+#define LZW_MAXIMUM_BITS 24
 typedef int32_t code_t;
+#endif
 
 #endif // CONFIG_H_
@@ -0,0 +1,135 @@
+/*
+ * decoder.h: The LZW decoding state machine behind lzw_decode(). Codes are
+ *            read one at a time and expanded into the strings they stand for.
+ */
+
+#ifndef DECODER_H_
+#define DECODER_H_
+
+#include <stddef.h>
+
+#include "lzw.h"
+#include "checkpoint.h"
+#include "config.h"
+
+struct decoder;
+
+enum decoder_status {
+    DECODER_OK,
+    DECODER_EOF,
+    DECODER_ERROR
+};
+
+struct decoder* decoder_init(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context), void* context);
+void decoder_destroy(struct decoder* dec);
+
+/*
+ * decoder_init_source: Like decoder_init(), except that codes are taken
+ *                      from next_code, which is given the expected width and
+ *                      returns the code or EOF.
+ */
+struct decoder* decoder_init_source(unsigned int start_bits,
+        unsigned int max_bits,
+        code_t (*next_code)(void* source, unsigned int bits),
+        void* source);
+
+/*
+ * decoder_seed: Add the entries of a trained dictionary to a new decoder's
+ *               table. Returns false if the dictionary doesn't fit within
+ *               the decoder's widths or allocation fails.
+ */
+bool decoder_seed(struct decoder* dec, struct lzw_dictionary const* dict);
+
+/*
+ * decoder_enable_phase_in: Read codes written with phase-in codes. Returns
+ *                          false for a decoder made with
+ *                          decoder_init_source() or one that has already
+ *                          read a code.
+ */
+bool decoder_enable_phase_in(struct decoder* dec);
+
+/*
+ * decoder_enable_lru: Replace the least recently used entries once the
+ *                     table is full, as an encoder with LRU replacement
+ *                     does. Returns false for a seeded decoder, one with a
+ *                     growth policy, or one that has already read a code.
+ */
+bool decoder_enable_lru(struct decoder* dec);
+
+/*
+ * decoder_set_growth: Grow the table the way an encoder with the given
+ *                     policy does. Returns false for a seeded decoder, one
+ *                     reading phase-in codes or replacing entries, one that
+ *                     has already read a code, or if allocation fails.
+ */
+bool decoder_set_growth(struct decoder* dec, enum lzw_growth policy);
+
+/*
+ * decoder_next: Read the next code and point string at its expansion, which
+ *               stays valid until the next call. Returns DECODER_EOF once the
+ *               input is exhausted, or DECODER_ERROR on corrupt input or
+ *               allocation failure.
+ */
+enum decoder_status decoder_next(struct decoder* dec,
+        unsigned char const** string, size_t* length);
+
+/*
+ * decoder_next_code: Like decoder_next(), but only read the next code into
+ *                    code without expanding it. If the code completed a
+ *                    table entry, its code is stored in added, otherwise
+ *                    added is -1, as it always is under a growth policy
+ *                    other than LZW_GROWTH_LZW.
+ */
+enum decoder_status decoder_next_code(struct decoder* dec, code_t* code,
+        code_t* added);
+
+/*
+ * decoder_expand: Point string at the expansion of a code that is already
+ *                 in the table, which stays valid until the next call to
+ *                 decoder_next() or decoder_expand(). Returns false if
+ *                 allocation fails.
+ */
+bool decoder_expand(struct decoder* dec, code_t code,
+        unsigned char const** string, size_t* length);
+
+/*
+ * decoder_entry: Get the prefix code, last byte and length of the string of
+ *                a code that is already in the table. The prefix of a single
+ *                byte is -1.
+ */
+void decoder_entry(struct decoder const* dec, code_t code, code_t* prefix,
+        unsigned char* suffix, size_t* length);
+
+/*
+ * decoder_stats: Get the statistics of the decoding so far.
+ */
+void decoder_stats(struct decoder const* dec, struct lzw_stats* stats);
+
+/*
+ * decoder_current: Point string at the expansion of the most recent code
+ *                  again, as decoder_next() last returned it. The length is
+ *                  zero if nothing has been decoded yet. Returns false if
+ *                  allocation fails.
+ */
+bool decoder_current(struct decoder* dec, unsigned char const** string,
+        size_t* length);
+
+/*
+ * Checkpoints:
+ *  - checkpoint() writes the state of a decoder that reads its own input,
+ *      including the unread bits of the last byte it read. It fails for a
+ *      decoder made with decoder_init_source(), reading phase-in codes,
+ *      replacing entries or with a growth policy other than
+ *      LZW_GROWTH_LZW.
+ *  - resume() creates a decoder from such a checkpoint, which carries on
+ *      reading via read_byte from just after the last byte the original
+ *      had read. It returns NULL if the checkpoint is malformed.
+ * The caller may add its own fields after the decoder's.
+ */
+bool decoder_checkpoint(struct decoder const* dec,
+        struct checkpoint_writer* w);
+struct decoder* decoder_resume(struct checkpoint_reader* r,
+        int (*read_byte)(void* context), void* context);
+
+#endif // DECODER_H_
@@ -0,0 +1,72 @@
+/*
+ * dict.h: The LZW string table, stored as a hash table mapping
+ *         (prefix code, next byte) pairs to the code of the extended string.
+ *         Single-byte strings are implicit (their code is the byte value),
+ *         so only multi-byte entries are ever stored.
+ */
+
+#ifndef DICT_H_
+#define DICT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "config.h"
+
+struct dict;
+
+struct dict* dict_init(size_t capacity);
+void dict_destroy(struct dict* dict);
+
+/*
+ * dict_init_overlay: Initialize a dictionary layered over base, which must
+ *                    no longer change and must outlive it. Lookups see the
+ *                    entries of both, but inserts and clears only affect the
+ *                    overlay, so creating one costs the same however large
+ *                    base is. base is only read, so several overlays may
+ *                    share it across threads.
+ */
+struct dict* dict_init_overlay(struct dict const* base, size_t capacity);
+
+size_t dict_size(struct dict const* dict);
+
+/*
+ * dict_memory: Get the number of bytes the dictionary currently holds, and
+ *              store the number it has allocated over its life in
+ *              allocated. The dictionaries under an overlay aren't counted.
+ */
+size_t dict_memory(struct dict const* dict, unsigned long long* allocated);
+
+/*
+ * dict_clear: Remove every entry, keeping the table for reuse. Returns false
+ *             if allocation fails, in which case the dictionary is unchanged.
+ */
+bool dict_clear(struct dict* dict);
+
+/*
+ * Dictionary operations:
+ *  - lookup() returns the code of the string formed by appending c to the
+ *      string with code prefix, or -1 if there is no such entry.
+ *  - insert() adds the entry, returning false if allocation fails or the
+ *      entry is already present. An overlay only checks its own entries.
+ *  - remove() takes the entry out, returning false if it isn't present.
+ *      An overlay can only remove its own entries.
+ *  - prefetch() hints that the slot for the given entry will be probed soon.
+ *      It has no observable effect.
+ */
+code_t dict_lookup(struct dict const* dict, code_t prefix, unsigned char c);
+bool dict_insert(struct dict* dict, code_t prefix, unsigned char c,
+        code_t code);
+bool dict_remove(struct dict* dict, code_t prefix, unsigned char c);
+void dict_prefetch(struct dict const* dict, code_t prefix, unsigned char c);
+
+/*
+ * dict_visit: Call visit with every entry, including those of the
+ *             dictionaries underneath an overlay, in no particular order.
+ */
+void dict_visit(struct dict const* dict,
+        void (*visit)(code_t prefix, unsigned char c, code_t code,
+                      void* context),
+        void* context);
+
+#endif // DICT_H_
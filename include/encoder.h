@@ -0,0 +1,22 @@
+/*
+ * encoder.h: Internal hooks into the encoder behind lzw_encoder_*(), for
+ *            callers that want the codes themselves rather than bytes.
+ */
+
+#ifndef ENCODER_H_
+#define ENCODER_H_
+
+#include "lzw.h"
+#include "config.h"
+
+/*
+ * encoder_init_sink: Like lzw_encoder_init(), except that each code is
+ *                    passed to emit along with its width instead of being
+ *                    packed into bytes. finish() emits the last code.
+ */
+struct lzw_encoder* encoder_init_sink(unsigned int start_bits,
+        unsigned int max_bits,
+        void (*emit)(void* sink, code_t code, unsigned int bits),
+        void* sink);
+
+#endif // ENCODER_H_
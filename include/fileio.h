@@ -0,0 +1,73 @@
+/*
+ * fileio.h: File input and output for the command-line interface.
+ *           Regular input files are memory-mapped and handed to the coder
+ *           without copying; other inputs are read in large blocks. Output
+ *           is collected in large aligned buffers and written with write(2),
+ *           except for pipes, which go through stdio.
+ */
+
+#ifndef FILEIO_H_
+#define FILEIO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+struct source {
+    int fd;
+    bool owns_fd;
+
+    // the whole file when it's mapped, otherwise the current block
+    unsigned char* data;
+    size_t length;
+    size_t position;
+    bool mapped;
+
+    bool eof;
+    bool ok;
+};
+
+struct sink {
+    int fd;
+    bool owns_fd;
+
+    // set when writing to a pipe
+    FILE* stream;
+
+    unsigned char* buffer;
+    size_t length;
+    size_t capacity;
+
+    bool ok;
+};
+
+/*
+ * Opening a path of NULL or "-" uses stdin or stdout.
+ */
+bool source_open(struct source* src, char const* path);
+bool source_close(struct source* src);
+
+bool sink_open(struct sink* snk, char const* path);
+bool sink_close(struct sink* snk);
+
+/*
+ * sink_flush: Write out everything buffered so far. Returns false if
+ *             writing has failed at any point.
+ */
+bool sink_flush(struct sink* snk);
+
+/*
+ * source_next_block: Point block at the next unread part of the input and
+ *                    return its length, or 0 at the end of the input.
+ *                    A mapped file is returned in a single block.
+ */
+size_t source_next_block(struct source* src, unsigned char const** block);
+
+/*
+ * Callbacks for lzw_encode() and friends, with a struct source or
+ * struct sink as the context.
+ */
+int source_read_byte(void* src);
+void sink_write_byte(unsigned char c, void* snk);
+
+#endif // FILEIO_H_
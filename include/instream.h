@@ -15,6 +15,39 @@ struct instream* ins_init(void* context,
 
 void ins_destroy(struct instream* ins);
 
-int32_t ins_read_bits(struct instream* ins, size_t bit_count);
+/*
+ * ins_read_bits: Read bit_count bits, returning EOF if the input runs out.
+ *                Reads of up to 32 bits are supported.
+ */
+int64_t ins_read_bits(struct instream* ins, size_t bit_count);
+
+/*
+ * ins_read_phased: Read a value written by outs_write_phased() with the same
+ *                  range and bit_count. Returns EOF if the input runs out.
+ */
+int64_t ins_read_phased(struct instream* ins, uint64_t range,
+        size_t bit_count);
+
+/*
+ * ins_bytes_read: Get the number of bytes read so far.
+ */
+unsigned long long ins_bytes_read(struct instream const* ins);
+
+/*
+ * ins_align: Discard the unread bits of the last byte read, so that the
+ *            next read starts at a byte boundary.
+ */
+void ins_align(struct instream* ins);
+
+/*
+ * Partial byte:
+ *  - get_pending() returns the unread bits of the last byte read, aligned
+ *      to the most significant end, and stores their number in bit_count.
+ *  - set_pending() replaces them, so that a stream can be continued from
+ *      the middle of a byte.
+ */
+unsigned char ins_get_pending(struct instream const* ins, size_t* bit_count);
+void ins_set_pending(struct instream* ins, unsigned char bits,
+        size_t bit_count);
 
 #endif // INSTREAM_H_
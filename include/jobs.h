@@ -0,0 +1,28 @@
+/*
+ * jobs.h: Codes many files in one process, spreading them over a pool of
+ *         worker threads. Each worker keeps its coder between files, so the
+ *         per-file cost is little more than opening the files.
+ */
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Output names:
+ * Encoding PATH writes PATH.lzw, and decoding PATH.lzw writes PATH. Files
+ * that can't be coded are reported on stderr and skipped.
+ */
+#define JOBS_SUFFIX ".lzw"
+
+/*
+ * jobs_run: Encode or decode every path with worker_count threads, then
+ *           print the totals and throughput to stderr. Returns false if any
+ *           file failed.
+ */
+bool jobs_run(char* const* paths, size_t path_count, unsigned int worker_count,
+        bool decode, unsigned int start_bits, unsigned int max_bits);
+
+#endif // JOBS_H_
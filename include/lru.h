@@ -0,0 +1,52 @@
+/*
+ * lru.h: The order in which table entries were last used, for replacing
+ *        the least recently used one once every code is taken. Entries are
+ *        kept on a list threaded through arrays indexed by code, along with
+ *        the number of entries that extend each one, since only a leaf (an
+ *        entry nothing extends) can be replaced without breaking the
+ *        strings built on it. The encoder and decoder make the same calls
+ *        in the same order, so they always replace the same entry.
+ */
+
+#ifndef LRU_H_
+#define LRU_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "config.h"
+
+struct lru;
+
+struct lru* lru_init(void);
+void lru_destroy(struct lru* lru);
+
+/*
+ * lru_clear: Forget every entry, keeping the arrays for reuse.
+ */
+void lru_clear(struct lru* lru);
+
+/*
+ * lru_memory: Get the number of bytes the arrays currently hold, and store
+ *             the number allocated over their life in allocated.
+ */
+size_t lru_memory(struct lru const* lru, unsigned long long* allocated);
+
+/*
+ * LRU operations:
+ *  - add() records a new entry, the string with code prefix followed by c,
+ *      as the most recently used. Returns false if allocation fails.
+ *  - touch() marks the entry as the most recently used. Single bytes aren't
+ *      entries, so touching one does nothing.
+ *  - evict() removes the least recently used leaf other than keep and
+ *      returns its code, storing its prefix and last byte. Entries passed
+ *      over because others extend them are moved to the most recently used
+ *      end, so that each one is passed over once per round rather than on
+ *      every eviction. Returns -1 if there is no leaf to remove.
+ */
+bool lru_add(struct lru* lru, code_t code, code_t prefix, unsigned char c);
+void lru_touch(struct lru* lru, code_t code);
+code_t lru_evict(struct lru* lru, code_t keep, code_t* prefix,
+        unsigned char* c);
+
+#endif // LRU_H_
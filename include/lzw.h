@@ -6,6 +6,8 @@
 #define LZW_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 
 bool lzw_encode(unsigned int start_bits, unsigned int max_bits,
         int (*read_byte)(void* context),
@@ -17,4 +19,459 @@ bool lzw_decode(unsigned int start_bits, unsigned int max_bits,
         void (*write_byte)(unsigned char c, void* context),
         void* context);
 
+/*
+ * Two-thread coding:
+ * These produce the same output as lzw_encode() and lzw_decode(), but move
+ * the bit packing and writing (or the reading and bit unpacking) to a
+ * second thread, connected to the dictionary work by a lock-free queue of
+ * codes. read_byte and write_byte are called from different threads, so
+ * they must not share unsynchronized state through context.
+ */
+
+bool lzw_encode_threaded(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_decode_threaded(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Entropy coding:
+ * The codes are far from uniform, literals and older, shorter strings
+ * coming up more often than the rest, yet they are stored at the full
+ * width. These entropy code them instead, for smaller output at some cost
+ * in speed. The codes are split into blocks, each of which has its own
+ * frequency table and is rANS coded with it. The output can only be
+ * decoded by lzw_decode_entropy(). Codes are limited to
+ * LZW_ENTROPY_MAX_BITS.
+ */
+
+#define LZW_ENTROPY_MAX_BITS 24
+
+bool lzw_encode_entropy(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_decode_entropy(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Incremental encoder:
+ *  - write() encodes the given bytes, emitting any finished codes.
+ *  - finish() emits the pending match and flushes the final partial byte.
+ *      No more bytes may be written afterwards.
+ * The output is identical to that of lzw_encode() over the same input.
+ */
+
+struct lzw_encoder;
+
+struct lzw_encoder* lzw_encoder_init(unsigned int start_bits,
+        unsigned int max_bits,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+void lzw_encoder_destroy(struct lzw_encoder* enc);
+
+bool lzw_encoder_write(struct lzw_encoder* enc, unsigned char const* bytes,
+        size_t length);
+bool lzw_encoder_finish(struct lzw_encoder* enc);
+
+/*
+ * Sync flush:
+ * lzw_encoder_sync() writes the code of the current match, followed by a
+ * marker and padding up to the next byte boundary. Everything written so
+ * far can then be decoded from the bytes passed to write_byte, without
+ * waiting for more input. The dictionary is kept, so the cost is a couple
+ * of codes and at most a byte of padding per flush. Flushing when nothing
+ * has been written since the start or the last flush does nothing.
+ */
+bool lzw_encoder_sync(struct lzw_encoder* enc);
+
+/*
+ * lzw_encoder_reset: Return a finished encoder to its initial state so that
+ *                    it can encode another input to the same write_byte and
+ *                    context, keeping the memory it has already allocated.
+ *                    Returns false if allocation fails, in which case the
+ *                    encoder can only be destroyed.
+ */
+bool lzw_encoder_reset(struct lzw_encoder* enc);
+
+/*
+ * Statistics:
+ * Counts gathered while coding, to help choose max_bits and to explain
+ * changes in ratio or speed. They cost a few increments per code.
+ *  - bytes_in and bytes_out count what was read and written. Bits still
+ *      waiting to fill a byte aren't counted until they're flushed.
+ *  - codes counts the codes of matched strings, not including sync flush
+ *      markers, and codes_by_width splits them up by width. The width grew
+ *      width_changes times, from start_bits to final_bits.
+ *  - average_match is the mean number of uncompressed bytes per code.
+ *  - entries is the number of codes handed out to new strings, of the
+ *      max_entries that fit within max_bits. Once the table is full it's
+ *      frozen, and freeze_codes and freeze_offset give the number of codes
+ *      and compressed bytes that came before that. With LRU replacement,
+ *      replaced counts the entries given up for new strings from then on.
+ *  - lookups and misses count the encoder's dictionary probes and those
+ *      that didn't find the string. Repeated bytes handled by the run fast
+ *      path need no probes. The decoder makes none.
+ *  - bytes_allocated totals every table allocated, and peak_memory is the
+ *      most held at once. These cover the coder's whole life, while the
+ *      other counts start over on lzw_encoder_reset().
+ * lzw_encode_stats() and lzw_decode_stats() are lzw_encode() and
+ * lzw_decode() that fill in stats once they're done, including when the
+ * input turns out to be corrupt partway.
+ */
+
+// codes_by_width is indexed by width, which goes up to 32 bits
+#define LZW_STATS_WIDTHS 33
+
+struct lzw_stats {
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+
+    unsigned long long codes;
+    unsigned long long codes_by_width[LZW_STATS_WIDTHS];
+    unsigned int start_bits;
+    unsigned int final_bits;
+    unsigned int width_changes;
+
+    double average_match;
+
+    unsigned long long entries;
+    unsigned long long max_entries;
+    bool frozen;
+    unsigned long long freeze_codes;
+    unsigned long long freeze_offset;
+    unsigned long long replaced;
+
+    unsigned long long lookups;
+    unsigned long long misses;
+
+    unsigned long long bytes_allocated;
+    unsigned long long peak_memory;
+};
+
+void lzw_encoder_stats(struct lzw_encoder const* enc,
+        struct lzw_stats* stats);
+
+bool lzw_encode_stats(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context, struct lzw_stats* stats);
+
+bool lzw_decode_stats(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context, struct lzw_stats* stats);
+
+/*
+ * Phase-in codes:
+ * Codes are normally written at the full current width, even though just
+ * after the width grows only a little over half of its values are in use.
+ * With phase-in (truncated binary) codes, the values not yet in use aren't
+ * given codes, so the lower codes take a bit less, saving up to a bit per
+ * code without changing the dictionary. The output can only be decoded
+ * with phase-in codes too.
+ *  - enable_phase_in() switches an encoder over. It fails once a code has
+ *      been written, for a fork, for an encoder that doesn't pack its own
+ *      codes, and for one with a growth policy. A phased encoder can't be
+ *      checkpointed, but it can be snapshotted, and its forks use phase-in
+ *      codes too.
+ *  - encode_phased() and decode_phased() are lzw_encode() and lzw_decode()
+ *      with phase-in codes.
+ */
+
+bool lzw_encoder_enable_phase_in(struct lzw_encoder* enc);
+
+bool lzw_encode_phased(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_decode_phased(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * LRU replacement:
+ * Once every code is taken, the table is normally frozen, which suits
+ * input that keeps to the same strings but not input whose content drifts.
+ * With LRU replacement, each new string instead takes the code of the
+ * least recently used string that no other string extends, so the table
+ * keeps up with the input. A string counts as used when its code is
+ * written. The output can only be decoded with LRU replacement too.
+ *  - enable_lru() switches an encoder over. It fails once a code has been
+ *      written, for a fork, for a seeded encoder, and for one with a growth
+ *      policy or lookahead parsing. Such an encoder can't be flushed,
+ *      snapshotted or checkpointed.
+ *  - encode_lru() and decode_lru() are lzw_encode() and lzw_decode() with
+ *      LRU replacement.
+ */
+
+bool lzw_encoder_enable_lru(struct lzw_encoder* enc);
+
+bool lzw_encode_lru(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_decode_lru(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Growth policies:
+ * LZW adds a single string per code, the match plus the next byte, so a
+ * long repeated string takes as many repeats as it has bytes to learn.
+ * The variants add strings made of whole matches instead, so the table
+ * catches up in a few repeats, and each code covers more input:
+ *  - LZMW adds the previous match followed by the current one.
+ *  - LZAP adds the previous match followed by each prefix of the current
+ *      one, using more codes to learn faster.
+ * Strings longer than 64 KiB aren't added. The output can only be decoded
+ * with the same policy.
+ *  - set_growth() chooses an encoder's policy. It fails once a byte has
+ *      been encoded, for a fork, a seeded encoder, and one with phase-in
+ *      codes, LRU replacement or lookahead parsing. An encoder with a
+ *      policy other than LZW_GROWTH_LZW can't be flushed, snapshotted or
+ *      checkpointed.
+ *  - encode_growth() and decode_growth() are lzw_encode() and lzw_decode()
+ *      with the given policy.
+ */
+
+enum lzw_growth {
+    LZW_GROWTH_LZW,
+    LZW_GROWTH_LZMW,
+    LZW_GROWTH_LZAP
+};
+
+bool lzw_encoder_set_growth(struct lzw_encoder* enc, enum lzw_growth policy);
+
+bool lzw_encode_growth(unsigned int start_bits, unsigned int max_bits,
+        enum lzw_growth policy,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_decode_growth(unsigned int start_bits, unsigned int max_bits,
+        enum lzw_growth policy,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Lookahead parsing:
+ * The greedy parse always takes the longest match, which can leave the next
+ * match short. With lookahead, the encoder holds input back and, before
+ * each match, tries the shorter strings the input starts with as well,
+ * taking the one that, followed by the longest match after it, reaches
+ * furthest within the next 256 bytes. The table grows exactly as the
+ * decoder expects, the match plus the next byte, so lzw_decode() reads the
+ * output unchanged; where that string is already in the table, its code
+ * goes unused. Encoding does several times the lookups.
+ *  - enable_lookahead() switches an encoder over. It fails once a byte has
+ *      been encoded, for a fork, and for one with LRU replacement or a
+ *      growth policy. Such an encoder can be flushed, but not snapshotted
+ *      or checkpointed.
+ *  - encode_lookahead() is lzw_encode() with lookahead.
+ */
+
+bool lzw_encoder_enable_lookahead(struct lzw_encoder* enc);
+
+bool lzw_encode_lookahead(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Snapshots:
+ * snapshot() freezes an encoder that has been fed a common prefix, such as
+ * a shared header, and takes it over; the encoder must not be used or
+ * destroyed directly afterwards. The bytes it has already written begin
+ * every forked stream, and the bits of its last partial byte are carried
+ * into each fork instead of being written.
+ * fork() creates an encoder that continues exactly where the snapshot left
+ * off, writing via write_byte. Its output appended to the snapshot's is the
+ * same as encoding the whole input at once. A fork only stores the entries
+ * it adds, reading the rest from the snapshot, so forking costs the same
+ * however much the snapshot has learned. Resetting a fork returns it to the
+ * snapshot's state. Forks may be made and used on several threads at once,
+ * and the snapshot must outlive them.
+ */
+
+struct lzw_snapshot;
+
+struct lzw_snapshot* lzw_encoder_snapshot(struct lzw_encoder* enc);
+void lzw_snapshot_destroy(struct lzw_snapshot* snap);
+
+struct lzw_encoder* lzw_snapshot_fork(struct lzw_snapshot const* snap,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Pull decoding:
+ *  - read() decodes only as much as needed to fill buffer with up to length
+ *      bytes, keeping the rest of a partly read string for the next call.
+ *      It returns the number of bytes copied, which is less than length
+ *      only at the end of the input or after an error.
+ *  - error() reports whether the input turned out to be corrupt or an
+ *      allocation failed.
+ */
+
+struct lzw_reader;
+
+struct lzw_reader* lzw_reader_open(unsigned int start_bits,
+        unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void* context);
+void lzw_reader_close(struct lzw_reader* reader);
+
+size_t lzw_reader_read(struct lzw_reader* reader, void* buffer,
+        size_t length);
+bool lzw_reader_error(struct lzw_reader const* reader);
+
+#ifdef __linux__
+/*
+ * lzw_fopen: Open a compressed file as a read-only stdio stream of its
+ *            decoded contents, for code that already reads from a FILE.
+ *            Read errors and corrupt input both show up through ferror().
+ */
+FILE* lzw_fopen(char const* path, unsigned int start_bits,
+        unsigned int max_bits);
+#endif
+
+/*
+ * Checkpoints:
+ * A long-running job can save the state of its coder and later carry on
+ * from it, for example in a new process after the old one was stopped.
+ * A checkpoint can be taken between any two calls, and holds the table,
+ * the code width and the bits of the last partial byte, so it costs a few
+ * bytes per table entry.
+ *  - encoder_checkpoint() writes the state of an encoder via write_byte.
+ *      The output to keep is exactly what had been written when the
+ *      checkpoint was taken: the encoder resumed from it writes the rest,
+ *      so that the two together are byte-for-byte what a single encoder
+ *      would have written. The caller records how much input had been
+ *      consumed. A resumed encoder no longer refers to a trained
+ *      dictionary or snapshot, so reset() empties its table.
+ *  - reader_checkpoint() does the same for a reader, failing if it has hit
+ *      the end of the input or an error. The reader resumed from it reads
+ *      via read_byte from just after the last byte the original had read,
+ *      and returns the rest of the decoded data.
+ *  - The resume functions read a checkpoint via read_checkpoint and return
+ *      NULL if it's malformed or allocation fails.
+ */
+
+bool lzw_encoder_checkpoint(struct lzw_encoder const* enc,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+struct lzw_encoder* lzw_encoder_resume(int (*read_checkpoint)(void* context),
+        void* checkpoint,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_reader_checkpoint(struct lzw_reader const* reader,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+struct lzw_reader* lzw_reader_resume(int (*read_checkpoint)(void* context),
+        void* checkpoint,
+        int (*read_byte)(void* context),
+        void* context);
+
+/*
+ * Pre-trained dictionaries:
+ * Short inputs compress poorly from an empty table, since most of them is
+ * spent building it. A dictionary trained on similar samples lets them
+ * start from a table that already holds the common strings. The same
+ * dictionary and widths must be used for encoding and decoding, and
+ * max_bits must leave room for the trained entries.
+ *  - train() learns from the samples read via read_byte and writes an
+ *      image of at most max_entries entries via write_byte. The entries
+ *      kept are the ones the samples matched through most often.
+ *  - load() maps an image file, and wrap() uses an image already in
+ *      memory, which must then outlive the dictionary. Both check the image
+ *      and return NULL if it's malformed.
+ *  - The seeded coders behave like their plain counterparts, but start with
+ *      the trained entries in the table. A seeded encoder refers to the
+ *      dictionary until it's destroyed, and reset() seeds it again.
+ */
+
+struct lzw_dictionary;
+
+bool lzw_dictionary_train(size_t max_entries,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+struct lzw_dictionary* lzw_dictionary_load(char const* path);
+struct lzw_dictionary* lzw_dictionary_wrap(void const* image, size_t size);
+void lzw_dictionary_unload(struct lzw_dictionary* dict);
+
+size_t lzw_dictionary_size(struct lzw_dictionary const* dict);
+
+struct lzw_encoder* lzw_encoder_init_seeded(unsigned int start_bits,
+        unsigned int max_bits, struct lzw_dictionary const* dict,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_encode_seeded(unsigned int start_bits, unsigned int max_bits,
+        struct lzw_dictionary const* dict,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+bool lzw_decode_seeded(unsigned int start_bits, unsigned int max_bits,
+        struct lzw_dictionary const* dict,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context);
+
+/*
+ * Searching:
+ * lzw_grep() finds the lines of compressed data read via read_byte that
+ * contain pattern, a fixed string of up to LZW_GREP_MAX_PATTERN bytes with
+ * no newline, without decompressing the rest. found is called with each
+ * such line, without its newline, and the offset of its first byte in the
+ * decompressed data. Only the lines that contain a match are expanded.
+ * Returns false on corrupt input, allocation failure or a bad pattern.
+ */
+
+#define LZW_GREP_MAX_PATTERN 1024
+
+bool lzw_grep(unsigned int start_bits, unsigned int max_bits,
+        unsigned char const* pattern, size_t pattern_length,
+        int (*read_byte)(void* context),
+        void (*found)(unsigned char const* line, size_t length,
+                      unsigned long long offset, void* context),
+        void* context);
+
+/*
+ * Batch encoding:
+ * Encodes many independent streams, a few at a time, with encoders that
+ * are reused from one stream to the next instead of set up for each. Once
+ * their tables outgrow the cache, the streams take turns, so that the
+ * dictionary probes of one overlap with the others' work. Each stream's
+ * output is identical to what lzw_encode() would produce. This is faster
+ * than encoding the streams one by one when they're short or compress
+ * well, but slower on long streams of incompressible data, whose tables
+ * crowd each other out of the cache. Returns false if any stream failed
+ * to encode.
+ */
+
+struct lzw_stream {
+    int (*read_byte)(void* context);
+    void (*write_byte)(unsigned char c, void* context);
+    void* context;
+};
+
+bool lzw_encode_batch(unsigned int start_bits, unsigned int max_bits,
+        struct lzw_stream const* streams, size_t stream_count);
+
 #endif // LZW_H_
@@ -18,4 +18,40 @@ void outs_destroy(struct outstream* outs);
 void outs_write_bits(struct outstream* outs, uint32_t bits, size_t bit_count);
 void outs_flush(struct outstream* outs);
 
+/*
+ * outs_write_phased: Write a value below range with a phase-in (truncated
+ *                    binary) code, where range fits in bit_count bits. The
+ *                    values below 2^n - range, where n is the fewest bits
+ *                    that can hold range values, take n - 1 bits, and the
+ *                    rest take n.
+ */
+void outs_write_phased(struct outstream* outs, uint32_t value,
+        uint64_t range, size_t bit_count);
+
+/*
+ * outs_bytes_written: Get the number of whole bytes written so far.
+ */
+unsigned long long outs_bytes_written(struct outstream const* outs);
+
+/*
+ * outs_redirect: Send the bytes from now on via write_byte instead, as if
+ *                the stream had just been initialized with them. Any bits
+ *                still waiting to fill a byte are dropped, so the stream
+ *                should be flushed first.
+ */
+void outs_redirect(struct outstream* outs, void* context,
+        void (*write_byte)(unsigned char c, void* context));
+
+/*
+ * Partial byte:
+ *  - get_pending() returns the bits still waiting to fill a byte, aligned
+ *      to the most significant end, and stores their number in bit_count.
+ *  - set_pending() replaces them, so that a stream can be continued from
+ *      the middle of a byte.
+ */
+unsigned char outs_get_pending(struct outstream const* outs,
+        size_t* bit_count);
+void outs_set_pending(struct outstream* outs, unsigned char bits,
+        size_t bit_count);
+
 #endif // OUTSTREAM_H_
@@ -0,0 +1,17 @@
+/*
+ * pipeline.h: Runs the encoder or decoder with reading, coding and writing
+ *             on separate threads, so that waiting on I/O overlaps with
+ *             coding. The stages pass large blocks through lock-free rings.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stdbool.h>
+
+bool pipeline_encode(int in_fd, int out_fd,
+        unsigned int start_bits, unsigned int max_bits);
+bool pipeline_decode(int in_fd, int out_fd,
+        unsigned int start_bits, unsigned int max_bits);
+
+#endif // PIPELINE_H_
@@ -0,0 +1,36 @@
+/*
+ * preset.h: Access to the entries of a pre-trained dictionary, for the
+ *           coders that seed their tables from one.
+ *
+ * Image format, with integers in little-endian order:
+ *  - the magic bytes "LZWD"
+ *  - the number of entries, as 4 bytes
+ *  - each entry as 4 bytes, holding its prefix code shifted left by 8 bits
+ *      plus its last byte. Entry i has code LZW_CHAR_RANGE + i, and its
+ *      prefix always has a smaller code.
+ */
+
+#ifndef PRESET_H_
+#define PRESET_H_
+
+#include <stddef.h>
+
+#include "lzw.h"
+#include "config.h"
+
+#define PRESET_MAGIC "LZWD"
+#define PRESET_HEADER_SIZE 8
+#define PRESET_ENTRY_SIZE 4
+
+// an entry packs its prefix into 24 bits, so its code can't be any wider
+#define PRESET_MAX_BITS 24
+
+size_t preset_size(struct lzw_dictionary const* dict);
+
+/*
+ * preset_entry: Get the prefix code and last byte of entry i.
+ */
+void preset_entry(struct lzw_dictionary const* dict, size_t i,
+        code_t* prefix, unsigned char* c);
+
+#endif // PRESET_H_
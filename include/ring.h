@@ -0,0 +1,42 @@
+/*
+ * ring.h: A lock-free ring of fixed-size blocks, passed from exactly one
+ *         producer thread to exactly one consumer thread.
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct ring;
+
+struct ring* ring_init(size_t block_count, size_t block_size);
+void ring_destroy(struct ring* ring);
+
+size_t ring_block_size(struct ring const* ring);
+
+/*
+ * Producer operations:
+ *  - acquire() waits for a free block and returns it, or returns NULL if
+ *      the ring has been closed.
+ *  - publish() hands the acquired block to the consumer, along with the
+ *      number of bytes used in it.
+ *
+ * Consumer operations:
+ *  - peek() waits for a published block and returns it, or returns NULL
+ *      once the ring is closed and every block has been consumed.
+ *  - release() returns the peeked block to the producer.
+ *
+ * Either side may close() the ring: the producer to signal the end of the
+ * data, or the consumer to make the producer stop.
+ */
+unsigned char* ring_acquire(struct ring* ring);
+void ring_publish(struct ring* ring, size_t length);
+
+unsigned char const* ring_peek(struct ring* ring, size_t* length);
+void ring_release(struct ring* ring);
+
+void ring_close(struct ring* ring);
+
+#endif // RING_H_
@@ -0,0 +1,27 @@
+/*
+ * table.h: Storage for the tables indexed by code, which reach gigabytes
+ *          with the widest codes. Small tables come from malloc(), while
+ *          those of a huge page or more are mapped on their own and backed
+ *          by huge pages where the system has them: reserved ones if there
+ *          are enough free, transparent ones otherwise. Lookups land all
+ *          over such a table, and with 4 KiB pages nearly every one would
+ *          miss the TLB. A table's size has to be passed back whenever it's
+ *          resized or freed.
+ */
+
+#ifndef TABLE_H_
+#define TABLE_H_
+
+#include <stddef.h>
+
+void* table_alloc(size_t size);
+void table_free(void* table, size_t size);
+
+/*
+ * table_resize: Move a table to one of new_size bytes, keeping as much of
+ *               its contents as fits. Returns NULL if allocation fails, in
+ *               which case the table is unchanged.
+ */
+void* table_resize(void* table, size_t old_size, size_t new_size);
+
+#endif // TABLE_H_
@@ -0,0 +1,48 @@
+/*
+ * trace.h: Static tracepoints in the coding hot paths, for attaching perf,
+ *          bpftrace or SystemTap to a running process. Building with
+ *          USDT=1 defines LZW_USDT, which turns each LZW_TRACE*() into a
+ *          probe of the "lzw" provider via <sys/sdt.h>. Otherwise they
+ *          compile to nothing, so they cost nothing when not in use.
+ *
+ * Encoder probes:
+ *  - block__start(length): the encoder is handed a block of input
+ *  - block__end(length, codes): it has consumed the block, having written
+ *      codes codes in total
+ *  - dict__insert(prefix, c, code): the string prefix followed by c was
+ *      given code
+ *  - dict__full(codes): no codes are left, after writing codes codes
+ *  - dict__replace(prefix, c, code): the least recently used string, prefix
+ *      followed by c, was removed to free up code
+ *  - dict__reset(): the dictionary was cleared
+ *  - width__grow(bits, next_code): codes are now written with bits bits
+ *  - flush(bytes): the output was flushed, bytes bytes having been written
+ *
+ * Decoder probes:
+ *  - decode__width__grow(bits, next_code), decode__dict__full(codes),
+ *      decode__dict__replace(prefix, c, code): as above
+ *  - decode__sync(codes): a sync flush marker was read
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#ifdef LZW_USDT
+
+#include <sys/sdt.h>
+
+#define LZW_TRACE0(name) DTRACE_PROBE(lzw, name)
+#define LZW_TRACE1(name, a) DTRACE_PROBE1(lzw, name, a)
+#define LZW_TRACE2(name, a, b) DTRACE_PROBE2(lzw, name, a, b)
+#define LZW_TRACE3(name, a, b, c) DTRACE_PROBE3(lzw, name, a, b, c)
+
+#else
+
+#define LZW_TRACE0(name) ((void) 0)
+#define LZW_TRACE1(name, a) ((void) 0)
+#define LZW_TRACE2(name, a, b) ((void) 0)
+#define LZW_TRACE3(name, a, b, c) ((void) 0)
+
+#endif
+
+#endif // TRACE_H_
@@ -0,0 +1,44 @@
+/*
+ * uring.h: Asynchronous block I/O for the command-line interface using
+ *          Linux's io_uring. Several block reads and writes are kept in
+ *          flight at once, so the device stays busy while the coder works
+ *          on the blocks that have already arrived.
+ */
+
+#ifndef URING_H_
+#define URING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct uring_io;
+
+/*
+ * uring_io_init: Set up asynchronous I/O between the given descriptors.
+ *                Returns NULL if io_uring isn't available on this system,
+ *                in which case the caller should use plain read/write.
+ */
+struct uring_io* uring_io_init(int in_fd, int out_fd);
+
+/*
+ * uring_io_finish: Write out any buffered output, wait for every request to
+ *                  complete and free the structure. Returns false if any
+ *                  read or write failed.
+ */
+bool uring_io_finish(struct uring_io* io);
+
+/*
+ * uring_io_next_block: Point block at the next input block and return its
+ *                      length, or 0 at the end of the input. The block stays
+ *                      valid until the next call.
+ */
+size_t uring_io_next_block(struct uring_io* io, unsigned char const** block);
+
+/*
+ * Callbacks for lzw_encode() and friends, with a struct uring_io as the
+ * context.
+ */
+int uring_io_read_byte(void* io);
+void uring_io_write_byte(unsigned char c, void* io);
+
+#endif // URING_H_
@@ -0,0 +1,73 @@
+#include "checkpoint.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string.h>
+
+/*
+ * checkpoint_put_header: Write the magic bytes, kind and version.
+ */
+
+void checkpoint_put_header(struct checkpoint_writer* w, char kind)
+{
+    for (size_t i = 0; i < strlen(CHECKPOINT_MAGIC); ++i) {
+        (w->write_byte)(CHECKPOINT_MAGIC[i], w->context);
+    }
+
+    (w->write_byte)(kind, w->context);
+    (w->write_byte)(CHECKPOINT_VERSION, w->context);
+}
+
+/*
+ * checkpoint_put: Write the low byte_count bytes of value.
+ */
+
+void checkpoint_put(struct checkpoint_writer* w, uint32_t value,
+        size_t byte_count)
+{
+    for (size_t i = 0; i < byte_count; ++i) {
+        (w->write_byte)(value >> (8 * i), w->context);
+    }
+}
+
+/*
+ * checkpoint_check_header: Read the header, checking that it's for the
+ *                          given kind of coder and a known version.
+ */
+
+bool checkpoint_check_header(struct checkpoint_reader* r, char kind)
+{
+    for (size_t i = 0; i < strlen(CHECKPOINT_MAGIC); ++i) {
+        if (checkpoint_get(r, 1) != (unsigned char) CHECKPOINT_MAGIC[i]) {
+            return false;
+        }
+    }
+
+    return checkpoint_get(r, 1) == (unsigned char) kind
+        && checkpoint_get(r, 1) == CHECKPOINT_VERSION
+        && !r->failed;
+}
+
+/*
+ * checkpoint_get: Read a byte_count byte integer.
+ */
+
+uint32_t checkpoint_get(struct checkpoint_reader* r, size_t byte_count)
+{
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < byte_count && !r->failed; ++i) {
+        int const c = (r->read_byte)(r->context);
+
+        if (c == EOF) {
+            r->failed = true;
+            return 0;
+        }
+
+        value |= (uint32_t) (c & 0xFF) << (8 * i);
+    }
+
+    return r->failed ? 0 : value;
+}
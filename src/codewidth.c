@@ -0,0 +1,110 @@
+#include "codewidth.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * cw_init: Start with no codes assigned past the single bytes.
+ */
+
+void cw_init(struct codewidth* cw, unsigned int start_bits,
+        unsigned int max_bits)
+{
+    cw->next_code = LZW_CHAR_RANGE;
+    cw->cur_bits = start_bits;
+    cw->max_bits = max_bits;
+}
+
+/*
+ * cw_advance: Widen the codes once the next code would reach the largest
+ *             value at the current width, and stop assigning codes once the
+ *             width can't grow any more. This means the largest value at
+ *             the current width is never written as a code, past the first.
+ */
+
+code_t cw_advance(struct codewidth* cw)
+{
+    code_t const current_code_max = ((code_t) 1 << cw->cur_bits) - 1;
+    bool const code_needs_expand = cw->next_code >= current_code_max;
+    bool const code_can_expand = cw->cur_bits < cw->max_bits;
+
+    if (code_needs_expand && !code_can_expand) {
+        return -1;
+    }
+
+    if (code_needs_expand) {
+        ++cw->cur_bits;
+    }
+
+    return cw->next_code++;
+}
+
+/*
+ * cw_sync_marker: Get the all-ones code at the current width.
+ */
+
+code_t cw_sync_marker(struct codewidth const* cw)
+{
+    return ((code_t) 1 << cw->cur_bits) - 1;
+}
+
+/*
+ * cw_phased_range: Count the codes and the marker. Before the first code
+ *                  the width may only just hold the single bytes, but the
+ *                  marker can't be written then anyway.
+ */
+
+uint64_t cw_phased_range(struct codewidth const* cw)
+{
+    uint64_t const range = (uint64_t) cw->next_code + 1;
+    uint64_t const width_range = (uint64_t) 1 << cw->cur_bits;
+
+    return (range < width_range) ? range : width_range;
+}
+
+/*
+ * cw_to_phased: Move the marker down to next_code. Once the table is full,
+ *               it's there already.
+ */
+
+code_t cw_to_phased(struct codewidth const* cw, code_t code)
+{
+    code_t const marker = cw_sync_marker(cw);
+
+    return (code == marker && marker > cw->next_code) ? cw->next_code : code;
+}
+
+/*
+ * cw_from_phased: Move the marker back up from next_code.
+ */
+
+code_t cw_from_phased(struct codewidth const* cw, code_t value)
+{
+    code_t const marker = cw_sync_marker(cw);
+
+    return (value == cw->next_code && marker > cw->next_code) ?
+        marker :
+        value;
+}
+
+/*
+ * cw_stats: Total up the codes and work out the table's fill. The largest
+ *           value at max_bits is the last one never handed out.
+ */
+
+void cw_stats(struct codewidth const* cw, unsigned int start_bits,
+        struct lzw_stats* stats)
+{
+    stats->codes = 0;
+
+    for (size_t i = 0; i < LZW_STATS_WIDTHS; ++i) {
+        stats->codes += stats->codes_by_width[i];
+    }
+
+    stats->start_bits = start_bits;
+    stats->final_bits = cw->cur_bits;
+    stats->width_changes = cw->cur_bits - start_bits;
+    stats->entries = cw->next_code - LZW_CHAR_RANGE;
+    stats->max_entries = ((code_t) 1 << cw->max_bits) - 1 - LZW_CHAR_RANGE;
+}
@@ -0,0 +1,933 @@
+#include "decoder.h"
+#include "checkpoint.h"
+#include "codewidth.h"
+#include "instream.h"
+#include "lru.h"
+#include "preset.h"
+#include "table.h"
+#include "trace.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <limits.h>
+#include <string.h>
+
+/*
+ * A decoding table entry. Each string is stored as the code of its prefix
+ * plus its last byte, so the table needs no allocation per entry. Strings
+ * made of a single repeated byte are flagged so that they can be expanded
+ * with memset() rather than by walking the prefix chain.
+ */
+
+struct entry {
+    code_t prefix;
+    uint32_t length;
+    unsigned char suffix;
+    unsigned char first;
+    bool run;
+};
+
+struct decoder {
+    // codes are unpacked from ins, unless they're taken from next_code
+    struct instream* ins;
+    code_t (*next_code)(void* source, unsigned int bits);
+    void* source;
+
+    struct entry* entries;
+    size_t capacity;
+
+    // the code reserved for the entry that will be completed by the first
+    // byte of the next string, or -1 if the table is full
+    code_t pending;
+    code_t prev;
+
+    struct codewidth cw;
+    unsigned int start_bits;
+
+    // whether codes are read as phase-in codes instead of at full width
+    bool phased;
+
+    // the encoder's replacement order, or NULL if a full table is frozen
+    struct lru* lru;
+
+    // how the table grows. An LZMW string is stored as its prefix plus the
+    // code of the string that follows it, its tail, and expanded with the
+    // help of a stack of prefixes yet to be written.
+    enum lzw_growth growth;
+    code_t* tails;
+    size_t tails_capacity;
+    code_t* stack;
+
+    // holds the expansion of the most recent code
+    unsigned char* string;
+    size_t string_capacity;
+
+    // the counts behind decoder_stats()
+    struct lzw_stats stats;
+};
+
+/*
+ * create_decoder: Allocate a decoder with no input attached.
+ */
+
+static struct decoder* create_decoder(unsigned int start_bits,
+        unsigned int max_bits)
+{
+    struct decoder* dec = malloc(sizeof(*dec));
+
+    if (dec == NULL) {
+        return NULL;
+    }
+
+    dec->ins = NULL;
+    dec->next_code = NULL;
+    dec->source = NULL;
+    dec->lru = NULL;
+    dec->growth = LZW_GROWTH_LZW;
+    dec->tails = NULL;
+    dec->tails_capacity = 0;
+    dec->stack = NULL;
+    dec->capacity = 2 * LZW_CHAR_RANGE;
+    dec->entries = table_alloc(sizeof(*dec->entries) * dec->capacity);
+    dec->string_capacity = 64;
+    dec->string = malloc(dec->string_capacity);
+
+    memset(&dec->stats, 0, sizeof(dec->stats));
+    dec->stats.bytes_allocated = sizeof(*dec)
+        + sizeof(*dec->entries) * dec->capacity
+        + dec->string_capacity;
+
+    if (dec->entries == NULL || dec->string == NULL) {
+        decoder_destroy(dec);
+        return NULL;
+    }
+
+    // the first LZW_CHAR_RANGE entries hold their respective bytes
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        struct entry* const e = &dec->entries[i];
+
+        e->prefix = -1;
+        e->length = 1;
+        e->suffix = i;
+        e->first = i;
+        e->run = true;
+    }
+
+    dec->pending = -1;
+    dec->prev = -1;
+    cw_init(&dec->cw, start_bits, max_bits);
+    dec->start_bits = start_bits;
+    dec->phased = false;
+
+    return dec;
+}
+
+/*
+ * decoder_init: Initialize a decoder that reads its codes via read_byte.
+ */
+
+struct decoder* decoder_init(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void* context), void* context)
+{
+    struct decoder* dec = create_decoder(start_bits, max_bits);
+
+    if (dec == NULL) {
+        return NULL;
+    }
+
+    dec->ins = ins_init(context, read_byte);
+
+    if (dec->ins == NULL) {
+        decoder_destroy(dec);
+        return NULL;
+    }
+
+    return dec;
+}
+
+/*
+ * decoder_init_source: Initialize a decoder that takes its codes from
+ *                      next_code.
+ */
+
+struct decoder* decoder_init_source(unsigned int start_bits,
+        unsigned int max_bits,
+        code_t (*next_code)(void* source, unsigned int bits),
+        void* source)
+{
+    struct decoder* dec = create_decoder(start_bits, max_bits);
+
+    if (dec == NULL) {
+        return NULL;
+    }
+
+    dec->next_code = next_code;
+    dec->source = source;
+
+    return dec;
+}
+
+/*
+ * decoder_destroy: Free the structure allocated by decoder_init().
+ */
+
+void decoder_destroy(struct decoder* dec)
+{
+    if (dec == NULL) {
+        return;
+    }
+
+    if (dec->ins != NULL) {
+        ins_destroy(dec->ins);
+    }
+
+    lru_destroy(dec->lru);
+    table_free(dec->tails, sizeof(*dec->tails) * dec->tails_capacity);
+    free(dec->stack);
+    table_free(dec->entries, sizeof(*dec->entries) * dec->capacity);
+    free(dec->string);
+    free(dec);
+}
+
+/*
+ * input_bytes: Get the number of bytes read so far. A decoder that is
+ *              handed its codes can only tell from their widths.
+ */
+
+static unsigned long long input_bytes(struct decoder const* dec)
+{
+    if (dec->ins != NULL) {
+        return ins_bytes_read(dec->ins);
+    }
+
+    unsigned long long bits = 0;
+
+    for (size_t i = 0; i < LZW_STATS_WIDTHS; ++i) {
+        bits += dec->stats.codes_by_width[i] * i;
+    }
+
+    return bits / CHAR_BIT;
+}
+
+/*
+ * grow_entries: Double the size of the table.
+ */
+
+static bool grow_entries(struct decoder* dec)
+{
+    size_t const new_capacity = dec->capacity * 2;
+    struct entry* new_entries = table_resize(dec->entries,
+        sizeof(*new_entries) * dec->capacity,
+        sizeof(*new_entries) * new_capacity);
+
+    if (new_entries == NULL) {
+        return false;
+    }
+
+    dec->entries = new_entries;
+    dec->capacity = new_capacity;
+    dec->stats.bytes_allocated += sizeof(*new_entries) * new_capacity;
+
+    return true;
+}
+
+/*
+ * reserve_entry: Mirror the encoder's bookkeeping after it writes a code,
+ *                setting aside the code of the entry that the following
+ *                string will complete.
+ */
+
+static bool reserve_entry(struct decoder* dec)
+{
+    unsigned int const bits = dec->cw.cur_bits;
+
+    dec->pending = cw_advance(&dec->cw);
+
+    if (dec->cw.cur_bits != bits) {
+        LZW_TRACE2(decode__width__grow, dec->cw.cur_bits, dec->cw.next_code);
+    }
+
+    if (dec->pending < 0 && !dec->stats.frozen) {
+        dec->stats.frozen = true;
+        dec->stats.freeze_codes = dec->stats.codes;
+        dec->stats.freeze_offset = input_bytes(dec);
+        LZW_TRACE1(decode__dict__full, dec->stats.codes);
+    }
+
+    return dec->pending < 0 || (size_t) dec->pending < dec->capacity
+        || grow_entries(dec);
+}
+
+/*
+ * replace_entry: Once the table is full, set aside the code of the entry
+ *                the encoder replaced, which is the least recently used
+ *                leaf other than keep, the code just read. The old string
+ *                stays in place until the new one is completed, since no
+ *                code but the replacement itself can refer to it.
+ */
+
+static void replace_entry(struct decoder* dec, code_t keep)
+{
+    code_t prefix;
+    unsigned char c;
+
+    dec->pending = lru_evict(dec->lru, keep, &prefix, &c);
+
+    if (dec->pending >= 0) {
+        ++dec->stats.replaced;
+        LZW_TRACE3(decode__dict__replace, prefix, c, dec->pending);
+    }
+}
+
+/*
+ * decoder_seed: Fill in each trained entry and advance the code width the
+ *               same way the seeded encoder does.
+ */
+
+bool decoder_seed(struct decoder* dec, struct lzw_dictionary const* dict)
+{
+    size_t const count = preset_size(dict);
+
+    for (size_t i = 0; i < count; ++i) {
+        code_t prefix;
+        unsigned char c;
+
+        preset_entry(dict, i, &prefix, &c);
+
+        if (!reserve_entry(dec) || dec->pending < 0) {
+            return false;
+        }
+
+        struct entry const* const p = &dec->entries[prefix];
+        struct entry* const e = &dec->entries[dec->pending];
+
+        e->prefix = prefix;
+        e->length = p->length + 1;
+        e->suffix = c;
+        e->first = p->first;
+        e->run = p->run && p->first == c;
+    }
+
+    dec->pending = -1;
+    return true;
+}
+
+/*
+ * complete_entry: Fill in the pending entry as the previous string followed
+ *                 by the first byte of the current one.
+ */
+
+static void complete_entry(struct decoder* dec, code_t code)
+{
+    struct entry const* const prev = &dec->entries[dec->prev];
+    struct entry* const e = &dec->entries[dec->pending];
+
+    // if the code is the pending entry itself, its first byte is the
+    // previous string's first byte
+    unsigned char const c = (code == dec->pending) ?
+        prev->first :
+        dec->entries[code].first;
+
+    e->prefix = dec->prev;
+    e->length = prev->length + 1;
+    e->suffix = c;
+    e->first = prev->first;
+    e->run = prev->run && prev->first == c;
+}
+
+/*
+ * expand_concatenation: Write the string for an LZMW code into the string
+ *                       buffer, back to front. The tail is written before
+ *                       the prefix, which waits on the stack meanwhile. The
+ *                       strings on the stack are parts of the one being
+ *                       expanded, so there are fewer of them than it has
+ *                       bytes.
+ */
+
+static void expand_concatenation(struct decoder* dec, code_t code)
+{
+    size_t end = dec->entries[code].length;
+    size_t count = 0;
+
+    for (;;) {
+        struct entry const* const e = &dec->entries[code];
+
+        if (!e->run) {
+            dec->stack[count++] = e->prefix;
+            code = dec->tails[code];
+            continue;
+        }
+
+        end -= e->length;
+        memset(dec->string + end, e->first, e->length);
+
+        if (count == 0) {
+            return;
+        }
+
+        code = dec->stack[--count];
+    }
+}
+
+/*
+ * expand: Write the string for the given code into the string buffer,
+ *         back to front. Once the walk reaches a run, the rest of the
+ *         string is filled in with a single memset().
+ */
+
+static bool expand(struct decoder* dec, code_t code)
+{
+    size_t const length = dec->entries[code].length;
+
+    if (length > dec->string_capacity) {
+        size_t new_capacity = dec->string_capacity;
+
+        while (new_capacity < length) {
+            new_capacity *= 2;
+        }
+
+        unsigned char* new_string = realloc(dec->string, new_capacity);
+
+        if (new_string == NULL) {
+            return false;
+        }
+
+        dec->string = new_string;
+        dec->string_capacity = new_capacity;
+        dec->stats.bytes_allocated += new_capacity;
+    }
+
+    if (dec->growth == LZW_GROWTH_LZMW) {
+        expand_concatenation(dec, code);
+        return true;
+    }
+
+    size_t i = length;
+
+    while (!dec->entries[code].run) {
+        struct entry const* const e = &dec->entries[code];
+
+        dec->string[--i] = e->suffix;
+        code = e->prefix;
+    }
+
+    memset(dec->string, dec->entries[code].first, i);
+    return true;
+}
+
+/*
+ * read_code: Get the next code at the current width.
+ */
+
+static code_t read_code(struct decoder* dec)
+{
+    if (dec->next_code != NULL) {
+        return (dec->next_code)(dec->source, dec->cw.cur_bits);
+    }
+
+    if (dec->phased) {
+        return cw_from_phased(&dec->cw,
+                              ins_read_phased(dec->ins,
+                                              cw_phased_range(&dec->cw),
+                                              dec->cw.cur_bits));
+    }
+
+    return ins_read_bits(dec->ins, dec->cw.cur_bits);
+}
+
+/*
+ * decoder_enable_phase_in: Switch to phase-in codes before the first code
+ *                          is read.
+ */
+
+bool decoder_enable_phase_in(struct decoder* dec)
+{
+    if (dec->ins == NULL || dec->growth != LZW_GROWTH_LZW
+            || dec->stats.codes > 0) {
+        return false;
+    }
+
+    dec->phased = true;
+    return true;
+}
+
+/*
+ * decoder_enable_lru: Replace entries the way an encoder with LRU
+ *                     replacement does, before the first code is read.
+ */
+
+bool decoder_enable_lru(struct decoder* dec)
+{
+    if (dec->lru != NULL) {
+        return true;
+    }
+
+    if (dec->growth != LZW_GROWTH_LZW || dec->stats.codes > 0
+            || dec->cw.next_code != LZW_CHAR_RANGE) {
+        return false;
+    }
+
+    dec->lru = lru_init();
+    return dec->lru != NULL;
+}
+
+/*
+ * decoder_set_growth: Grow the table the way an encoder with the given
+ *                     policy does, before the first code is read. An LZMW
+ *                     string can't be longer than LZW_GROWTH_MAX_LENGTH,
+ *                     which bounds the stack its expansion needs.
+ */
+
+bool decoder_set_growth(struct decoder* dec, enum lzw_growth policy)
+{
+    if (policy != LZW_GROWTH_LZW && policy != LZW_GROWTH_LZMW
+            && policy != LZW_GROWTH_LZAP) {
+        return false;
+    }
+
+    if (dec->lru != NULL || dec->phased || dec->stats.codes > 0
+            || dec->cw.next_code != LZW_CHAR_RANGE) {
+        return false;
+    }
+
+    if (policy == LZW_GROWTH_LZMW && dec->stack == NULL) {
+        dec->tails = table_alloc(sizeof(*dec->tails) * dec->capacity);
+        dec->stack = malloc(sizeof(*dec->stack) * LZW_GROWTH_MAX_LENGTH);
+
+        if (dec->tails == NULL || dec->stack == NULL) {
+            table_free(dec->tails, sizeof(*dec->tails) * dec->capacity);
+            free(dec->stack);
+            dec->tails = NULL;
+            dec->stack = NULL;
+
+            return false;
+        }
+
+        dec->tails_capacity = dec->capacity;
+        dec->stats.bytes_allocated += sizeof(*dec->tails) * dec->capacity
+            + sizeof(*dec->stack) * LZW_GROWTH_MAX_LENGTH;
+    }
+
+    dec->growth = policy;
+    return true;
+}
+
+/*
+ * add_prefixes: Add the previous string followed by each prefix of the
+ *               one with the given code, as an LZAP encoder does. Each is
+ *               an ordinary entry extending the one before.
+ */
+
+static bool add_prefixes(struct decoder* dec, code_t code)
+{
+    if (!expand(dec, code)) {
+        return false;
+    }
+
+    size_t const length = dec->entries[code].length;
+    size_t const prev_length = dec->entries[dec->prev].length;
+    code_t prefix = dec->prev;
+
+    for (size_t i = 0; i < length
+            && prev_length + i < LZW_GROWTH_MAX_LENGTH; ++i) {
+        if (!reserve_entry(dec)) {
+            return false;
+        }
+
+        if (dec->pending < 0) {
+            break;
+        }
+
+        struct entry const* const p = &dec->entries[prefix];
+        struct entry* const e = &dec->entries[dec->pending];
+        unsigned char const c = dec->string[i];
+
+        e->prefix = prefix;
+        e->length = p->length + 1;
+        e->suffix = c;
+        e->first = p->first;
+        e->run = p->run && p->first == c;
+
+        prefix = dec->pending;
+    }
+
+    dec->pending = -1;
+    return true;
+}
+
+/*
+ * add_concatenation: Add the previous string followed by the one with the
+ *                    given code, as an LZMW encoder does.
+ */
+
+static bool add_concatenation(struct decoder* dec, code_t code)
+{
+    if (dec->entries[dec->prev].length + dec->entries[code].length
+            > LZW_GROWTH_MAX_LENGTH) {
+        return true;
+    }
+
+    if (!reserve_entry(dec)) {
+        return false;
+    }
+
+    code_t const added = dec->pending;
+
+    dec->pending = -1;
+
+    if (added < 0) {
+        return true;
+    }
+
+    if ((size_t) added >= dec->tails_capacity) {
+        code_t* new_tails = table_resize(dec->tails,
+            sizeof(*new_tails) * dec->tails_capacity,
+            sizeof(*new_tails) * dec->capacity);
+
+        if (new_tails == NULL) {
+            return false;
+        }
+
+        dec->tails = new_tails;
+        dec->tails_capacity = dec->capacity;
+        dec->stats.bytes_allocated += sizeof(*new_tails) * dec->capacity;
+    }
+
+    struct entry const* const p = &dec->entries[dec->prev];
+    struct entry const* const t = &dec->entries[code];
+    struct entry* const e = &dec->entries[added];
+
+    e->prefix = dec->prev;
+    e->length = p->length + t->length;
+    e->suffix = t->suffix;
+    e->first = p->first;
+    e->run = p->run && t->run && p->first == t->first;
+    dec->tails[added] = code;
+
+    return true;
+}
+
+/*
+ * decoder_next_code: Read a single code, skipping any sync flush markers,
+ *                    and bring the table up to date with it. The code
+ *                    before a marker is handled like any other, so the
+ *                    table carries on across the flush unchanged.
+ */
+
+enum decoder_status decoder_next_code(struct decoder* dec, code_t* code,
+        code_t* added)
+{
+    code_t c = read_code(dec);
+
+    // an encoder with a growth policy can't be flushed, and its second code
+    // is read at the same width as its first, so the marker can't be told
+    // from a single byte
+    while (dec->prev >= 0 && dec->growth == LZW_GROWTH_LZW
+            && c == cw_sync_marker(&dec->cw)) {
+        LZW_TRACE1(decode__sync, dec->stats.codes);
+
+        // the rest of the marker's byte is padding
+        if (dec->ins != NULL) {
+            ins_align(dec->ins);
+        }
+
+        c = read_code(dec);
+    }
+
+    if (c == EOF) {
+        return DECODER_EOF;
+    }
+
+    // the first code must be complete already, so it can't be the pending
+    // entry; later codes can be
+    if (c >= dec->cw.next_code) {
+        return DECODER_ERROR;
+    }
+
+    *added = -1;
+
+    if (dec->prev >= 0 && dec->pending >= 0) {
+        complete_entry(dec, c);
+        *added = dec->pending;
+
+        if (dec->lru != NULL
+                && !lru_add(dec->lru, dec->pending, dec->prev,
+                            dec->entries[dec->pending].suffix)) {
+            return DECODER_ERROR;
+        }
+    }
+
+    ++dec->stats.codes_by_width[dec->cw.cur_bits];
+    ++dec->stats.codes;
+    dec->stats.bytes_out += dec->entries[c].length;
+
+    // the variants add their strings once the code is known, so there is
+    // never a pending entry
+    if (dec->growth == LZW_GROWTH_LZMW) {
+        if (dec->prev >= 0 && !add_concatenation(dec, c)) {
+            return DECODER_ERROR;
+        }
+    } else if (dec->growth == LZW_GROWTH_LZAP) {
+        if (dec->prev >= 0 && !add_prefixes(dec, c)) {
+            return DECODER_ERROR;
+        }
+    } else if (!reserve_entry(dec)) {
+        return DECODER_ERROR;
+    }
+
+    // in the same order as the encoder: the code is used, then the next
+    // entry replaces another if the table is full
+    if (dec->lru != NULL) {
+        lru_touch(dec->lru, c);
+
+        if (dec->pending < 0) {
+            replace_entry(dec, c);
+        }
+    }
+
+    dec->prev = c;
+    *code = c;
+
+    return DECODER_OK;
+}
+
+/*
+ * decoder_expand: Expand any complete code into the string buffer.
+ */
+
+bool decoder_expand(struct decoder* dec, code_t code,
+        unsigned char const** string, size_t* length)
+{
+    if (!expand(dec, code)) {
+        return false;
+    }
+
+    *string = dec->string;
+    *length = dec->entries[code].length;
+
+    return true;
+}
+
+/*
+ * decoder_entry: Look up how the string of a complete code was formed.
+ */
+
+void decoder_entry(struct decoder const* dec, code_t code, code_t* prefix,
+        unsigned char* suffix, size_t* length)
+{
+    struct entry const* const e = &dec->entries[code];
+
+    *prefix = e->prefix;
+    *suffix = e->suffix;
+    *length = e->length;
+}
+
+/*
+ * decoder_next: Decode a single code.
+ */
+
+enum decoder_status decoder_next(struct decoder* dec,
+        unsigned char const** string, size_t* length)
+{
+    code_t code;
+    code_t added;
+    enum decoder_status const status = decoder_next_code(dec, &code, &added);
+
+    if (status != DECODER_OK) {
+        return status;
+    }
+
+    return decoder_expand(dec, code, string, length) ?
+        DECODER_OK :
+        DECODER_ERROR;
+}
+
+/*
+ * decoder_stats: Copy out the counts and fill in the rest. The tables never
+ *                shrink, so they're at their largest now.
+ */
+
+void decoder_stats(struct decoder const* dec, struct lzw_stats* stats)
+{
+    *stats = dec->stats;
+    stats->bytes_in = input_bytes(dec);
+    cw_stats(&dec->cw, dec->start_bits, stats);
+
+    stats->average_match = (stats->codes > 0) ?
+        (double) stats->bytes_out / stats->codes :
+        0;
+    stats->peak_memory = sizeof(*dec)
+        + sizeof(*dec->entries) * dec->capacity
+        + dec->string_capacity;
+
+    if (dec->growth == LZW_GROWTH_LZMW) {
+        stats->peak_memory += sizeof(*dec->tails) * dec->tails_capacity
+            + sizeof(*dec->stack) * LZW_GROWTH_MAX_LENGTH;
+    }
+
+    if (dec->lru != NULL) {
+        unsigned long long allocated;
+
+        stats->peak_memory += lru_memory(dec->lru, &allocated);
+        stats->bytes_allocated += allocated;
+    }
+}
+
+/*
+ * decoder_current: Expand the most recent code again.
+ */
+
+bool decoder_current(struct decoder* dec, unsigned char const** string,
+        size_t* length)
+{
+    if (dec->prev < 0) {
+        *string = dec->string;
+        *length = 0;
+
+        return true;
+    }
+
+    if (!expand(dec, dec->prev)) {
+        return false;
+    }
+
+    *string = dec->string;
+    *length = dec->entries[dec->prev].length;
+
+    return true;
+}
+
+/*
+ * complete_codes: Get the end of the range of codes whose entries are
+ *                 filled in, which stops short of the pending entry.
+ */
+
+static code_t complete_codes(struct decoder const* dec)
+{
+    return (dec->pending >= 0) ? dec->pending : dec->cw.next_code;
+}
+
+/*
+ * decoder_checkpoint: Write the coding state, then the prefix and last byte
+ *                     of each complete entry in code order. The rest of an
+ *                     entry follows from its prefix.
+ */
+
+bool decoder_checkpoint(struct decoder const* dec,
+        struct checkpoint_writer* w)
+{
+    if (dec->ins == NULL || dec->phased || dec->lru != NULL
+            || dec->growth != LZW_GROWTH_LZW) {
+        return false;
+    }
+
+    size_t bit_count;
+    unsigned char const bits = ins_get_pending(dec->ins, &bit_count);
+
+    checkpoint_put_header(w, CHECKPOINT_DECODER);
+    checkpoint_put(w, dec->start_bits, 1);
+    checkpoint_put(w, dec->cw.max_bits, 1);
+    checkpoint_put(w, dec->cw.cur_bits, 1);
+    checkpoint_put(w, dec->cw.next_code, 4);
+    checkpoint_put(w, dec->pending + 1, 4);
+    checkpoint_put(w, dec->prev + 1, 4);
+    checkpoint_put(w, bits, 1);
+    checkpoint_put(w, bit_count, 1);
+
+    for (code_t code = LZW_CHAR_RANGE; code < complete_codes(dec); ++code) {
+        checkpoint_put(w, dec->entries[code].prefix, 4);
+        checkpoint_put(w, dec->entries[code].suffix, 1);
+    }
+
+    return true;
+}
+
+/*
+ * restore: Read the coding state and entries of a checkpoint into a new
+ *          decoder. Anything that would leave the decoder inconsistent is
+ *          rejected.
+ */
+
+static bool restore(struct decoder* dec, struct checkpoint_reader* r)
+{
+    dec->cw.cur_bits = checkpoint_get(r, 1);
+    dec->cw.next_code = checkpoint_get(r, 4);
+    dec->pending = (code_t) checkpoint_get(r, 4) - 1;
+    dec->prev = (code_t) checkpoint_get(r, 4) - 1;
+
+    unsigned char const bits = checkpoint_get(r, 1);
+    size_t const bit_count = checkpoint_get(r, 1);
+    code_t const next_code = dec->cw.next_code;
+
+    if (r->failed
+            || dec->cw.cur_bits < dec->start_bits
+            || dec->cw.cur_bits > dec->cw.max_bits
+            || next_code < LZW_CHAR_RANGE
+            || next_code > ((code_t) 1 << dec->cw.cur_bits)
+            || dec->pending < -1
+            || (dec->pending >= 0 && dec->pending != next_code - 1)
+            || dec->prev < -1 || dec->prev >= complete_codes(dec)
+            || bit_count >= CHAR_BIT) {
+        return false;
+    }
+
+    ins_set_pending(dec->ins, bits, bit_count);
+
+    while (dec->capacity < (size_t) next_code) {
+        if (!grow_entries(dec)) {
+            return false;
+        }
+    }
+
+    for (code_t code = LZW_CHAR_RANGE; code < complete_codes(dec); ++code) {
+        code_t const prefix = checkpoint_get(r, 4);
+        unsigned char const c = checkpoint_get(r, 1);
+
+        if (r->failed || prefix < 0 || prefix >= code) {
+            return false;
+        }
+
+        struct entry const* const p = &dec->entries[prefix];
+        struct entry* const e = &dec->entries[code];
+
+        e->prefix = prefix;
+        e->length = p->length + 1;
+        e->suffix = c;
+        e->first = p->first;
+        e->run = p->run && p->first == c;
+    }
+
+    return true;
+}
+
+/*
+ * decoder_resume: Create a decoder from the state in a checkpoint.
+ */
+
+struct decoder* decoder_resume(struct checkpoint_reader* r,
+        int (*read_byte)(void* context), void* context)
+{
+    if (!checkpoint_check_header(r, CHECKPOINT_DECODER)) {
+        return NULL;
+    }
+
+    unsigned int const start_bits = checkpoint_get(r, 1);
+    unsigned int const max_bits = checkpoint_get(r, 1);
+    struct decoder* dec = NULL;
+
+    if (!r->failed && start_bits >= LZW_MINIMUM_BITS
+            && start_bits <= max_bits && max_bits <= LZW_MAXIMUM_BITS) {
+        dec = decoder_init(start_bits, max_bits, read_byte, context);
+    }
+
+    if (dec != NULL && !restore(dec, r)) {
+        decoder_destroy(dec);
+        return NULL;
+    }
+
+    return dec;
+}
@@ -0,0 +1,388 @@
+#include "dict.h"
+#include "bitops.h"
+#include "table.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <limits.h>
+
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void) (addr))
+#endif
+
+#define DICT_MIN_SLOTS 64
+
+// tables larger than this are reallocated rather than cleared on reuse
+#define DICT_CLEAR_SLOTS (1 << 16)
+
+// a key holds a prefix code and a byte, so wide codes need 64 bits. The
+// multipliers are 2^n divided by the golden ratio, for Fibonacci hashing.
+#ifdef LZW_WIDE_CODES
+typedef uint64_t dict_key;
+#define KEY_MULTIPLIER UINT64_C(11400714819323198485)
+#else
+typedef uint32_t dict_key;
+#define KEY_MULTIPLIER UINT32_C(2654435761)
+#endif
+
+/*
+ * Each slot holds the packed (prefix, byte) key and the code it maps to.
+ * A slot with a negative code is empty.
+ */
+
+struct slot {
+    dict_key key;
+    code_t code;
+};
+
+struct dict {
+    struct slot* slots;
+    size_t slot_count;
+    size_t used;
+
+    // the number of bits to shift a hashed key right by to get an index
+    unsigned int shift;
+
+    // the size of the table when it was created
+    size_t initial_slot_count;
+    unsigned int initial_shift;
+
+    // the read-only dictionary underneath an overlay, or NULL
+    struct dict const* base;
+
+    // bytes allocated for slots over the dictionary's life
+    unsigned long long allocated;
+};
+
+/*
+ * make_key: Pack an entry into a single integer. Since codes are at most
+ *           LZW_MAXIMUM_BITS wide, the result always fits in a dict_key.
+ */
+
+static dict_key make_key(code_t prefix, unsigned char c)
+{
+    return ((dict_key) prefix << CHAR_BIT) | c;
+}
+
+/*
+ * slot_index: Find the slot at which probing for the given key starts,
+ *             using Fibonacci hashing.
+ */
+
+static size_t slot_index(struct dict const* dict, dict_key key)
+{
+    return (dict_key) (key * KEY_MULTIPLIER) >> dict->shift;
+}
+
+/*
+ * alloc_slots: Allocate slot_count empty slots.
+ */
+
+static struct slot* alloc_slots(size_t slot_count)
+{
+    struct slot* slots = table_alloc(sizeof(*slots) * slot_count);
+
+    if (slots == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < slot_count; ++i) {
+        slots[i].code = -1;
+    }
+
+    return slots;
+}
+
+/*
+ * dict_init: Initialize an empty dictionary with room for at least
+ *            capacity entries before it needs to grow.
+ */
+
+struct dict* dict_init(size_t capacity)
+{
+    struct dict* dict = malloc(sizeof(*dict));
+
+    if (dict == NULL) {
+        return NULL;
+    }
+
+    // keep the load factor at or below one half
+    size_t slot_count = DICT_MIN_SLOTS;
+    unsigned int shift = BITS_IN(dict_key) - 6;
+
+    while (slot_count < capacity * 2 && shift > 1) {
+        slot_count *= 2;
+        --shift;
+    }
+
+    dict->slots = alloc_slots(slot_count);
+    dict->slot_count = slot_count;
+    dict->used = 0;
+    dict->shift = shift;
+    dict->initial_slot_count = slot_count;
+    dict->initial_shift = shift;
+    dict->base = NULL;
+    dict->allocated = sizeof(*dict->slots) * slot_count;
+
+    if (dict->slots == NULL) {
+        free(dict);
+        return NULL;
+    }
+
+    return dict;
+}
+
+/*
+ * dict_init_overlay: Initialize an empty dictionary on top of base.
+ */
+
+struct dict* dict_init_overlay(struct dict const* base, size_t capacity)
+{
+    struct dict* dict = dict_init(capacity);
+
+    if (dict != NULL) {
+        dict->base = base;
+    }
+
+    return dict;
+}
+
+/*
+ * dict_destroy: Free the structure allocated by dict_init().
+ */
+
+void dict_destroy(struct dict* dict)
+{
+    if (dict == NULL) {
+        return;
+    }
+
+    table_free(dict->slots, sizeof(*dict->slots) * dict->slot_count);
+    free(dict);
+}
+
+/*
+ * dict_size: Get the number of entries stored in the dictionary.
+ */
+
+size_t dict_size(struct dict const* dict)
+{
+    return dict->used + ((dict->base != NULL) ? dict_size(dict->base) : 0);
+}
+
+/*
+ * dict_memory: Get the size of the table, and the total size of every
+ *              table allocated.
+ */
+
+size_t dict_memory(struct dict const* dict, unsigned long long* allocated)
+{
+    *allocated = dict->allocated + sizeof(*dict);
+
+    return sizeof(*dict) + sizeof(*dict->slots) * dict->slot_count;
+}
+
+/*
+ * dict_clear: Remove every entry. A table that has grown large is shrunk
+ *             back to its initial size, since clearing it would cost more
+ *             than the next input is likely to need.
+ */
+
+bool dict_clear(struct dict* dict)
+{
+    if (dict->slot_count > DICT_CLEAR_SLOTS
+            && dict->slot_count > dict->initial_slot_count) {
+        struct slot* new_slots = alloc_slots(dict->initial_slot_count);
+
+        if (new_slots == NULL) {
+            return false;
+        }
+
+        table_free(dict->slots, sizeof(*dict->slots) * dict->slot_count);
+        dict->slots = new_slots;
+        dict->allocated += sizeof(*new_slots) * dict->initial_slot_count;
+        dict->slot_count = dict->initial_slot_count;
+        dict->shift = dict->initial_shift;
+    } else {
+        for (size_t i = 0; i < dict->slot_count; ++i) {
+            dict->slots[i].code = -1;
+        }
+    }
+
+    dict->used = 0;
+    return true;
+}
+
+/*
+ * find_slot: Find the slot holding the given key, or the empty slot where it
+ *            would be inserted. Linear probing always terminates because the
+ *            table is never more than half full.
+ */
+
+static struct slot* find_slot(struct dict const* dict, dict_key key)
+{
+    size_t const mask = dict->slot_count - 1;
+    size_t i = slot_index(dict, key);
+
+    while (dict->slots[i].code >= 0 && dict->slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+
+    return &dict->slots[i];
+}
+
+/*
+ * find_code: Look up a key in a dictionary and the ones underneath it.
+ */
+
+static code_t find_code(struct dict const* dict, dict_key key)
+{
+    for (; dict != NULL; dict = dict->base) {
+        struct slot const* const slot = find_slot(dict, key);
+
+        if (slot->code >= 0) {
+            return slot->code;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * grow: Double the number of slots and rehash every entry.
+ */
+
+static bool grow(struct dict* dict)
+{
+    struct slot* const old_slots = dict->slots;
+    size_t const old_count = dict->slot_count;
+    struct slot* new_slots = alloc_slots(old_count * 2);
+
+    if (new_slots == NULL) {
+        return false;
+    }
+
+    dict->slots = new_slots;
+    dict->slot_count = old_count * 2;
+    dict->allocated += sizeof(*new_slots) * dict->slot_count;
+    --dict->shift;
+
+    for (size_t i = 0; i < old_count; ++i) {
+        if (old_slots[i].code >= 0) {
+            *find_slot(dict, old_slots[i].key) = old_slots[i];
+        }
+    }
+
+    table_free(old_slots, sizeof(*old_slots) * old_count);
+    return true;
+}
+
+/*
+ * dict_lookup: Get the code for the string with code prefix followed by c,
+ *              or -1 if it isn't in the dictionary.
+ */
+
+code_t dict_lookup(struct dict const* dict, code_t prefix, unsigned char c)
+{
+    dict_key const key = make_key(prefix, c);
+
+    return (dict->base == NULL) ?
+        find_slot(dict, key)->code :
+        find_code(dict, key);
+}
+
+/*
+ * dict_insert: Add the string with code prefix followed by c to the
+ *              dictionary under the given code.
+ */
+
+bool dict_insert(struct dict* dict, code_t prefix, unsigned char c,
+        code_t code)
+{
+    if ((dict->used + 1) * 2 > dict->slot_count && !grow(dict)) {
+        return false;
+    }
+
+    dict_key const key = make_key(prefix, c);
+    struct slot* slot = find_slot(dict, key);
+
+    if (slot->code >= 0) {
+        // entry is already present
+        return false;
+    }
+
+    slot->key = key;
+    slot->code = code;
+    ++dict->used;
+
+    return true;
+}
+
+/*
+ * dict_remove: Take the string with code prefix followed by c out of the
+ *              dictionary. Rather than leaving a marker in its slot, the
+ *              entries probed past it are shifted back, so that lookups
+ *              never slow down however many entries come and go.
+ */
+
+bool dict_remove(struct dict* dict, code_t prefix, unsigned char c)
+{
+    dict_key const key = make_key(prefix, c);
+    size_t const mask = dict->slot_count - 1;
+    size_t hole = find_slot(dict, key) - dict->slots;
+
+    if (dict->slots[hole].code < 0) {
+        return false;
+    }
+
+    for (size_t i = (hole + 1) & mask; dict->slots[i].code >= 0;
+            i = (i + 1) & mask) {
+        size_t const home = slot_index(dict, dict->slots[i].key);
+
+        // an entry can fill the hole if it lies between its home and it
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            dict->slots[hole] = dict->slots[i];
+            hole = i;
+        }
+    }
+
+    dict->slots[hole].code = -1;
+    --dict->used;
+
+    return true;
+}
+
+/*
+ * dict_prefetch: Start loading the slot where a lookup of the given entry
+ *                will begin, so that it's likely cached when the lookup
+ *                happens.
+ */
+
+void dict_prefetch(struct dict const* dict, code_t prefix, unsigned char c)
+{
+    PREFETCH(&dict->slots[slot_index(dict, make_key(prefix, c))]);
+}
+
+/*
+ * dict_visit: Walk the slots of the dictionary and each one underneath it.
+ */
+
+void dict_visit(struct dict const* dict,
+        void (*visit)(code_t prefix, unsigned char c, code_t code,
+                      void* context),
+        void* context)
+{
+    for (; dict != NULL; dict = dict->base) {
+        for (size_t i = 0; i < dict->slot_count; ++i) {
+            struct slot const* const slot = &dict->slots[i];
+
+            if (slot->code >= 0) {
+                visit(slot->key >> CHAR_BIT, slot->key & UCHAR_MAX,
+                      slot->code, context);
+            }
+        }
+    }
+}
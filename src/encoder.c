@@ -0,0 +1,2072 @@
+#include "lzw.h"
+#include "encoder.h"
+#include "checkpoint.h"
+#include "codewidth.h"
+#include "dict.h"
+#include "lru.h"
+#include "preset.h"
+#include "outstream.h"
+#include "trace.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <limits.h>
+#include <string.h>
+
+// runs shorter than this are encoded a byte at a time
+#define RUN_THRESHOLD 16
+
+// with lookahead parsing, the input held back to choose matches in, the
+// part of it kept in view when more input is expected, and how far past
+// its start a match is chosen to reach
+#define LOOKAHEAD_BUFFER (1 << 16)
+#define LOOKAHEAD_KEEP (LOOKAHEAD_BUFFER / 2)
+#define LOOKAHEAD_WINDOW 256
+
+// while the table grows, a shorter match wastes the code of the entry the
+// longer one had already added, so it has to reach this much further
+#define LOOKAHEAD_MARGIN 2
+
+// batch encoding works on this many streams at a time, reading each this
+// far ahead of its encoder
+#define BATCH_GROUP 8
+#define BATCH_CHUNK 1024
+
+// a table this small stays cached, so there's no miss to hide, and the
+// streams are only interleaved once their tables outgrow it
+#define BATCH_CACHED_ENTRIES 4096
+
+/*
+ * The codes of the strings made of a single byte repeated, where codes[k]
+ * is the code of the byte repeated k + 2 times. LZW only ever adds such a
+ * string after the one a byte shorter, so the table has no gaps. A forked
+ * encoder shares its snapshot's codes until it first adds a run.
+ */
+
+struct run_table {
+    code_t* codes;
+    size_t count;
+    size_t capacity;
+    bool shared;
+};
+
+// tags a node of the LZMW trie that isn't an entry of the table, above the
+// bits of any code or node number
+#define PHANTOM ((code_t) 1 << LZW_MAXIMUM_BITS)
+
+// node numbers are packed into dictionary keys the same way codes are
+#define PHANTOM_LIMIT ((size_t) 1 << LZW_MAXIMUM_BITS)
+
+/*
+ * The matching state of an encoder whose table grows by whole matches
+ * rather than a byte at a time. The bytes of the current match are kept,
+ * since the strings added once it's written are built from them.
+ * An LZMW string's prefixes needn't be in the table, so the bytes on the
+ * way to it are linked through phantom nodes, which have no code of their
+ * own until a string ending there is added. Lookups from a phantom node go
+ * to a table of their own, and a dictionary value that is a phantom node
+ * is tagged with PHANTOM. A match that ends past its last string gives
+ * back the bytes after it, to be matched again.
+ */
+
+struct growth {
+    enum lzw_growth policy;
+
+    // the current match, of which the first walked bytes have been looked
+    // up, reaching node. The first coded bytes are the string with code.
+    unsigned char* match;
+    size_t length;
+    size_t walked;
+    size_t coded;
+    code_t node;
+    code_t code;
+
+    // the match written before the current one, or -1 before the first
+    code_t prev;
+    size_t prev_length;
+
+    // LZMW only: the code each phantom node was given, or -1, and the node
+    // of each code given to a phantom node, or -1 for those that weren't
+    struct dict* phantoms;
+    code_t* phantom_codes;
+    size_t phantom_count;
+    size_t phantom_capacity;
+    code_t* nodes;
+    size_t node_capacity;
+
+    unsigned long long allocated;
+};
+
+struct lzw_encoder {
+    // codes are packed into outs, unless they're handed to emit instead
+    struct outstream* outs;
+    void (*emit)(void* sink, code_t code, unsigned int bits);
+    void* sink;
+
+    struct dict* dict;
+    struct codewidth cw;
+    unsigned int start_bits;
+
+    // whether codes are packed with phase-in codes instead of at full width
+    bool phased;
+
+    // the order entries are replaced in once the table is full, or NULL if
+    // the table is frozen instead
+    struct lru* lru;
+
+    // how the table grows when it isn't by a byte per code, or NULL
+    struct growth* growth;
+
+    // with lookahead parsing, the input not yet parsed, or NULL if matches
+    // are taken greedily as the input arrives
+    unsigned char* ahead;
+    size_t ahead_length;
+
+    // the trained entries the table starts with, or NULL
+    struct lzw_dictionary const* preset;
+
+    // the snapshot a forked encoder started from, or NULL
+    struct lzw_snapshot const* origin;
+
+    // code of the current match, or -1 if nothing has been read yet
+    code_t prefix;
+
+    // if the current match is a single byte repeated, the byte and the
+    // number of repetitions. run_byte is -1 otherwise.
+    int run_byte;
+    size_t run_length;
+
+    // after a sync flush, the entry that the first byte of the next match
+    // will complete, the same as the decoder's pending entry. sync_code is
+    // -1 if there is none.
+    code_t sync_prefix;
+    code_t sync_code;
+    int sync_run_byte;
+
+    struct run_table runs[LZW_CHAR_RANGE];
+
+    // the counts behind lzw_encoder_stats(), along with the bytes the run
+    // tables have allocated
+    struct lzw_stats stats;
+    unsigned long long run_allocated;
+};
+
+/*
+ * A frozen encoder, along with the bits of its last partial byte. These
+ * are left out of its own output and start the output of every fork.
+ */
+
+struct lzw_snapshot {
+    struct lzw_encoder* enc;
+    unsigned char bits;
+    size_t bit_count;
+};
+
+/*
+ * growth_destroy: Free the matching state of a growth policy.
+ */
+
+static void growth_destroy(struct growth* g)
+{
+    if (g == NULL) {
+        return;
+    }
+
+    dict_destroy(g->phantoms);
+    free(g->match);
+    free(g->phantom_codes);
+    free(g->nodes);
+    free(g);
+}
+
+/*
+ * growth_clear: Start matching over, forgetting the phantom nodes.
+ */
+
+static bool growth_clear(struct growth* g)
+{
+    g->length = 0;
+    g->walked = 0;
+    g->prev = -1;
+    g->prev_length = 0;
+    g->phantom_count = 0;
+
+    for (size_t i = 0; i < g->node_capacity; ++i) {
+        g->nodes[i] = -1;
+    }
+
+    return g->phantoms == NULL || dict_clear(g->phantoms);
+}
+
+/*
+ * growth_init: Allocate the matching state of a growth policy. A match is
+ *              never longer than the longest string plus the byte that
+ *              ends it, so the buffer is allocated once.
+ */
+
+static struct growth* growth_init(enum lzw_growth policy)
+{
+    struct growth* g = malloc(sizeof(*g));
+
+    if (g == NULL) {
+        return NULL;
+    }
+
+    g->policy = policy;
+    g->match = malloc(LZW_GROWTH_MAX_LENGTH + 1);
+    g->phantoms = (policy == LZW_GROWTH_LZMW) ?
+        dict_init(LZW_CHAR_RANGE) :
+        NULL;
+    g->phantom_codes = NULL;
+    g->phantom_capacity = 0;
+    g->nodes = NULL;
+    g->node_capacity = 0;
+    g->allocated = sizeof(*g) + LZW_GROWTH_MAX_LENGTH + 1;
+
+    if (g->match == NULL
+            || (policy == LZW_GROWTH_LZMW && g->phantoms == NULL)) {
+        growth_destroy(g);
+        return NULL;
+    }
+
+    growth_clear(g);
+    return g;
+}
+
+/*
+ * growth_memory: Get the number of bytes the matching state holds, and
+ *                store the number it has allocated over its life.
+ */
+
+static size_t growth_memory(struct growth const* g,
+        unsigned long long* allocated)
+{
+    size_t held = sizeof(*g) + LZW_GROWTH_MAX_LENGTH + 1
+        + sizeof(*g->phantom_codes) * g->phantom_capacity
+        + sizeof(*g->nodes) * g->node_capacity;
+
+    *allocated = g->allocated;
+
+    if (g->phantoms != NULL) {
+        unsigned long long phantoms_allocated;
+
+        held += dict_memory(g->phantoms, &phantoms_allocated);
+        *allocated += phantoms_allocated;
+    }
+
+    return held;
+}
+
+/*
+ * create_encoder: Allocate an encoder with no output attached. If base is
+ *                 given, the dictionary is an overlay on top of it.
+ */
+
+static struct lzw_encoder* create_encoder(unsigned int start_bits,
+        unsigned int max_bits, struct dict const* base)
+{
+    if (start_bits < LZW_MINIMUM_BITS || max_bits > LZW_MAXIMUM_BITS) {
+        return NULL;
+    }
+
+    struct lzw_encoder* enc = malloc(sizeof(*enc));
+
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        enc->runs[i].codes = NULL;
+        enc->runs[i].count = 0;
+        enc->runs[i].capacity = 0;
+        enc->runs[i].shared = false;
+    }
+
+    enc->outs = NULL;
+    enc->emit = NULL;
+    enc->sink = NULL;
+    enc->lru = NULL;
+    enc->growth = NULL;
+    enc->ahead = NULL;
+    enc->ahead_length = 0;
+    enc->dict = (base != NULL) ?
+        dict_init_overlay(base, LZW_CHAR_RANGE) :
+        dict_init(LZW_CHAR_RANGE);
+
+    if (enc->dict == NULL) {
+        lzw_encoder_destroy(enc);
+        return NULL;
+    }
+
+    cw_init(&enc->cw, start_bits, max_bits);
+    enc->start_bits = start_bits;
+    enc->phased = false;
+    enc->preset = NULL;
+    enc->origin = NULL;
+    enc->prefix = -1;
+    enc->run_byte = -1;
+    enc->run_length = 0;
+    enc->sync_code = -1;
+
+    memset(&enc->stats, 0, sizeof(enc->stats));
+    enc->run_allocated = 0;
+
+    return enc;
+}
+
+/*
+ * lzw_encoder_init: Initialize an encoder that writes its codes via
+ *                   write_byte. Returns NULL if the parameters are invalid
+ *                   or allocation fails.
+ */
+
+struct lzw_encoder* lzw_encoder_init(unsigned int start_bits,
+        unsigned int max_bits,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    if (write_byte == NULL) {
+        return NULL;
+    }
+
+    struct lzw_encoder* enc = create_encoder(start_bits, max_bits, NULL);
+
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    enc->outs = outs_init(context, write_byte);
+
+    if (enc->outs == NULL) {
+        lzw_encoder_destroy(enc);
+        return NULL;
+    }
+
+    return enc;
+}
+
+/*
+ * encoder_init_sink: Initialize an encoder that hands each code and its
+ *                    width to emit instead of packing them itself.
+ */
+
+struct lzw_encoder* encoder_init_sink(unsigned int start_bits,
+        unsigned int max_bits,
+        void (*emit)(void* sink, code_t code, unsigned int bits),
+        void* sink)
+{
+    if (emit == NULL) {
+        return NULL;
+    }
+
+    struct lzw_encoder* enc = create_encoder(start_bits, max_bits, NULL);
+
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    enc->emit = emit;
+    enc->sink = sink;
+
+    return enc;
+}
+
+/*
+ * lzw_encoder_destroy: Free the structure allocated by lzw_encoder_init().
+ */
+
+void lzw_encoder_destroy(struct lzw_encoder* enc)
+{
+    if (enc == NULL) {
+        return;
+    }
+
+    if (enc->outs != NULL) {
+        outs_destroy(enc->outs);
+    }
+
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        if (!enc->runs[i].shared) {
+            free(enc->runs[i].codes);
+        }
+    }
+
+    dict_destroy(enc->dict);
+    lru_destroy(enc->lru);
+    growth_destroy(enc->growth);
+    free(enc->ahead);
+    free(enc);
+}
+
+/*
+ * lzw_encoder_enable_phase_in: Switch to phase-in codes, as long as no code
+ *                              has been written at full width yet.
+ */
+
+bool lzw_encoder_enable_phase_in(struct lzw_encoder* enc)
+{
+    if (enc->outs == NULL || enc->origin != NULL || enc->growth != NULL
+            || enc->stats.codes > 0) {
+        return false;
+    }
+
+    enc->phased = true;
+    return true;
+}
+
+/*
+ * lzw_encoder_enable_lru: Replace the least recently used entries once the
+ *                         table is full, as long as no code has been
+ *                         written yet.
+ */
+
+bool lzw_encoder_enable_lru(struct lzw_encoder* enc)
+{
+    if (enc->lru != NULL) {
+        return true;
+    }
+
+    if (enc->origin != NULL || enc->preset != NULL || enc->growth != NULL
+            || enc->ahead != NULL || enc->stats.codes > 0) {
+        return false;
+    }
+
+    enc->lru = lru_init();
+    return enc->lru != NULL;
+}
+
+/*
+ * lzw_encoder_set_growth: Choose how the table grows, as long as no byte
+ *                         has been encoded yet.
+ */
+
+bool lzw_encoder_set_growth(struct lzw_encoder* enc, enum lzw_growth policy)
+{
+    if (enc->origin != NULL || enc->preset != NULL || enc->lru != NULL
+            || enc->phased || enc->ahead != NULL || enc->stats.bytes_in > 0) {
+        return false;
+    }
+
+    if (policy == LZW_GROWTH_LZW) {
+        growth_destroy(enc->growth);
+        enc->growth = NULL;
+
+        return true;
+    }
+
+    if (policy != LZW_GROWTH_LZMW && policy != LZW_GROWTH_LZAP) {
+        return false;
+    }
+
+    struct growth* g = growth_init(policy);
+
+    if (g == NULL) {
+        return false;
+    }
+
+    growth_destroy(enc->growth);
+    enc->growth = g;
+
+    return true;
+}
+
+/*
+ * lzw_encoder_enable_lookahead: Parse with lookahead, as long as no byte
+ *                               has been encoded yet.
+ */
+
+bool lzw_encoder_enable_lookahead(struct lzw_encoder* enc)
+{
+    if (enc->ahead != NULL) {
+        return true;
+    }
+
+    if (enc->origin != NULL || enc->lru != NULL || enc->growth != NULL
+            || enc->stats.bytes_in > 0) {
+        return false;
+    }
+
+    enc->ahead = malloc(LOOKAHEAD_BUFFER);
+    return enc->ahead != NULL;
+}
+
+/*
+ * record_run: Add the code of the next longest run of c to its run table.
+ */
+
+static bool record_run(struct lzw_encoder* enc, unsigned char c, code_t code)
+{
+    struct run_table* const runs = &enc->runs[c];
+
+    if (runs->shared || runs->count == runs->capacity) {
+        size_t const new_capacity = runs->capacity * 2 + 16;
+        code_t* new_codes = malloc(sizeof(*new_codes) * new_capacity);
+
+        if (new_codes == NULL) {
+            return false;
+        }
+
+        if (runs->count > 0) {
+            memcpy(new_codes, runs->codes, sizeof(*new_codes) * runs->count);
+        }
+
+        if (!runs->shared) {
+            free(runs->codes);
+        }
+
+        runs->codes = new_codes;
+        runs->capacity = new_capacity;
+        runs->shared = false;
+        enc->run_allocated += sizeof(*new_codes) * new_capacity;
+    }
+
+    runs->codes[runs->count] = code;
+    ++runs->count;
+
+    return true;
+}
+
+/*
+ * run_code: Get the code of c repeated length times. The string must be in
+ *           the dictionary.
+ */
+
+static code_t run_code(struct lzw_encoder const* enc, unsigned char c,
+        size_t length)
+{
+    return (length == 1) ?
+        c :
+        enc->runs[c].codes[length - 2];
+}
+
+/*
+ * seed: Add the trained entries to the table, advancing the code width as
+ *       if each had been added while encoding. Fails if the dictionary
+ *       doesn't fit or holds the same string twice.
+ */
+
+static bool seed(struct lzw_encoder* enc)
+{
+    size_t const count = preset_size(enc->preset);
+
+    for (size_t i = 0; i < count; ++i) {
+        code_t prefix;
+        unsigned char c;
+
+        preset_entry(enc->preset, i, &prefix, &c);
+
+        code_t const code = cw_advance(&enc->cw);
+
+        if (code < 0 || !dict_insert(enc->dict, prefix, c, code)) {
+            return false;
+        }
+
+        // entries come after their prefixes, so runs arrive longest last
+        if (prefix == run_code(enc, c, enc->runs[c].count + 1)
+                && !record_run(enc, c, code)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * lzw_encoder_init_seeded: Initialize an encoder whose table starts out
+ *                          holding the entries of a trained dictionary.
+ */
+
+struct lzw_encoder* lzw_encoder_init_seeded(unsigned int start_bits,
+        unsigned int max_bits, struct lzw_dictionary const* dict,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    if (dict == NULL) {
+        return NULL;
+    }
+
+    struct lzw_encoder* enc = lzw_encoder_init(start_bits, max_bits,
+                                               write_byte, context);
+
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    enc->preset = dict;
+
+    if (!seed(enc)) {
+        lzw_encoder_destroy(enc);
+        return NULL;
+    }
+
+    return enc;
+}
+
+/*
+ * write_code: Write a code at the current width, or as a phase-in code
+ *             within it.
+ */
+
+static void write_code(struct lzw_encoder* enc, code_t code)
+{
+    if (enc->emit != NULL) {
+        (enc->emit)(enc->sink, code, enc->cw.cur_bits);
+    } else if (enc->phased) {
+        outs_write_phased(enc->outs, cw_to_phased(&enc->cw, code),
+                          cw_phased_range(&enc->cw), enc->cw.cur_bits);
+    } else {
+        outs_write_bits(enc->outs, code, enc->cw.cur_bits);
+    }
+}
+
+/*
+ * write_match: Write the code of the current match, counting it.
+ */
+
+static void write_match(struct lzw_encoder* enc)
+{
+    ++enc->stats.codes_by_width[enc->cw.cur_bits];
+    ++enc->stats.codes;
+    write_code(enc, enc->prefix);
+
+    if (enc->lru != NULL) {
+        lru_touch(enc->lru, enc->prefix);
+    }
+}
+
+/*
+ * output_bytes: Get the number of bytes written so far. An encoder that
+ *               hands its codes on can only tell from their widths.
+ */
+
+static unsigned long long output_bytes(struct lzw_encoder const* enc)
+{
+    if (enc->outs != NULL) {
+        return outs_bytes_written(enc->outs);
+    }
+
+    unsigned long long bits = 0;
+
+    for (size_t i = 0; i < LZW_STATS_WIDTHS; ++i) {
+        bits += enc->stats.codes_by_width[i] * i;
+    }
+
+    return bits / CHAR_BIT;
+}
+
+/*
+ * advance: Hand out the next code, noting when the width grows and when the
+ *          table fills up.
+ */
+
+static code_t advance(struct lzw_encoder* enc)
+{
+    unsigned int const bits = enc->cw.cur_bits;
+    code_t const code = cw_advance(&enc->cw);
+
+    if (enc->cw.cur_bits != bits) {
+        LZW_TRACE2(width__grow, enc->cw.cur_bits, enc->cw.next_code);
+    }
+
+    if (code < 0 && !enc->stats.frozen) {
+        enc->stats.frozen = true;
+        enc->stats.freeze_codes = enc->stats.codes;
+        enc->stats.freeze_offset = output_bytes(enc);
+        LZW_TRACE1(dict__full, enc->stats.codes);
+    }
+
+    return code;
+}
+
+/*
+ * replace: Free up the code of the least recently used leaf other than the
+ *          match just written, taking its string out of the table. Returns
+ *          -1 if there is no such leaf. A leaf run is the longest run of
+ *          its byte, so it comes off the end of the run table.
+ */
+
+static code_t replace(struct lzw_encoder* enc)
+{
+    code_t prefix;
+    unsigned char c;
+    code_t const code = lru_evict(enc->lru, enc->prefix, &prefix, &c);
+
+    if (code < 0) {
+        return -1;
+    }
+
+    dict_remove(enc->dict, prefix, c);
+
+    struct run_table* const runs = &enc->runs[c];
+
+    if (runs->count > 0 && runs->codes[runs->count - 1] == code) {
+        --runs->count;
+    }
+
+    ++enc->stats.replaced;
+    LZW_TRACE3(dict__replace, prefix, c, code);
+
+    return code;
+}
+
+/*
+ * encoder_emit: Write the code of the current match, which can't be extended
+ *               by c. Assign the extended string a new code if possible, and
+ *               restart the match at c.
+ */
+
+static bool encoder_emit(struct lzw_encoder* enc, unsigned char c)
+{
+    write_match(enc);
+
+    code_t code = advance(enc);
+
+    if (code < 0 && enc->lru != NULL) {
+        code = replace(enc);
+    }
+
+    if (code >= 0) {
+        if (!dict_insert(enc->dict, enc->prefix, c, code)
+                || (enc->lru != NULL
+                    && !lru_add(enc->lru, code, enc->prefix, c))) {
+            return false;
+        }
+
+        LZW_TRACE3(dict__insert, enc->prefix, c, code);
+
+        // a run that can't be extended is the longest one in the table
+        if (enc->run_byte == c && !record_run(enc, c, code)) {
+            return false;
+        }
+    }
+
+    enc->prefix = c;
+    enc->run_byte = c;
+    enc->run_length = 1;
+
+    return true;
+}
+
+/*
+ * complete_sync: Add the entry left pending by a sync flush, now that its
+ *                last byte is known. The string may already be in the
+ *                dictionary, since the flushed match could still have been
+ *                extended, in which case its new code simply goes unused.
+ */
+
+static bool complete_sync(struct lzw_encoder* enc, unsigned char c)
+{
+    code_t const code = enc->sync_code;
+
+    enc->sync_code = -1;
+
+    if (dict_lookup(enc->dict, enc->sync_prefix, c) >= 0) {
+        return true;
+    }
+
+    if (!dict_insert(enc->dict, enc->sync_prefix, c, code)) {
+        return false;
+    }
+
+    LZW_TRACE3(dict__insert, enc->sync_prefix, c, code);
+
+    // the run isn't in the table, so the flushed one was the longest
+    return enc->sync_run_byte != c || record_run(enc, c, code);
+}
+
+/*
+ * encoder_step: Extend the current match by c, emitting the match first if
+ *               the extended string isn't in the dictionary.
+ */
+
+static bool encoder_step(struct lzw_encoder* enc, unsigned char c)
+{
+    if (enc->prefix < 0) {
+        if (enc->sync_code >= 0 && !complete_sync(enc, c)) {
+            return false;
+        }
+
+        enc->prefix = c;
+        enc->run_byte = c;
+        enc->run_length = 1;
+
+        return true;
+    }
+
+    code_t const code = dict_lookup(enc->dict, enc->prefix, c);
+
+    ++enc->stats.lookups;
+
+    if (code < 0) {
+        ++enc->stats.misses;
+        return encoder_emit(enc, c);
+    }
+
+    enc->prefix = code;
+
+    if (enc->run_byte == c) {
+        ++enc->run_length;
+    } else {
+        enc->run_byte = -1;
+    }
+
+    return true;
+}
+
+/*
+ * encoder_run: Consume count repetitions of c while the current match is a
+ *              run of c. The dictionary's runs of c are exactly those up to
+ *              the longest one recorded, so the match can jump straight to
+ *              the end of each phrase instead of probing once per byte. The
+ *              codes written are the same as those encoder_step() would
+ *              write.
+ */
+
+static bool encoder_run(struct lzw_encoder* enc, unsigned char c,
+        size_t count)
+{
+    while (count > 0) {
+        size_t const longest = enc->runs[c].count + 1;
+
+        if (enc->run_length + count <= longest) {
+            enc->run_length += count;
+            enc->prefix = run_code(enc, c, enc->run_length);
+
+            return true;
+        }
+
+        // extend the match to the longest run, then emit it on the next byte
+        count -= longest - enc->run_length;
+        enc->run_length = longest;
+        enc->prefix = run_code(enc, c, longest);
+
+        if (!encoder_emit(enc, c)) {
+            return false;
+        }
+
+        --count;
+    }
+
+    return true;
+}
+
+/*
+ * grow_codes: Make room for index in an array of codes, filling the new
+ *             part with -1.
+ */
+
+static bool grow_codes(struct growth* g, code_t** codes, size_t* capacity,
+        size_t index)
+{
+    if (index < *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = (*capacity > 0) ? *capacity : LZW_CHAR_RANGE;
+
+    while (new_capacity <= index) {
+        new_capacity *= 2;
+    }
+
+    code_t* new_codes = realloc(*codes, sizeof(*new_codes) * new_capacity);
+
+    if (new_codes == NULL) {
+        return false;
+    }
+
+    for (size_t i = *capacity; i < new_capacity; ++i) {
+        new_codes[i] = -1;
+    }
+
+    *codes = new_codes;
+    *capacity = new_capacity;
+    g->allocated += sizeof(*new_codes) * new_capacity;
+
+    return true;
+}
+
+/*
+ * follow: Get the node reached from the given one by c, or -1.
+ */
+
+static code_t follow(struct lzw_encoder* enc, code_t node, unsigned char c)
+{
+    return (node & PHANTOM) ?
+        dict_lookup(enc->growth->phantoms, node & ~PHANTOM, c) :
+        dict_lookup(enc->dict, node, c);
+}
+
+/*
+ * link_node: Make next the node reached from the given one by c.
+ */
+
+static bool link_node(struct lzw_encoder* enc, code_t node, unsigned char c,
+        code_t next)
+{
+    return (node & PHANTOM) ?
+        dict_insert(enc->growth->phantoms, node & ~PHANTOM, c, next) :
+        dict_insert(enc->dict, node, c, next);
+}
+
+/*
+ * node_code: Get the code of a node, which is -1 for a phantom node that
+ *            hasn't been given one.
+ */
+
+static code_t node_code(struct growth const* g, code_t node)
+{
+    return (node & PHANTOM) ?
+        g->phantom_codes[node & ~PHANTOM] :
+        node;
+}
+
+/*
+ * code_node: Get the node of the string with the given code.
+ */
+
+static code_t code_node(struct growth const* g, code_t code)
+{
+    return ((size_t) code < g->node_capacity && g->nodes[code] >= 0) ?
+        g->nodes[code] :
+        code;
+}
+
+/*
+ * walk: Look up the bytes of the match that haven't been yet, noting the
+ *       longest string on the way. Returns false at the first byte that
+ *       can't be followed, leaving the match ready to be written.
+ */
+
+static bool walk(struct lzw_encoder* enc)
+{
+    struct growth* const g = enc->growth;
+
+    if (g->walked == 0) {
+        g->node = g->match[0];
+        g->code = g->match[0];
+        g->walked = 1;
+        g->coded = 1;
+    }
+
+    while (g->walked < g->length) {
+        code_t const next = follow(enc, g->node, g->match[g->walked]);
+
+        ++enc->stats.lookups;
+
+        if (next < 0) {
+            ++enc->stats.misses;
+            return false;
+        }
+
+        g->node = next;
+        ++g->walked;
+
+        code_t const code = node_code(g, next);
+
+        if (code >= 0) {
+            g->code = code;
+            g->coded = g->walked;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * add_prefixes: Add the previous match followed by each prefix of the
+ *               current one (LZAP). Every prefix of these strings is in the
+ *               table, so they're added a byte at a time like any other
+ *               entry. One may already be there, in which case its new
+ *               code goes unused, since the decoder can't tell.
+ */
+
+static bool add_prefixes(struct lzw_encoder* enc)
+{
+    struct growth* const g = enc->growth;
+    code_t prefix = g->prev;
+    bool added = false;
+
+    for (size_t i = 0; i < g->coded
+            && g->prev_length + i < LZW_GROWTH_MAX_LENGTH; ++i) {
+        code_t const code = advance(enc);
+
+        if (code < 0) {
+            break;
+        }
+
+        unsigned char const c = g->match[i];
+
+        // nothing can extend a string that was only just added
+        if (!added) {
+            code_t const existing = dict_lookup(enc->dict, prefix, c);
+
+            if (existing >= 0) {
+                prefix = existing;
+                continue;
+            }
+        }
+
+        if (!dict_insert(enc->dict, prefix, c, code)) {
+            return false;
+        }
+
+        LZW_TRACE3(dict__insert, prefix, c, code);
+        prefix = code;
+        added = true;
+    }
+
+    return true;
+}
+
+/*
+ * add_concatenation: Add the previous match followed by the current one
+ *                    (LZMW), linking in phantom nodes on the way to it. If
+ *                    the string is in the table already, or the node
+ *                    numbers have run out, its new code goes unused.
+ */
+
+static bool add_concatenation(struct lzw_encoder* enc)
+{
+    struct growth* const g = enc->growth;
+
+    if (g->prev_length + g->coded > LZW_GROWTH_MAX_LENGTH) {
+        return true;
+    }
+
+    code_t const code = advance(enc);
+
+    if (code < 0) {
+        return true;
+    }
+
+    code_t node = code_node(g, g->prev);
+    size_t const last = g->coded - 1;
+
+    for (size_t i = 0; i < last; ++i) {
+        code_t next = follow(enc, node, g->match[i]);
+
+        if (next < 0) {
+            if (g->phantom_count == PHANTOM_LIMIT) {
+                return true;
+            }
+
+            if (!grow_codes(g, &g->phantom_codes, &g->phantom_capacity,
+                            g->phantom_count)) {
+                return false;
+            }
+
+            g->phantom_codes[g->phantom_count] = -1;
+            next = (code_t) g->phantom_count++ | PHANTOM;
+
+            if (!link_node(enc, node, g->match[i], next)) {
+                return false;
+            }
+        }
+
+        node = next;
+    }
+
+    code_t const next = follow(enc, node, g->match[last]);
+
+    if (next < 0) {
+        return link_node(enc, node, g->match[last], code);
+    }
+
+    if ((next & PHANTOM) && node_code(g, next) < 0) {
+        if (!grow_codes(g, &g->nodes, &g->node_capacity, code)) {
+            return false;
+        }
+
+        g->phantom_codes[next & ~PHANTOM] = code;
+        g->nodes[code] = next;
+    }
+
+    return true;
+}
+
+/*
+ * write_walked: Write the longest string the walk found and add the
+ *               strings built from it, then give back the rest of the
+ *               match to be walked again.
+ */
+
+static bool write_walked(struct lzw_encoder* enc)
+{
+    struct growth* const g = enc->growth;
+
+    enc->prefix = g->code;
+    write_match(enc);
+    enc->prefix = -1;
+
+    if (g->prev >= 0) {
+        bool const added = (g->policy == LZW_GROWTH_LZAP) ?
+            add_prefixes(enc) :
+            add_concatenation(enc);
+
+        if (!added) {
+            return false;
+        }
+    }
+
+    g->prev = g->code;
+    g->prev_length = g->coded;
+    g->length -= g->coded;
+    g->walked = 0;
+    memmove(g->match, g->match + g->coded, g->length);
+
+    return true;
+}
+
+/*
+ * growth_write: Encode length bytes a byte at a time under a growth policy.
+ *               Each byte is matched as soon as it arrives, so a match
+ *               never holds more than the longest string plus one byte.
+ */
+
+static bool growth_write(struct lzw_encoder* enc, unsigned char const* bytes,
+        size_t length)
+{
+    struct growth* const g = enc->growth;
+
+    for (size_t i = 0; i < length; ++i) {
+        g->match[g->length++] = bytes[i];
+
+        while (!walk(enc)) {
+            if (!write_walked(enc)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * growth_finish: Write out the rest of the match, which may take several
+ *                strings.
+ */
+
+static bool growth_finish(struct lzw_encoder* enc)
+{
+    struct growth* const g = enc->growth;
+
+    while (g->length > 0) {
+        walk(enc);
+
+        if (!write_walked(enc)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * match_length: Get the length of the longest string in the table that the
+ *               given bytes start with, looking at no more than limit of
+ *               them.
+ */
+
+static size_t match_length(struct lzw_encoder* enc, unsigned char const* bytes,
+        size_t limit)
+{
+    if (limit == 0) {
+        return 0;
+    }
+
+    code_t code = bytes[0];
+    size_t length = 1;
+
+    while (length < limit) {
+        code_t const next = dict_lookup(enc->dict, code, bytes[length]);
+
+        ++enc->stats.lookups;
+
+        if (next < 0) {
+            ++enc->stats.misses;
+            break;
+        }
+
+        code = next;
+        ++length;
+    }
+
+    return length;
+}
+
+/*
+ * choose_match: Choose the length of the match the given bytes start with,
+ *               storing its code. Of the strings the bytes start with, the
+ *               one taken is that which, followed by the longest match
+ *               after it, reaches furthest into the window. Ties go to the
+ *               longer string, and until the table is full a shorter one
+ *               has to reach more than LOOKAHEAD_MARGIN bytes further, so
+ *               a greedy parse is only given up for a better one.
+ */
+
+static size_t choose_match(struct lzw_encoder* enc,
+        unsigned char const* bytes, size_t available, code_t* code)
+{
+    size_t const longest = match_length(enc, bytes, available);
+    size_t const window = (available < LOOKAHEAD_WINDOW) ?
+        available :
+        LOOKAHEAD_WINDOW;
+    size_t const margin = enc->stats.frozen ? 0 : LOOKAHEAD_MARGIN;
+    size_t chosen = longest;
+
+    if (longest < window) {
+        size_t reach = longest + match_length(enc, bytes + longest,
+                                              window - longest);
+
+        for (size_t length = longest - 1; length > 0 && reach < window;
+                --length) {
+            size_t const r = length + match_length(enc, bytes + length,
+                                                   window - length);
+
+            if (r > reach + margin) {
+                reach = r - margin;
+                chosen = length;
+            }
+        }
+    }
+
+    *code = bytes[0];
+
+    for (size_t i = 1; i < chosen; ++i) {
+        *code = dict_lookup(enc->dict, *code, bytes[i]);
+        ++enc->stats.lookups;
+    }
+
+    return chosen;
+}
+
+/*
+ * emit_parsed: Write the code of the current match, which the next match
+ *              starts after with c, and add the match followed by c, the
+ *              entry the decoder adds. A match shorter than the longest
+ *              can already be followed by c in the table, in which case
+ *              the new code goes unused, as after a sync flush.
+ */
+
+static bool emit_parsed(struct lzw_encoder* enc, unsigned char c)
+{
+    write_match(enc);
+
+    code_t const code = advance(enc);
+
+    if (code < 0 || dict_lookup(enc->dict, enc->prefix, c) >= 0) {
+        return true;
+    }
+
+    if (!dict_insert(enc->dict, enc->prefix, c, code)) {
+        return false;
+    }
+
+    LZW_TRACE3(dict__insert, enc->prefix, c, code);
+    return true;
+}
+
+/*
+ * parse_ahead: Choose and write matches while more than keep bytes are
+ *              held back, then move the rest to the front of the buffer.
+ *              The last match chosen is left as the current match, the
+ *              same as after a greedy step. The run tables aren't kept up,
+ *              since the run fast path is never taken.
+ */
+
+static bool parse_ahead(struct lzw_encoder* enc, size_t keep)
+{
+    size_t i = 0;
+
+    while (enc->ahead_length - i > keep) {
+        unsigned char const c = enc->ahead[i];
+
+        if (enc->prefix >= 0) {
+            if (!emit_parsed(enc, c)) {
+                return false;
+            }
+        } else if (enc->sync_code >= 0 && !complete_sync(enc, c)) {
+            return false;
+        }
+
+        code_t code;
+
+        i += choose_match(enc, enc->ahead + i, enc->ahead_length - i, &code);
+        enc->prefix = code;
+    }
+
+    enc->ahead_length -= i;
+    memmove(enc->ahead, enc->ahead + i, enc->ahead_length);
+
+    return true;
+}
+
+/*
+ * lookahead_write: Add length bytes to those held back, parsing whenever
+ *                  the buffer fills.
+ */
+
+static bool lookahead_write(struct lzw_encoder* enc,
+        unsigned char const* bytes, size_t length)
+{
+    while (length > 0) {
+        size_t n = LOOKAHEAD_BUFFER - enc->ahead_length;
+
+        if (n > length) {
+            n = length;
+        }
+
+        memcpy(enc->ahead + enc->ahead_length, bytes, n);
+        enc->ahead_length += n;
+        bytes += n;
+        length -= n;
+
+        if (enc->ahead_length == LOOKAHEAD_BUFFER
+                && !parse_ahead(enc, LOOKAHEAD_KEEP)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * lzw_encoder_write: Encode length bytes.
+ */
+
+bool lzw_encoder_write(struct lzw_encoder* enc, unsigned char const* bytes,
+        size_t length)
+{
+    size_t i = 0;
+
+    LZW_TRACE1(block__start, length);
+    enc->stats.bytes_in += length;
+
+    if (enc->growth != NULL || enc->ahead != NULL) {
+        bool const written = (enc->growth != NULL) ?
+            growth_write(enc, bytes, length) :
+            lookahead_write(enc, bytes, length);
+
+        if (!written) {
+            return false;
+        }
+
+        i = length;
+    }
+
+    while (i < length) {
+        unsigned char const c = bytes[i];
+
+        if (enc->run_byte != c) {
+            if (!encoder_step(enc, c)) {
+                return false;
+            }
+
+            ++i;
+            continue;
+        }
+
+        // the match is a run of c, so see how far the input continues it
+        size_t run = 1;
+
+        while (i + run < length && bytes[i + run] == c) {
+            ++run;
+        }
+
+        if (run >= RUN_THRESHOLD) {
+            if (!encoder_run(enc, c, run)) {
+                return false;
+            }
+        } else {
+            for (size_t j = 0; j < run; ++j) {
+                if (!encoder_step(enc, c)) {
+                    return false;
+                }
+            }
+        }
+
+        i += run;
+    }
+
+    LZW_TRACE2(block__end, length, enc->stats.codes);
+    return true;
+}
+
+/*
+ * lzw_encoder_finish: Write the code of the current match, if any, and
+ *                     flush the output.
+ */
+
+bool lzw_encoder_finish(struct lzw_encoder* enc)
+{
+    if (enc->ahead != NULL && !parse_ahead(enc, 0)) {
+        return false;
+    }
+
+    if (enc->growth != NULL) {
+        if (!growth_finish(enc)) {
+            return false;
+        }
+    } else if (enc->prefix >= 0) {
+        write_match(enc);
+        enc->prefix = -1;
+    }
+
+    if (enc->outs != NULL) {
+        outs_flush(enc->outs);
+    }
+
+    LZW_TRACE1(flush, output_bytes(enc));
+    return true;
+}
+
+/*
+ * lzw_encoder_sync: Write the current match as the decoder would expect at
+ *                   the end of the input, then the marker, then pad to a
+ *                   byte boundary. Only encoders that pack their own output
+ *                   and freeze a full table can be flushed.
+ */
+
+bool lzw_encoder_sync(struct lzw_encoder* enc)
+{
+    if (enc->outs == NULL || enc->lru != NULL || enc->growth != NULL) {
+        return false;
+    }
+
+    if (enc->ahead != NULL && !parse_ahead(enc, 0)) {
+        return false;
+    }
+
+    if (enc->prefix < 0) {
+        return true;
+    }
+
+    write_match(enc);
+
+    enc->sync_prefix = enc->prefix;
+    enc->sync_run_byte = enc->run_byte;
+    enc->sync_code = advance(enc);
+
+    write_code(enc, cw_sync_marker(&enc->cw));
+    outs_flush(enc->outs);
+    LZW_TRACE1(flush, output_bytes(enc));
+
+    enc->prefix = -1;
+    enc->run_byte = -1;
+    enc->run_length = 0;
+
+    return true;
+}
+
+/*
+ * lzw_encoder_snapshot: Freeze the encoder, holding back its partial byte.
+ */
+
+struct lzw_snapshot* lzw_encoder_snapshot(struct lzw_encoder* enc)
+{
+    if (enc->outs == NULL || enc->lru != NULL || enc->growth != NULL
+            || enc->ahead != NULL) {
+        return NULL;
+    }
+
+    struct lzw_snapshot* snap = malloc(sizeof(*snap));
+
+    if (snap == NULL) {
+        return NULL;
+    }
+
+    snap->enc = enc;
+    snap->bits = outs_get_pending(enc->outs, &snap->bit_count);
+    outs_set_pending(enc->outs, 0, 0);
+
+    return snap;
+}
+
+/*
+ * lzw_snapshot_destroy: Free the snapshot along with the encoder it holds.
+ */
+
+void lzw_snapshot_destroy(struct lzw_snapshot* snap)
+{
+    if (snap == NULL) {
+        return;
+    }
+
+    lzw_encoder_destroy(snap->enc);
+    free(snap);
+}
+
+/*
+ * inherit: Take over the coding state of a snapshot, sharing its run tables
+ *          until they're next extended. The dictionary is left alone.
+ */
+
+static void inherit(struct lzw_encoder* enc, struct lzw_snapshot const* snap)
+{
+    struct lzw_encoder const* const base = snap->enc;
+
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        if (!enc->runs[i].shared) {
+            free(enc->runs[i].codes);
+        }
+
+        enc->runs[i] = base->runs[i];
+        enc->runs[i].shared = true;
+    }
+
+    enc->cw = base->cw;
+    enc->phased = base->phased;
+    enc->preset = base->preset;
+    enc->prefix = base->prefix;
+    enc->run_byte = base->run_byte;
+    enc->run_length = base->run_length;
+    enc->sync_prefix = base->sync_prefix;
+    enc->sync_code = base->sync_code;
+    enc->sync_run_byte = base->sync_run_byte;
+
+    outs_set_pending(enc->outs, snap->bits, snap->bit_count);
+}
+
+/*
+ * lzw_snapshot_fork: Create an encoder that continues from the snapshot,
+ *                    with a dictionary layered over the snapshot's.
+ */
+
+struct lzw_encoder* lzw_snapshot_fork(struct lzw_snapshot const* snap,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    if (write_byte == NULL) {
+        return NULL;
+    }
+
+    struct lzw_encoder const* const base = snap->enc;
+    struct lzw_encoder* enc = create_encoder(base->start_bits,
+                                             base->cw.max_bits, base->dict);
+
+    if (enc == NULL) {
+        return NULL;
+    }
+
+    enc->outs = outs_init(context, write_byte);
+
+    if (enc->outs == NULL) {
+        lzw_encoder_destroy(enc);
+        return NULL;
+    }
+
+    enc->origin = snap;
+    inherit(enc, snap);
+
+    return enc;
+}
+
+/*
+ * memory_held: Get the number of bytes held by the encoder and the tables
+ *              it owns, storing the number it has allocated over its life
+ *              in allocated.
+ */
+
+static size_t memory_held(struct lzw_encoder const* enc,
+        unsigned long long* allocated)
+{
+    size_t held = sizeof(*enc) + dict_memory(enc->dict, allocated);
+
+    if (enc->lru != NULL) {
+        unsigned long long lru_allocated;
+
+        held += lru_memory(enc->lru, &lru_allocated);
+        *allocated += lru_allocated;
+    }
+
+    if (enc->growth != NULL) {
+        unsigned long long growth_allocated;
+
+        held += growth_memory(enc->growth, &growth_allocated);
+        *allocated += growth_allocated;
+    }
+
+    if (enc->ahead != NULL) {
+        held += LOOKAHEAD_BUFFER;
+        *allocated += LOOKAHEAD_BUFFER;
+    }
+
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        if (!enc->runs[i].shared) {
+            held += sizeof(*enc->runs[i].codes) * enc->runs[i].capacity;
+        }
+    }
+
+    *allocated += sizeof(*enc) + enc->run_allocated;
+    return held;
+}
+
+/*
+ * lzw_encoder_stats: Copy out the counts and fill in the rest. The tables
+ *                    never shrink while encoding, so they're at their
+ *                    largest now, unless the encoder was reset.
+ */
+
+void lzw_encoder_stats(struct lzw_encoder const* enc,
+        struct lzw_stats* stats)
+{
+    unsigned long long allocated;
+    size_t const held = memory_held(enc, &allocated);
+
+    *stats = enc->stats;
+    stats->bytes_out = output_bytes(enc);
+    cw_stats(&enc->cw, enc->start_bits, stats);
+
+    stats->average_match = (stats->codes > 0) ?
+        (double) stats->bytes_in / stats->codes :
+        0;
+    stats->bytes_allocated = allocated;
+
+    if (held > stats->peak_memory) {
+        stats->peak_memory = held;
+    }
+}
+
+/*
+ * lzw_encoder_reset: Clear the dictionary and run tables and start over.
+ *                    The counts start over too, except for the peak memory
+ *                    use.
+ */
+
+bool lzw_encoder_reset(struct lzw_encoder* enc)
+{
+    unsigned long long allocated;
+    size_t const held = memory_held(enc, &allocated);
+    unsigned long long const peak = (held > enc->stats.peak_memory) ?
+        held :
+        enc->stats.peak_memory;
+
+    memset(&enc->stats, 0, sizeof(enc->stats));
+    enc->stats.peak_memory = peak;
+
+    if (!dict_clear(enc->dict)) {
+        return false;
+    }
+
+    LZW_TRACE0(dict__reset);
+
+    if (enc->lru != NULL) {
+        lru_clear(enc->lru);
+    }
+
+    if (enc->growth != NULL && !growth_clear(enc->growth)) {
+        return false;
+    }
+
+    enc->ahead_length = 0;
+
+    if (enc->origin != NULL) {
+        inherit(enc, enc->origin);
+        return true;
+    }
+
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        enc->runs[i].count = 0;
+    }
+
+    cw_init(&enc->cw, enc->start_bits, enc->cw.max_bits);
+    enc->prefix = -1;
+    enc->run_byte = -1;
+    enc->run_length = 0;
+    enc->sync_code = -1;
+
+    return enc->preset == NULL || seed(enc);
+}
+
+/*
+ * An entry of the table being saved, indexed by its code. A prefix of -1
+ * marks a code that was handed out without being added, which happens
+ * after a sync flush.
+ */
+
+struct saved_entry {
+    code_t prefix;
+    unsigned char c;
+};
+
+/*
+ * save_entry: Dictionary visitor that files each entry under its code.
+ */
+
+static void save_entry(code_t prefix, unsigned char c, code_t code,
+        void* context)
+{
+    struct saved_entry* entries = context;
+
+    entries[code - LZW_CHAR_RANGE].prefix = prefix;
+    entries[code - LZW_CHAR_RANGE].c = c;
+}
+
+/*
+ * lzw_encoder_checkpoint: Write the coding state, then the table in code
+ *                         order. The run tables aren't saved, since they
+ *                         can be rebuilt from the table.
+ */
+
+bool lzw_encoder_checkpoint(struct lzw_encoder const* enc,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    if (enc->outs == NULL || enc->phased || enc->lru != NULL
+            || enc->growth != NULL || enc->ahead != NULL
+            || write_byte == NULL) {
+        return false;
+    }
+
+    // one spare entry, so that an empty table isn't a zero-size allocation
+    size_t const count = enc->cw.next_code - LZW_CHAR_RANGE;
+    struct saved_entry* entries = malloc(sizeof(*entries) * (count + 1));
+
+    if (entries == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        entries[i].prefix = -1;
+        entries[i].c = 0;
+    }
+
+    dict_visit(enc->dict, save_entry, entries);
+
+    struct checkpoint_writer w = { write_byte, context };
+    bool const syncing = enc->sync_code >= 0;
+    size_t bit_count;
+    unsigned char const bits = outs_get_pending(enc->outs, &bit_count);
+
+    checkpoint_put_header(&w, CHECKPOINT_ENCODER);
+    checkpoint_put(&w, enc->start_bits, 1);
+    checkpoint_put(&w, enc->cw.max_bits, 1);
+    checkpoint_put(&w, enc->cw.cur_bits, 1);
+    checkpoint_put(&w, enc->cw.next_code, 4);
+    checkpoint_put(&w, enc->prefix + 1, 4);
+    checkpoint_put(&w, enc->run_byte + 1, 2);
+    checkpoint_put(&w, enc->run_length, 4);
+    checkpoint_put(&w, enc->sync_code + 1, 4);
+    checkpoint_put(&w, syncing ? enc->sync_prefix + 1 : 0, 4);
+    checkpoint_put(&w, syncing ? enc->sync_run_byte + 1 : 0, 2);
+    checkpoint_put(&w, bits, 1);
+    checkpoint_put(&w, bit_count, 1);
+
+    for (size_t i = 0; i < count; ++i) {
+        checkpoint_put(&w, entries[i].prefix + 1, 4);
+        checkpoint_put(&w, entries[i].c, 1);
+    }
+
+    free(entries);
+    return true;
+}
+
+/*
+ * restore: Read the coding state and table of a checkpoint into a new
+ *          encoder, rebuilding the run tables the same way seed() does.
+ *          Anything that would leave the encoder inconsistent is rejected.
+ */
+
+static bool restore(struct lzw_encoder* enc, struct checkpoint_reader* r)
+{
+    enc->cw.cur_bits = checkpoint_get(r, 1);
+    enc->cw.next_code = checkpoint_get(r, 4);
+    enc->prefix = (code_t) checkpoint_get(r, 4) - 1;
+    enc->run_byte = (int) checkpoint_get(r, 2) - 1;
+    enc->run_length = checkpoint_get(r, 4);
+    enc->sync_code = (code_t) checkpoint_get(r, 4) - 1;
+    enc->sync_prefix = (code_t) checkpoint_get(r, 4) - 1;
+    enc->sync_run_byte = (int) checkpoint_get(r, 2) - 1;
+
+    unsigned char const bits = checkpoint_get(r, 1);
+    size_t const bit_count = checkpoint_get(r, 1);
+    code_t const next_code = enc->cw.next_code;
+
+    if (r->failed
+            || enc->cw.cur_bits < enc->start_bits
+            || enc->cw.cur_bits > enc->cw.max_bits
+            || next_code < LZW_CHAR_RANGE
+            || next_code > ((code_t) 1 << enc->cw.cur_bits)
+            || enc->prefix < -1 || enc->prefix >= next_code
+            || enc->run_byte >= LZW_CHAR_RANGE
+            || enc->sync_code < -1 || enc->sync_code >= next_code
+            || enc->sync_prefix < -1 || enc->sync_prefix >= next_code
+            || enc->sync_run_byte >= LZW_CHAR_RANGE
+            || bit_count >= CHAR_BIT) {
+        return false;
+    }
+
+    outs_set_pending(enc->outs, bits, bit_count);
+
+    for (code_t code = LZW_CHAR_RANGE; code < next_code; ++code) {
+        code_t const prefix = (code_t) checkpoint_get(r, 4) - 1;
+        unsigned char const c = checkpoint_get(r, 1);
+
+        if (r->failed || prefix < -1 || prefix >= code) {
+            return false;
+        }
+
+        if (prefix < 0) {
+            continue;
+        }
+
+        if (!dict_insert(enc->dict, prefix, c, code)) {
+            return false;
+        }
+
+        if (prefix == run_code(enc, c, enc->runs[c].count + 1)
+                && !record_run(enc, c, code)) {
+            return false;
+        }
+    }
+
+    // the current match must be the run it claims to be
+    if (enc->run_byte >= 0) {
+        size_t const longest = enc->runs[enc->run_byte].count + 1;
+
+        if (enc->run_length == 0 || enc->run_length > longest
+                || enc->prefix != run_code(enc, enc->run_byte,
+                                           enc->run_length)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * lzw_encoder_resume: Create an encoder from the state in a checkpoint.
+ */
+
+struct lzw_encoder* lzw_encoder_resume(int (*read_checkpoint)(void* context),
+        void* checkpoint,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    if (read_checkpoint == NULL) {
+        return NULL;
+    }
+
+    struct checkpoint_reader r = { read_checkpoint, checkpoint, false };
+
+    if (!checkpoint_check_header(&r, CHECKPOINT_ENCODER)) {
+        return NULL;
+    }
+
+    unsigned int const start_bits = checkpoint_get(&r, 1);
+    unsigned int const max_bits = checkpoint_get(&r, 1);
+    struct lzw_encoder* enc = NULL;
+
+    if (!r.failed && start_bits <= max_bits) {
+        enc = lzw_encoder_init(start_bits, max_bits, write_byte, context);
+    }
+
+    if (enc != NULL && !restore(enc, &r)) {
+        lzw_encoder_destroy(enc);
+        return NULL;
+    }
+
+    return enc;
+}
+
+/*
+ * A stream of lzw_encode_batch() being encoded, with the input read ahead
+ * of its encoder. Knowing the next byte is what lets the dictionary probe
+ * for it be prefetched a round before it happens. interleaved is set when
+ * the chunk was read with the table large enough to be worth it. failed is
+ * set once the encoder has failed, and the rest of the stream is skipped.
+ */
+
+struct batch_lane {
+    struct lzw_encoder* enc;
+    struct lzw_stream const* stream;
+    bool interleaved;
+    bool failed;
+
+    unsigned char input[BATCH_CHUNK];
+    size_t length;
+    size_t position;
+};
+
+/*
+ * lane_fill: Read the next chunk of the lane's stream. Returns false once
+ *            there's nothing left to encode.
+ */
+
+static bool lane_fill(struct batch_lane* lane)
+{
+    struct lzw_stream const* const stream = lane->stream;
+    size_t length = 0;
+    int c;
+
+    while (!lane->failed && length < BATCH_CHUNK
+            && (c = (stream->read_byte)(stream->context)) != EOF) {
+        lane->input[length++] = c;
+    }
+
+    lane->length = length;
+    lane->position = 0;
+    lane->interleaved = dict_size(lane->enc->dict) >= BATCH_CACHED_ENTRIES;
+
+    return length > 0;
+}
+
+/*
+ * lane_step: Make one probe's worth of progress on the lane, jumping over a
+ *            run the way lzw_encoder_write() does, then prefetch the slot
+ *            that the lane's next probe will start at. Unless the chunk is
+ *            interleaved, the rest of it is written at once instead.
+ */
+
+static bool lane_step(struct batch_lane* lane)
+{
+    struct lzw_encoder* const enc = lane->enc;
+    unsigned char const* const input = lane->input;
+    size_t i = lane->position;
+
+    if (!lane->interleaved) {
+        lane->position = lane->length;
+        return lzw_encoder_write(enc, input + i, lane->length - i);
+    }
+
+    unsigned char const c = input[i];
+    size_t run = 1;
+
+    if (enc->run_byte == c) {
+        while (i + run < lane->length && input[i + run] == c) {
+            ++run;
+        }
+    }
+
+    bool const stepped = (run >= RUN_THRESHOLD) ?
+        encoder_run(enc, c, run) :
+        encoder_step(enc, c);
+
+    i += (run >= RUN_THRESHOLD) ? run : 1;
+    enc->stats.bytes_in += i - lane->position;
+    lane->position = i;
+
+    if (i < lane->length && enc->prefix >= 0) {
+        dict_prefetch(enc->dict, enc->prefix, input[i]);
+    }
+
+    return stepped;
+}
+
+/*
+ * lane_start: Hand a lane's encoder over to the given stream, starting its
+ *             table and output over.
+ */
+
+static bool lane_start(struct batch_lane* lane,
+        struct lzw_stream const* stream)
+{
+    lane->stream = stream;
+    lane->failed = !lzw_encoder_reset(lane->enc);
+    lane->length = 0;
+    lane->position = 0;
+
+    outs_redirect(lane->enc->outs, stream->context, stream->write_byte);
+
+    return !lane->failed;
+}
+
+/*
+ * lzw_encode_batch: Encode the streams BATCH_GROUP at a time. Once a
+ *                   stream's table outgrows BATCH_CACHED_ENTRIES, it takes
+ *                   a single probe per turn, with its next probe prefetched
+ *                   a round ahead, so its cache miss is serviced while the
+ *                   others are stepped. Until then it's written a chunk per
+ *                   turn. A lane whose stream ends
+ *                   moves on to the next stream with the same encoder, so
+ *                   its tables are allocated once and keep the size they
+ *                   grew to.
+ */
+
+bool lzw_encode_batch(unsigned int start_bits, unsigned int max_bits,
+        struct lzw_stream const* streams, size_t stream_count)
+{
+    for (size_t i = 0; i < stream_count; ++i) {
+        if (streams[i].read_byte == NULL || streams[i].write_byte == NULL) {
+            return false;
+        }
+    }
+
+    size_t const lane_count = (stream_count < BATCH_GROUP) ?
+        stream_count :
+        BATCH_GROUP;
+
+    if (lane_count == 0) {
+        return true;
+    }
+
+    struct batch_lane* lanes = malloc(sizeof(*lanes) * lane_count);
+
+    if (lanes == NULL) {
+        return false;
+    }
+
+    bool success = true;
+
+    for (size_t i = 0; i < lane_count; ++i) {
+        lanes[i].enc = lzw_encoder_init(start_bits, max_bits,
+                                        streams[i].write_byte,
+                                        streams[i].context);
+        lanes[i].stream = &streams[i];
+        lanes[i].interleaved = false;
+        lanes[i].failed = false;
+        lanes[i].length = 0;
+        lanes[i].position = 0;
+
+        success = success && lanes[i].enc != NULL;
+    }
+
+    size_t next = lane_count;
+    size_t active = success ? lane_count : 0;
+
+    while (active > 0) {
+        size_t i = 0;
+
+        while (i < active) {
+            struct batch_lane* const lane = &lanes[i];
+
+            if (lane->position < lane->length || lane_fill(lane)) {
+                if (!lane_step(lane)) {
+                    lane->failed = true;
+                    lane->length = 0;
+                    lane->position = 0;
+                }
+
+                ++i;
+                continue;
+            }
+
+            // the stream is done, so the lane takes on the next one
+            success = !lane->failed && lzw_encoder_finish(lane->enc)
+                && success;
+
+            if (next < stream_count) {
+                success = lane_start(lane, &streams[next++]) && success;
+                continue;
+            }
+
+            // or retires, swapping its encoder past the live lanes
+            --active;
+
+            struct lzw_encoder* const enc = lane->enc;
+            *lane = lanes[active];
+            lanes[active].enc = enc;
+        }
+    }
+
+    for (size_t i = 0; i < lane_count; ++i) {
+        lzw_encoder_destroy(lanes[i].enc);
+    }
+
+    free(lanes);
+    return success;
+}
@@ -0,0 +1,658 @@
+#include "lzw.h"
+#include "encoder.h"
+#include "decoder.h"
+#include "instream.h"
+#include "outstream.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BLOCK_CODES (1 << 16)
+#define READ_BLOCK_SIZE 4096
+
+// literals are symbols of their own, while longer codes are grouped by
+// their top bit and the MANTISSA_BITS below it, the rest being stored as is.
+// Every block lists the frequencies of all the symbols, so the widest codes
+// are fixed by the format (LZW_ENTROPY_MAX_BITS) rather than by
+// LZW_MAXIMUM_BITS.
+#define MANTISSA_BITS 4
+#define SYMBOL_COUNT (LZW_CHAR_RANGE \
+    + (LZW_ENTROPY_MAX_BITS - LZW_MINIMUM_BITS) * (1 << MANTISSA_BITS))
+#define MAX_EXTRA_BITS (LZW_ENTROPY_MAX_BITS - 1 - MANTISSA_BITS)
+
+// symbol frequencies are scaled to sum to SCALE, and the coder's state is
+// kept between RANS_LOW and 256 times that, a byte being moved at a time
+#define SCALE_BITS 14
+#define SCALE ((uint32_t) 1 << SCALE_BITS)
+#define RANS_LOW ((uint32_t) 1 << 23)
+
+// the largest a block's parts can be: a symbol takes at most SCALE_BITS,
+// and the final state four bytes
+#define MAX_CODED_LENGTH (2 * BLOCK_CODES + 4)
+#define MAX_EXTRAS_LENGTH ((BLOCK_CODES * MAX_EXTRA_BITS + 7) / 8)
+
+/*
+ * The entropy coding stage of the encoder: codes are gathered into blocks,
+ * whose symbols are rANS coded with the block's own frequencies.
+ */
+
+struct entropy_writer {
+    void (*write_byte)(unsigned char c, void* context);
+    void* context;
+
+    uint16_t* symbols;
+    size_t length;
+
+    // the bits of each code beyond its symbol, packed in order
+    struct outstream* extras;
+    unsigned char* extra_bytes;
+    size_t extras_length;
+
+    unsigned char* coded;
+};
+
+/*
+ * The matching stage of the decoder, which hands out the codes of a block
+ * at a time.
+ */
+
+struct entropy_reader {
+    int (*read_byte)(void* context);
+    void* context;
+
+    uint16_t freqs[SYMBOL_COUNT];
+    uint16_t starts[SYMBOL_COUNT];
+    uint16_t* slots;
+
+    uint32_t state;
+    unsigned char* coded;
+    size_t coded_length;
+    size_t coded_position;
+
+    struct instream* extras;
+    unsigned char* extra_bytes;
+    size_t extras_length;
+    size_t extras_position;
+
+    size_t remaining;
+    bool finished;
+    bool success;
+};
+
+/*
+ * code_symbol: Get the symbol a code is coded as, along with the number of
+ *              low bits of the code it leaves out.
+ */
+
+static unsigned int code_symbol(code_t code, unsigned int* extra_bits)
+{
+    if (code < LZW_CHAR_RANGE) {
+        *extra_bits = 0;
+        return code;
+    }
+
+    unsigned int top = LZW_MINIMUM_BITS;
+
+    while ((code >> (top + 1)) != 0) {
+        ++top;
+    }
+
+    unsigned int const mantissa = (code >> (top - MANTISSA_BITS))
+        & ((1 << MANTISSA_BITS) - 1);
+
+    *extra_bits = top - MANTISSA_BITS;
+    return LZW_CHAR_RANGE + ((top - LZW_MINIMUM_BITS) << MANTISSA_BITS)
+        + mantissa;
+}
+
+/*
+ * write_varint: Write a number seven bits at a time, low bits first, with
+ *               the top bit of each byte set if more follow.
+ */
+
+static void write_varint(struct entropy_writer* w, size_t value)
+{
+    while (value >= 0x80) {
+        w->write_byte((value & 0x7f) | 0x80, w->context);
+        value >>= 7;
+    }
+
+    w->write_byte(value, w->context);
+}
+
+static void write_bytes(struct entropy_writer* w, unsigned char const* bytes,
+        size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        w->write_byte(bytes[i], w->context);
+    }
+}
+
+/*
+ * store_extra: outstream callback that collects the extra bits of a block.
+ */
+
+static void store_extra(unsigned char c, void* context)
+{
+    struct entropy_writer* w = context;
+    w->extra_bytes[w->extras_length++] = c;
+}
+
+/*
+ * normalize: Scale the counts of the symbols in a block of length codes to
+ *            frequencies that sum to SCALE, keeping every symbol that
+ *            occurs at a frequency of at least 1.
+ */
+
+static void normalize(uint32_t const* counts, size_t length, uint16_t* freqs)
+{
+    uint32_t sum = 0;
+    size_t largest = 0;
+
+    for (size_t s = 0; s < SYMBOL_COUNT; ++s) {
+        uint32_t freq = (uint64_t) counts[s] * SCALE / length;
+
+        if (freq == 0 && counts[s] > 0) {
+            freq = 1;
+        }
+
+        freqs[s] = freq;
+        sum += freq;
+
+        if (counts[s] > counts[largest]) {
+            largest = s;
+        }
+    }
+
+    // rounding down leaves a shortfall, which goes to the most common
+    // symbol, while rounding rare symbols up can leave an excess, which is
+    // taken from whichever symbols can spare it
+    if (sum < SCALE) {
+        freqs[largest] += SCALE - sum;
+    }
+
+    for (size_t s = 0; sum > SCALE; s = (s + 1) % SYMBOL_COUNT) {
+        if (freqs[s] > 1) {
+            --freqs[s];
+            --sum;
+        }
+    }
+}
+
+/*
+ * write_freqs: Write the frequency table, each frequency as a varint, with
+ *              a zero followed by the number of zeros after it.
+ */
+
+static void write_freqs(struct entropy_writer* w, uint16_t const* freqs)
+{
+    for (size_t s = 0; s < SYMBOL_COUNT; ++s) {
+        write_varint(w, freqs[s]);
+
+        if (freqs[s] == 0) {
+            size_t run = 0;
+
+            while (s + 1 < SYMBOL_COUNT && freqs[s + 1] == 0 && run < 255) {
+                ++run;
+                ++s;
+            }
+
+            w->write_byte(run, w->context);
+        }
+    }
+}
+
+/*
+ * rans_encode: Code the symbols backwards from the end of out, so that they
+ *              decode forwards. Returns the number of bytes written.
+ */
+
+static size_t rans_encode(uint16_t const* symbols, size_t length,
+        uint16_t const* freqs, uint16_t const* starts, unsigned char* out)
+{
+    unsigned char* p = out + MAX_CODED_LENGTH;
+    uint32_t x = RANS_LOW;
+
+    for (size_t i = length; i-- > 0;) {
+        uint32_t const freq = freqs[symbols[i]];
+        uint32_t const x_max = ((RANS_LOW >> SCALE_BITS) << 8) * freq;
+
+        while (x >= x_max) {
+            *--p = x & 0xff;
+            x >>= 8;
+        }
+
+        x = ((x / freq) << SCALE_BITS) + x % freq + starts[symbols[i]];
+    }
+
+    p -= 4;
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+
+    return out + MAX_CODED_LENGTH - p;
+}
+
+/*
+ * write_block: Write out the gathered codes as a block: the code count,
+ *              the frequency table, then the coded symbols and the extra
+ *              bits, each preceded by its length.
+ */
+
+static void write_block(struct entropy_writer* w)
+{
+    uint32_t counts[SYMBOL_COUNT] = { 0 };
+    uint16_t freqs[SYMBOL_COUNT];
+    uint16_t starts[SYMBOL_COUNT];
+
+    for (size_t i = 0; i < w->length; ++i) {
+        ++counts[w->symbols[i]];
+    }
+
+    normalize(counts, w->length, freqs);
+
+    for (size_t s = 0, start = 0; s < SYMBOL_COUNT; ++s) {
+        starts[s] = start;
+        start += freqs[s];
+    }
+
+    size_t const coded_length = rans_encode(w->symbols, w->length, freqs,
+                                            starts, w->coded);
+
+    outs_flush(w->extras);
+
+    write_varint(w, w->length);
+    write_freqs(w, freqs);
+    write_varint(w, coded_length);
+    write_bytes(w, w->coded + MAX_CODED_LENGTH - coded_length, coded_length);
+    write_varint(w, w->extras_length);
+    write_bytes(w, w->extra_bytes, w->extras_length);
+
+    w->length = 0;
+    w->extras_length = 0;
+}
+
+/*
+ * push_code: Encoder sink that adds a code to the current block, writing
+ *            the block out once it's full.
+ */
+
+static void push_code(void* sink, code_t code, unsigned int bits)
+{
+    struct entropy_writer* w = sink;
+    unsigned int extra_bits;
+
+    (void) bits;
+
+    w->symbols[w->length++] = code_symbol(code, &extra_bits);
+
+    if (extra_bits > 0) {
+        outs_write_bits(w->extras, code & ((1 << extra_bits) - 1),
+                        extra_bits);
+    }
+
+    if (w->length == BLOCK_CODES) {
+        write_block(w);
+    }
+}
+
+static void writer_destroy(struct entropy_writer* w)
+{
+    if (w->extras != NULL) {
+        outs_destroy(w->extras);
+    }
+
+    free(w->symbols);
+    free(w->extra_bytes);
+    free(w->coded);
+}
+
+/*
+ * lzw_encode_entropy: Same as lzw_encode(), except that the codes are
+ *                     entropy coded a block at a time instead of being
+ *                     packed at their width.
+ */
+
+bool lzw_encode_entropy(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (start_bits < LZW_MINIMUM_BITS || max_bits > LZW_ENTROPY_MAX_BITS
+            || read_byte == NULL || write_byte == NULL) {
+        return false;
+    }
+
+    struct entropy_writer w;
+
+    w.write_byte = write_byte;
+    w.context = context;
+    w.symbols = malloc(BLOCK_CODES * sizeof(*w.symbols));
+    w.length = 0;
+    w.extras = outs_init(&w, store_extra);
+    w.extra_bytes = malloc(MAX_EXTRAS_LENGTH);
+    w.extras_length = 0;
+    w.coded = malloc(MAX_CODED_LENGTH);
+
+    struct lzw_encoder* enc = (w.symbols != NULL && w.extras != NULL
+                               && w.extra_bytes != NULL && w.coded != NULL) ?
+        encoder_init_sink(start_bits, max_bits, push_code, &w) :
+        NULL;
+
+    if (enc == NULL) {
+        writer_destroy(&w);
+        return false;
+    }
+
+    unsigned char buffer[READ_BLOCK_SIZE];
+    bool success = true;
+    int next = 0;
+
+    while (success && next != EOF) {
+        size_t length = 0;
+
+        while (length < sizeof(buffer)
+                && (next = read_byte(context)) != EOF) {
+            buffer[length++] = next;
+        }
+
+        success = lzw_encoder_write(enc, buffer, length);
+    }
+
+    success = success && lzw_encoder_finish(enc);
+    lzw_encoder_destroy(enc);
+
+    if (success) {
+        // the last partial block, then an empty one to end the stream
+        if (w.length > 0) {
+            write_block(&w);
+        }
+
+        write_varint(&w, 0);
+    }
+
+    writer_destroy(&w);
+    return success;
+}
+
+/*
+ * read_varint: Read a number written by write_varint(). Returns false at
+ *              the end of the input or if the number is too long.
+ */
+
+static bool read_varint(struct entropy_reader* r, size_t* value)
+{
+    *value = 0;
+
+    for (unsigned int shift = 0; shift < 32; shift += 7) {
+        int const c = r->read_byte(r->context);
+
+        if (c == EOF) {
+            return false;
+        }
+
+        *value |= (size_t) (c & 0x7f) << shift;
+
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * read_bytes: Read a length and then that many bytes, which may be no more
+ *             than capacity.
+ */
+
+static bool read_bytes(struct entropy_reader* r, unsigned char* bytes,
+        size_t capacity, size_t* length)
+{
+    if (!read_varint(r, length) || *length > capacity) {
+        return false;
+    }
+
+    for (size_t i = 0; i < *length; ++i) {
+        int const c = r->read_byte(r->context);
+
+        if (c == EOF) {
+            return false;
+        }
+
+        bytes[i] = c;
+    }
+
+    return true;
+}
+
+/*
+ * read_freqs: Read a frequency table and build the slot table from it.
+ *             Returns false unless the frequencies sum to SCALE.
+ */
+
+static bool read_freqs(struct entropy_reader* r)
+{
+    uint32_t sum = 0;
+
+    for (size_t s = 0; s < SYMBOL_COUNT; ++s) {
+        size_t freq;
+
+        if (!read_varint(r, &freq) || freq > SCALE - sum) {
+            return false;
+        }
+
+        r->freqs[s] = freq;
+        r->starts[s] = sum;
+
+        for (size_t i = 0; i < freq; ++i) {
+            r->slots[sum + i] = s;
+        }
+
+        sum += freq;
+
+        if (freq == 0) {
+            int const run = r->read_byte(r->context);
+
+            if (run == EOF || s + run >= SYMBOL_COUNT) {
+                return false;
+            }
+
+            for (int i = 0; i < run; ++i) {
+                ++s;
+                r->freqs[s] = 0;
+                r->starts[s] = sum;
+            }
+        }
+    }
+
+    return sum == SCALE;
+}
+
+/*
+ * read_block: Start on the next block. Returns false at the end of the
+ *             stream, setting success to whether it ended where it should.
+ */
+
+static bool read_block(struct entropy_reader* r)
+{
+    // the state of a finished block returns to where the encoder started
+    if (r->coded_position != r->coded_length || r->state != RANS_LOW) {
+        r->success = false;
+        return false;
+    }
+
+    size_t length;
+
+    if (!read_varint(r, &length) || length > BLOCK_CODES) {
+        r->success = false;
+        return false;
+    }
+
+    if (length == 0) {
+        r->finished = true;
+        return false;
+    }
+
+    if (!read_freqs(r)
+            || !read_bytes(r, r->coded, MAX_CODED_LENGTH, &r->coded_length)
+            || r->coded_length < 4
+            || !read_bytes(r, r->extra_bytes, MAX_EXTRAS_LENGTH,
+                           &r->extras_length)) {
+        r->success = false;
+        return false;
+    }
+
+    r->state = (uint32_t) r->coded[0] << 24 | (uint32_t) r->coded[1] << 16
+        | (uint32_t) r->coded[2] << 8 | r->coded[3];
+    r->coded_position = 4;
+    r->extras_position = 0;
+    r->remaining = length;
+    ins_align(r->extras);
+
+    return true;
+}
+
+/*
+ * load_extra: instream callback that reads the extra bits of a block.
+ */
+
+static int load_extra(void* context)
+{
+    struct entropy_reader* r = context;
+
+    if (r->extras_position == r->extras_length) {
+        return EOF;
+    }
+
+    return r->extra_bytes[r->extras_position++];
+}
+
+/*
+ * pull_code: Decoder source that decodes the next code of the block,
+ *            moving on to the next block as needed. A code too wide for
+ *            the decoder means the stream is corrupt.
+ */
+
+static code_t pull_code(void* source, unsigned int bits)
+{
+    struct entropy_reader* r = source;
+
+    if (r->finished || !r->success
+            || (r->remaining == 0 && !read_block(r))) {
+        return EOF;
+    }
+
+    --r->remaining;
+
+    uint32_t const slot = r->state & (SCALE - 1);
+    unsigned int const symbol = r->slots[slot];
+
+    r->state = r->freqs[symbol] * (r->state >> SCALE_BITS) + slot
+        - r->starts[symbol];
+
+    while (r->state < RANS_LOW && r->coded_position < r->coded_length) {
+        r->state = r->state << 8 | r->coded[r->coded_position++];
+    }
+
+    if (symbol < LZW_CHAR_RANGE) {
+        return symbol;
+    }
+
+    unsigned int const group = symbol - LZW_CHAR_RANGE;
+    unsigned int const extra_bits = (group >> MANTISSA_BITS)
+        + LZW_MINIMUM_BITS - MANTISSA_BITS;
+    int32_t const extra = ins_read_bits(r->extras, extra_bits);
+    code_t const code = ((code_t) ((1 << MANTISSA_BITS)
+                                   | (group & ((1 << MANTISSA_BITS) - 1)))
+                         << extra_bits) | extra;
+
+    if (extra == EOF || (code >> bits) != 0) {
+        r->success = false;
+        return EOF;
+    }
+
+    return code;
+}
+
+static void reader_destroy(struct entropy_reader* r)
+{
+    if (r->extras != NULL) {
+        ins_destroy(r->extras);
+    }
+
+    free(r->slots);
+    free(r->coded);
+    free(r->extra_bytes);
+}
+
+/*
+ * lzw_decode_entropy: Decode the output of lzw_encode_entropy().
+ */
+
+bool lzw_decode_entropy(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (start_bits < LZW_MINIMUM_BITS || max_bits > LZW_ENTROPY_MAX_BITS
+            || read_byte == NULL || write_byte == NULL) {
+        return false;
+    }
+
+    struct entropy_reader* r = malloc(sizeof(*r));
+
+    if (r == NULL) {
+        return false;
+    }
+
+    r->read_byte = read_byte;
+    r->context = context;
+    r->slots = malloc(SCALE * sizeof(*r->slots));
+    r->state = RANS_LOW;
+    r->coded = malloc(MAX_CODED_LENGTH);
+    r->coded_length = 0;
+    r->coded_position = 0;
+    r->extras = ins_init(r, load_extra);
+    r->extra_bytes = malloc(MAX_EXTRAS_LENGTH);
+    r->extras_length = 0;
+    r->extras_position = 0;
+    r->remaining = 0;
+    r->finished = false;
+    r->success = true;
+
+    struct decoder* dec = (r->slots != NULL && r->coded != NULL
+                           && r->extras != NULL && r->extra_bytes != NULL) ?
+        decoder_init_source(start_bits, max_bits, pull_code, r) :
+        NULL;
+
+    if (dec == NULL) {
+        reader_destroy(r);
+        free(r);
+        return false;
+    }
+
+    enum decoder_status status;
+    unsigned char const* string;
+    size_t length;
+
+    while ((status = decoder_next(dec, &string, &length)) == DECODER_OK) {
+        for (size_t i = 0; i < length; ++i) {
+            write_byte(string[i], context);
+        }
+    }
+
+    // the decoder stops at the first missing code, so a stream that ends
+    // early or doesn't end with an empty block is corrupt
+    bool const success = status == DECODER_EOF && r->success && r->finished;
+
+    decoder_destroy(dec);
+    reader_destroy(r);
+    free(r);
+
+    return success;
+}
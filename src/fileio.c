@@ -0,0 +1,314 @@
+#include "fileio.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BLOCK_SIZE (1024 * 1024)
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+#define WRITE_ALIGNMENT 4096
+
+/*
+ * is_std_path: Check if the path refers to the standard stream.
+ */
+
+static bool is_std_path(char const* path)
+{
+    return path == NULL || strcmp(path, "-") == 0;
+}
+
+/*
+ * map_input: Map the whole of a regular file and advise the kernel that it
+ *            will be read sequentially, so it can read ahead aggressively.
+ */
+
+static bool map_input(struct source* src, size_t size)
+{
+    if (size == 0) {
+        // nothing to map, and mmap() rejects empty mappings
+        src->mapped = true;
+        return true;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, src->fd, 0);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+    src->data = map;
+    src->length = size;
+    src->mapped = true;
+
+    return true;
+}
+
+/*
+ * source_open: Open the input, mapping it if it's a regular file.
+ */
+
+bool source_open(struct source* src, char const* path)
+{
+    src->fd = STDIN_FILENO;
+    src->owns_fd = false;
+    src->data = NULL;
+    src->length = 0;
+    src->position = 0;
+    src->mapped = false;
+    src->eof = false;
+    src->ok = true;
+
+    if (!is_std_path(path)) {
+        src->fd = open(path, O_RDONLY);
+        src->owns_fd = true;
+
+        if (src->fd < 0) {
+            return false;
+        }
+    }
+
+    struct stat st;
+
+    if (fstat(src->fd, &st) == 0 && S_ISREG(st.st_mode)
+            && map_input(src, st.st_size)) {
+        return true;
+    }
+
+    // fall back to reading blocks, e.g. from a pipe or terminal
+    src->data = malloc(READ_BLOCK_SIZE);
+
+    if (src->data == NULL) {
+        source_close(src);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * source_close: Unmap or free the input and close its file.
+ *               Returns false if reading failed at any point.
+ */
+
+bool source_close(struct source* src)
+{
+    if (src->mapped) {
+        if (src->data != NULL) {
+            munmap(src->data, src->length);
+        }
+    } else {
+        free(src->data);
+    }
+
+    if (src->owns_fd && src->fd >= 0) {
+        close(src->fd);
+    }
+
+    src->data = NULL;
+    return src->ok;
+}
+
+/*
+ * fill: Read the next block of an unmapped input.
+ */
+
+static bool fill(struct source* src)
+{
+    src->position = 0;
+    src->length = 0;
+
+    while (!src->eof) {
+        ssize_t const n = read(src->fd, src->data, READ_BLOCK_SIZE);
+
+        if (n > 0) {
+            src->length = n;
+            return true;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            src->ok = false;
+        }
+
+        src->eof = true;
+    }
+
+    return false;
+}
+
+/*
+ * source_next_block: Hand out the unread part of the current block.
+ */
+
+size_t source_next_block(struct source* src, unsigned char const** block)
+{
+    if (src->position == src->length && (src->mapped || !fill(src))) {
+        return 0;
+    }
+
+    size_t const length = src->length - src->position;
+
+    *block = src->data + src->position;
+    src->position = src->length;
+
+    return length;
+}
+
+/*
+ * source_read_byte: Return the next input byte, or EOF.
+ */
+
+int source_read_byte(void* context)
+{
+    struct source* src = context;
+
+    if (src->position == src->length && (src->mapped || !fill(src))) {
+        return EOF;
+    }
+
+    return src->data[src->position++];
+}
+
+/*
+ * sink_open: Open the output, truncating it if it's a file.
+ */
+
+bool sink_open(struct sink* snk, char const* path)
+{
+    snk->fd = STDOUT_FILENO;
+    snk->owns_fd = false;
+    snk->stream = NULL;
+    snk->buffer = NULL;
+    snk->length = 0;
+    snk->capacity = WRITE_BUFFER_SIZE;
+    snk->ok = true;
+
+    if (!is_std_path(path)) {
+        snk->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        snk->owns_fd = true;
+
+        if (snk->fd < 0) {
+            return false;
+        }
+    }
+
+    struct stat st;
+
+    if (fstat(snk->fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        snk->stream = is_std_path(path) ? stdout : fdopen(snk->fd, "w");
+
+        if (snk->stream != NULL) {
+            return true;
+        }
+    }
+
+    void* buffer;
+
+    if (posix_memalign(&buffer, WRITE_ALIGNMENT, snk->capacity) != 0) {
+        sink_close(snk);
+        return false;
+    }
+
+    snk->buffer = buffer;
+    return true;
+}
+
+/*
+ * flush_sink: Write out the buffered output, retrying on short writes.
+ */
+
+static void flush_sink(struct sink* snk)
+{
+    unsigned char const* data = snk->buffer;
+    size_t length = snk->length;
+
+    while (snk->ok && length > 0) {
+        ssize_t const n = write(snk->fd, data, length);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            snk->ok = false;
+        } else {
+            data += n;
+            length -= n;
+        }
+    }
+
+    snk->length = 0;
+}
+
+/*
+ * sink_close: Flush and release the output. Returns false if writing failed
+ *             at any point.
+ */
+
+bool sink_close(struct sink* snk)
+{
+    if (snk->stream != NULL) {
+        if (fflush(snk->stream) != 0 || ferror(snk->stream)) {
+            snk->ok = false;
+        }
+
+        if (snk->owns_fd) {
+            fclose(snk->stream);
+            snk->owns_fd = false;
+        }
+    } else if (snk->buffer != NULL) {
+        flush_sink(snk);
+    }
+
+    if (snk->owns_fd && snk->fd >= 0 && close(snk->fd) != 0) {
+        snk->ok = false;
+    }
+
+    free(snk->buffer);
+    snk->buffer = NULL;
+
+    return snk->ok;
+}
+
+/*
+ * sink_flush: Push the buffered output to the file or pipe.
+ */
+
+bool sink_flush(struct sink* snk)
+{
+    if (snk->stream != NULL) {
+        if (fflush(snk->stream) != 0) {
+            snk->ok = false;
+        }
+    } else if (snk->buffer != NULL) {
+        flush_sink(snk);
+    }
+
+    return snk->ok;
+}
+
+/*
+ * sink_write_byte: Buffer a single output byte.
+ */
+
+void sink_write_byte(unsigned char c, void* context)
+{
+    struct sink* snk = context;
+
+    if (snk->stream != NULL) {
+        putc(c, snk->stream);
+        return;
+    }
+
+    snk->buffer[snk->length++] = c;
+
+    if (snk->length == snk->capacity) {
+        flush_sink(snk);
+    }
+}
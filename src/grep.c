@@ -0,0 +1,645 @@
+#include "lzw.h"
+#include "decoder.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+
+/*
+ * The search works on codes rather than bytes, in the manner of Amir,
+ * Benson and Farach: each new table entry is described by a few numbers
+ * derived from its prefix's description and its last byte, and the matcher
+ * moves over a whole code at a time using those numbers and tables built
+ * from the pattern. Only the lines found to contain a match are expanded.
+ */
+
+/*
+ * The pattern and the automata built from it, where m is its length:
+ *  - kmp is the Knuth-Morris-Pratt automaton, (m + 1) states of
+ *      LZW_CHAR_RANGE transitions, where state q means that the last q
+ *      bytes read are the first q of the pattern and state m is a match.
+ *  - cross[q * m + s] says whether a string that starts with exactly the
+ *      last s bytes of the pattern (and no more of them) completes a match
+ *      when read in state q.
+ *  - factors is the suffix automaton, whose states stand for the strings
+ *      that occur in the pattern. Each state's end is where the first
+ *      occurrence of its strings ends, and terminal states are those whose
+ *      strings end the pattern.
+ */
+
+struct pattern {
+    unsigned char const* bytes;
+    size_t length;
+
+    uint16_t* kmp;
+    unsigned char* cross;
+
+    int32_t* factors;
+    uint16_t* ends;
+    bool* terminal;
+};
+
+/*
+ * The description of a code's string:
+ *  - state is where the KMP automaton ends up after reading the string
+ *      from the start
+ *  - head is the most of the pattern's last bytes that the string starts
+ *      with, fewer than the whole pattern
+ *  - factor is the suffix automaton state of the string, or -1 if it
+ *      doesn't occur in the pattern
+ *  - tail is the number of bytes after the last newline, if there is one
+ */
+
+struct code_info {
+    uint32_t tail;
+    int32_t factor;
+    uint16_t state;
+    uint16_t head;
+    bool contains;
+    bool newline;
+};
+
+struct grep {
+    struct pattern pattern;
+    struct decoder* dec;
+
+    struct code_info* codes;
+    size_t capacity;
+
+    // the codes whose strings make up the current line, which starts skip
+    // bytes into the first of them, offset bytes into the output
+    code_t* line;
+    size_t line_length;
+    size_t line_capacity;
+    size_t skip;
+    unsigned long long offset;
+    bool line_hit;
+
+    // the expansion of a line that needs checking
+    unsigned char* text;
+    size_t text_capacity;
+
+    void (*found)(unsigned char const* line, size_t length,
+                  unsigned long long offset, void* context);
+    void* context;
+};
+
+/*
+ * grow: Make room for count elements of the given size in array, returning
+ *       the array, which may have moved, or NULL if allocation fails.
+ */
+
+static void* grow(void* array, size_t* capacity, size_t count, size_t size)
+{
+    if (count <= *capacity) {
+        return array;
+    }
+
+    size_t new_capacity = (*capacity > 0) ? *capacity : 64;
+
+    while (new_capacity < count) {
+        new_capacity *= 2;
+    }
+
+    void* new_array = realloc(array, new_capacity * size);
+
+    if (new_array != NULL) {
+        *capacity = new_capacity;
+    }
+
+    return new_array;
+}
+
+/*
+ * build_kmp: Fill in the KMP automaton, storing each state's failure state,
+ *            the longest proper border of its prefix, in fail.
+ */
+
+static void build_kmp(struct pattern* p, uint16_t* fail)
+{
+    size_t const m = p->length;
+
+    fail[0] = 0;
+
+    for (size_t c = 0; c < LZW_CHAR_RANGE; ++c) {
+        p->kmp[c] = (p->bytes[0] == c) ? 1 : 0;
+    }
+
+    for (size_t q = 1; q <= m; ++q) {
+        fail[q] = (q == 1) ? 0 : p->kmp[fail[q - 1] * LZW_CHAR_RANGE
+                                        + p->bytes[q - 1]];
+
+        for (size_t c = 0; c < LZW_CHAR_RANGE; ++c) {
+            p->kmp[q * LZW_CHAR_RANGE + c] = (q < m && p->bytes[q] == c) ?
+                q + 1 :
+                p->kmp[fail[q] * LZW_CHAR_RANGE + c];
+        }
+    }
+}
+
+/*
+ * build_cross: Fill in the table of matches that cross from the bytes
+ *              already read into the next string. In state q, the last i
+ *              bytes read are the start of the pattern for i = q and each of
+ *              its failure states, so a string that starts with the last
+ *              m - i bytes of the pattern completes a match.
+ */
+
+static bool build_cross(struct pattern* p, uint16_t const* fail)
+{
+    size_t const m = p->length;
+    size_t const side = m + 1;
+
+    // lcp[a * side + b] is the length of the common prefix of the pattern
+    // from a and the pattern from b
+    uint16_t* lcp = malloc(sizeof(*lcp) * side * side);
+
+    if (lcp == NULL) {
+        return false;
+    }
+
+    for (size_t a = side; a-- > 0; ) {
+        for (size_t b = side; b-- > 0; ) {
+            lcp[a * side + b] = (a < m && b < m
+                                 && p->bytes[a] == p->bytes[b]) ?
+                lcp[(a + 1) * side + b + 1] + 1 :
+                0;
+        }
+    }
+
+    for (size_t q = 0; q <= m; ++q) {
+        for (size_t s = 0; s < m; ++s) {
+            unsigned char* const cell = &p->cross[q * m + s];
+
+            if (q == 0) {
+                *cell = false;
+                continue;
+            }
+
+            // the string starts with the last s bytes of the pattern, so
+            // it starts with the last m - q too if those begin them
+            *cell = (q < m && m - q <= s && lcp[q * side + m - s] >= m - q)
+                || p->cross[fail[q] * m + s];
+        }
+    }
+
+    free(lcp);
+    return true;
+}
+
+/*
+ * build_factors: Build the suffix automaton of the pattern, whose missing
+ *                transitions are -1, and mark its terminal states.
+ */
+
+static bool build_factors(struct pattern* p)
+{
+    size_t const max_states = 2 * p->length + 1;
+    int32_t* links = malloc(sizeof(*links) * max_states);
+    uint16_t* lengths = malloc(sizeof(*lengths) * max_states);
+
+    p->factors = malloc(sizeof(*p->factors) * max_states * LZW_CHAR_RANGE);
+    p->ends = malloc(sizeof(*p->ends) * max_states);
+    p->terminal = calloc(max_states, sizeof(*p->terminal));
+
+    if (links == NULL || lengths == NULL || p->factors == NULL
+            || p->ends == NULL || p->terminal == NULL) {
+        free(links);
+        free(lengths);
+        return false;
+    }
+
+    int32_t* const next = p->factors;
+    size_t count = 1;
+    int32_t last = 0;
+
+    memset(next, -1, sizeof(*next) * LZW_CHAR_RANGE);
+    links[0] = -1;
+    lengths[0] = 0;
+    p->ends[0] = 0;
+
+    for (size_t i = 0; i < p->length; ++i) {
+        unsigned char const c = p->bytes[i];
+        int32_t const cur = count++;
+        int32_t state = last;
+
+        memset(&next[cur * LZW_CHAR_RANGE], -1,
+               sizeof(*next) * LZW_CHAR_RANGE);
+        lengths[cur] = lengths[last] + 1;
+        p->ends[cur] = i;
+
+        while (state >= 0 && next[state * LZW_CHAR_RANGE + c] < 0) {
+            next[state * LZW_CHAR_RANGE + c] = cur;
+            state = links[state];
+        }
+
+        if (state < 0) {
+            links[cur] = 0;
+        } else {
+            int32_t const q = next[state * LZW_CHAR_RANGE + c];
+
+            if (lengths[state] + 1 == lengths[q]) {
+                links[cur] = q;
+            } else {
+                int32_t const clone = count++;
+
+                memcpy(&next[clone * LZW_CHAR_RANGE],
+                       &next[q * LZW_CHAR_RANGE],
+                       sizeof(*next) * LZW_CHAR_RANGE);
+                lengths[clone] = lengths[state] + 1;
+                links[clone] = links[q];
+                p->ends[clone] = p->ends[q];
+
+                while (state >= 0 && next[state * LZW_CHAR_RANGE + c] == q) {
+                    next[state * LZW_CHAR_RANGE + c] = clone;
+                    state = links[state];
+                }
+
+                links[q] = clone;
+                links[cur] = clone;
+            }
+        }
+
+        last = cur;
+    }
+
+    for (int32_t state = last; state > 0; state = links[state]) {
+        p->terminal[state] = true;
+    }
+
+    free(links);
+    free(lengths);
+    return true;
+}
+
+static void pattern_destroy(struct pattern* p)
+{
+    free(p->kmp);
+    free(p->cross);
+    free(p->factors);
+    free(p->ends);
+    free(p->terminal);
+}
+
+/*
+ * pattern_init: Build the automata for a pattern, which is used in place.
+ */
+
+static bool pattern_init(struct pattern* p, unsigned char const* bytes,
+        size_t length)
+{
+    size_t const m = length;
+
+    p->bytes = bytes;
+    p->length = m;
+    p->kmp = malloc(sizeof(*p->kmp) * (m + 1) * LZW_CHAR_RANGE);
+    p->cross = malloc((m + 1) * m);
+    p->factors = NULL;
+    p->ends = NULL;
+    p->terminal = NULL;
+
+    uint16_t* fail = malloc(sizeof(*fail) * (m + 1));
+    bool success = p->kmp != NULL && p->cross != NULL && fail != NULL;
+
+    if (success) {
+        build_kmp(p, fail);
+        success = build_cross(p, fail) && build_factors(p);
+    }
+
+    free(fail);
+
+    if (!success) {
+        pattern_destroy(p);
+    }
+
+    return success;
+}
+
+/*
+ * pattern_found: Check whether the pattern occurs in the given bytes.
+ */
+
+static bool pattern_found(struct pattern const* p,
+        unsigned char const* bytes, size_t length)
+{
+    size_t state = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        state = p->kmp[state * LZW_CHAR_RANGE + bytes[i]];
+
+        if (state == p->length) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * describe_byte: Describe the string of one of the first LZW_CHAR_RANGE
+ *                codes.
+ */
+
+static void describe_byte(struct pattern const* p, struct code_info* info,
+        unsigned char c)
+{
+    size_t const m = p->length;
+
+    info->state = p->kmp[c];
+    info->contains = info->state == m;
+    info->factor = p->factors[c];
+    info->head = (m > 1 && p->bytes[m - 1] == c) ? 1 : 0;
+    info->newline = c == '\n';
+    info->tail = 0;
+}
+
+/*
+ * describe: Describe the string of a new entry, length bytes long, from
+ *           the description of its prefix and its last byte.
+ */
+
+static void describe(struct pattern const* p, struct code_info* info,
+        struct code_info const* prefix, unsigned char c, size_t length)
+{
+    size_t const m = p->length;
+
+    info->state = p->kmp[prefix->state * LZW_CHAR_RANGE + c];
+    info->contains = prefix->contains || info->state == m;
+    info->factor = (prefix->factor >= 0) ?
+        p->factors[prefix->factor * LZW_CHAR_RANGE + c] :
+        -1;
+
+    // the string starts with what its prefix does, unless it's the end of
+    // the pattern itself
+    info->head = (info->factor >= 0 && p->terminal[info->factor]
+                  && length < m) ?
+        length :
+        prefix->head;
+
+    info->newline = prefix->newline || c == '\n';
+    info->tail = (c == '\n') ? 0 : prefix->tail + 1;
+}
+
+/*
+ * step: Move the KMP automaton from *state over the string of a code,
+ *       length bytes long. Returns true if a match ends within it.
+ */
+
+static bool step(struct pattern const* p, struct code_info const* info,
+        size_t length, size_t* state)
+{
+    size_t q = *state;
+
+    if (q == 0) {
+        *state = info->state;
+        return info->contains;
+    }
+
+    // a string that occurs in the pattern is short enough to read a byte
+    // at a time, from the pattern itself
+    if (info->factor >= 0) {
+        unsigned char const* bytes = p->bytes + p->ends[info->factor] + 1
+            - length;
+        bool hit = false;
+
+        for (size_t i = 0; i < length; ++i) {
+            q = p->kmp[q * LZW_CHAR_RANGE + bytes[i]];
+            hit = hit || q == p->length;
+        }
+
+        *state = q;
+        return hit;
+    }
+
+    // otherwise, the bytes already read can't be the start of a longer end
+    // of a match than the string alone
+    *state = info->state;
+    return info->contains || p->cross[q * p->length + info->head];
+}
+
+/*
+ * report: Check the expanded lines, the first starting offset bytes into
+ *         the output, and report those that contain the pattern. The rest
+ *         after the last newline is a line that isn't finished unless
+ *         finished is set; whether it holds a match so far is returned.
+ */
+
+static bool report(struct grep* g, unsigned char const* text, size_t length,
+        unsigned long long offset, bool finished)
+{
+    size_t start = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] != '\n') {
+            continue;
+        }
+
+        if (pattern_found(&g->pattern, text + start, i - start)) {
+            (g->found)(text + start, i - start, offset + start, g->context);
+        }
+
+        start = i + 1;
+    }
+
+    bool const hit = pattern_found(&g->pattern, text + start, length - start);
+
+    if (hit && finished) {
+        (g->found)(text + start, length - start, offset + start, g->context);
+    }
+
+    return hit;
+}
+
+/*
+ * expand_line: Expand the codes of the current line into the text buffer,
+ *              returning the length, or -1 if allocation fails.
+ */
+
+static long long expand_line(struct grep* g)
+{
+    size_t length = 0;
+
+    for (size_t i = 0; i < g->line_length; ++i) {
+        unsigned char const* string;
+        size_t n;
+
+        if (!decoder_expand(g->dec, g->line[i], &string, &n)) {
+            return -1;
+        }
+
+        unsigned char* text = grow(g->text, &g->text_capacity, length + n,
+                                   sizeof(*text));
+
+        if (text == NULL) {
+            return -1;
+        }
+
+        g->text = text;
+
+        memcpy(g->text + length, string, n);
+        length += n;
+    }
+
+    return length;
+}
+
+/*
+ * check_line: Expand and report the current line, which ends with the code
+ *             just added to it unless finished is set.
+ */
+
+static bool check_line(struct grep* g, bool finished)
+{
+    long long const length = expand_line(g);
+
+    if (length < 0) {
+        return false;
+    }
+
+    g->line_hit = report(g, g->text + g->skip, length - g->skip, g->offset,
+                         finished);
+    return true;
+}
+
+/*
+ * add_code: Move the search over the string of a code, length bytes long,
+ *           which starts at the given offset in the output.
+ */
+
+static bool add_code(struct grep* g, code_t code, size_t length,
+        unsigned long long offset, size_t* state)
+{
+    struct code_info const* info = &g->codes[code];
+    bool const hit = step(&g->pattern, info, length, state);
+
+    code_t* line = grow(g->line, &g->line_capacity, g->line_length + 1,
+                        sizeof(*line));
+
+    if (line == NULL) {
+        return false;
+    }
+
+    g->line = line;
+    g->line[g->line_length++] = code;
+    g->line_hit = g->line_hit || hit;
+
+    if (!info->newline) {
+        return true;
+    }
+
+    // the code finishes the line, and starts another after its last newline
+    if (g->line_hit && !check_line(g, false)) {
+        return false;
+    }
+
+    g->line[0] = code;
+    g->line_length = 1;
+    g->skip = length - info->tail;
+    g->offset = offset + g->skip;
+
+    return true;
+}
+
+/*
+ * search: Read every code, describing each new entry, and look for the
+ *         pattern.
+ */
+
+static bool search(struct grep* g)
+{
+    unsigned long long offset = 0;
+    size_t state = 0;
+    enum decoder_status status;
+    code_t code;
+    code_t added;
+
+    while ((status = decoder_next_code(g->dec, &code, &added)) == DECODER_OK) {
+        code_t prefix;
+        unsigned char c;
+        size_t length;
+
+        if (added >= 0) {
+            struct code_info* codes = grow(g->codes, &g->capacity,
+                                           (size_t) added + 1,
+                                           sizeof(*codes));
+
+            if (codes == NULL) {
+                return false;
+            }
+
+            g->codes = codes;
+            decoder_entry(g->dec, added, &prefix, &c, &length);
+            describe(&g->pattern, &g->codes[added], &g->codes[prefix], c,
+                     length);
+        }
+
+        decoder_entry(g->dec, code, &prefix, &c, &length);
+
+        if (!add_code(g, code, length, offset, &state)) {
+            return false;
+        }
+
+        offset += length;
+    }
+
+    if (status != DECODER_EOF) {
+        return false;
+    }
+
+    return !g->line_hit || check_line(g, true);
+}
+
+/*
+ * lzw_grep: Find the lines of the compressed data that contain the
+ *           pattern.
+ */
+
+bool lzw_grep(unsigned int start_bits, unsigned int max_bits,
+        unsigned char const* pattern, size_t pattern_length,
+        int (*read_byte)(void* context),
+        void (*found)(unsigned char const* line, size_t length,
+                      unsigned long long offset, void* context),
+        void* context)
+{
+    if (start_bits < LZW_MINIMUM_BITS || max_bits > LZW_MAXIMUM_BITS
+            || read_byte == NULL || found == NULL || pattern_length == 0
+            || pattern_length > LZW_GREP_MAX_PATTERN
+            || memchr(pattern, '\n', pattern_length) != NULL) {
+        return false;
+    }
+
+    struct grep g;
+    memset(&g, 0, sizeof(g));
+
+    g.found = found;
+    g.context = context;
+
+    if (!pattern_init(&g.pattern, pattern, pattern_length)) {
+        return false;
+    }
+
+    g.dec = decoder_init(start_bits, max_bits, read_byte, context);
+    g.codes = grow(NULL, &g.capacity, LZW_CHAR_RANGE, sizeof(*g.codes));
+
+    bool success = g.dec != NULL && g.codes != NULL;
+
+    if (success) {
+        for (size_t c = 0; c < LZW_CHAR_RANGE; ++c) {
+            describe_byte(&g.pattern, &g.codes[c], c);
+        }
+
+        success = search(&g);
+    }
+
+    decoder_destroy(g.dec);
+    pattern_destroy(&g.pattern);
+    free(g.codes);
+    free(g.line);
+    free(g.text);
+
+    return success;
+}
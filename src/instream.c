@@ -12,8 +12,11 @@ struct instream {
     int (*read)(void*);
     void* context;
 
-    uint32_t buffer;
+    // a read of 32 bits can start after up to 7 left over from the last one
+    uint64_t buffer;
     size_t bufsize;
+
+    unsigned long long read_count;
 };
 
 /*
@@ -34,6 +37,7 @@ struct instream* ins_init(void* context,
 
     ins->buffer = 0;
     ins->bufsize = 0;
+    ins->read_count = 0;
 
     return ins;
 }
@@ -72,7 +76,7 @@ static void add_to_buffer(struct instream* ins, unsigned char bits,
 
     // extract the bits to be added and zero out the unused bits
     size_t const unused_bit_count = CHAR_BIT - bit_count;
-    uint32_t const used_bits = bits & (UINT32_MAX << unused_bit_count);
+    uint64_t const used_bits = bits & (UINT64_MAX << unused_bit_count);
 
     // find out if the used bits need to be shifted, and in what direction
     if (unused_buffer_space == bit_count) {
@@ -92,7 +96,7 @@ static void add_to_buffer(struct instream* ins, unsigned char bits,
  *               and returns the data. Returns EOF otherwise.
  */
 
-static int32_t flush_buffer(struct instream* ins, size_t bit_count)
+static int64_t flush_buffer(struct instream* ins, size_t bit_count)
 {
     if (ins->bufsize < bit_count) {
         return EOF;
@@ -104,15 +108,15 @@ static int32_t flush_buffer(struct instream* ins, size_t bit_count)
 
     // extract the important bits from the buffer via masking,
     // then right-align them before returning.
-    uint32_t const mask = UINT32_MAX << (BITS_IN(ins->buffer) - bits_needed);
+    uint64_t const mask = UINT64_MAX << (BITS_IN(ins->buffer) - bits_needed);
     size_t const align_distance = BITS_IN(ins->buffer) - bits_needed;
-    uint32_t result = (ins->buffer & mask) >> align_distance;
+    uint64_t result = (ins->buffer & mask) >> align_distance;
 
     // update the buffer info to reflect the flush
     ins->buffer <<= bits_needed;
     ins->bufsize -= bits_needed;
 
-    return (int32_t) result;
+    return (int64_t) result;
 }
 
 /*
@@ -121,10 +125,11 @@ static int32_t flush_buffer(struct instream* ins, size_t bit_count)
  *                the internal buffer, returns EOF.
  */
 
-int32_t ins_read_bits(struct instream* ins, size_t bit_count)
+int64_t ins_read_bits(struct instream* ins, size_t bit_count)
 {
-    if (bit_count > BITS_IN(ins->buffer)) {
-        // too many bits requested
+    if (bit_count > BITS_IN(ins->buffer) - (CHAR_BIT - 1)) {
+        // too many bits requested, since a whole byte has to fit on top
+        // of the bits left over
         return EOF;
     } else if (ins->bufsize >= bit_count) {
         // no need to read from the stream; take what's needed from buffer.
@@ -135,7 +140,7 @@ int32_t ins_read_bits(struct instream* ins, size_t bit_count)
     // the number of bits to obtain from the input stream
     unsigned int const bits_needed = bit_count - ins->bufsize;
 
-    int32_t result;
+    int64_t result;
     int const next = (ins->read)(ins->context);
     unsigned char const next_byte = next;
 
@@ -147,6 +152,8 @@ int32_t ins_read_bits(struct instream* ins, size_t bit_count)
         return EOF;
     }
 
+    ++ins->read_count;
+
     if (bits_needed == CHAR_BIT) {
         add_to_buffer(ins, next_byte, CHAR_BIT);
         result = flush_buffer(ins, bit_count);
@@ -167,3 +174,82 @@ int32_t ins_read_bits(struct instream* ins, size_t bit_count)
 
     return result;
 }
+
+/*
+ * ins_align: Drop whatever is left in the buffer. Bytes are only read as
+ *            they're needed, so the buffer never holds a whole unread byte.
+ */
+
+void ins_align(struct instream* ins)
+{
+    ins->buffer = 0;
+    ins->bufsize = 0;
+}
+
+/*
+ * ins_get_pending: Get the contents of the buffer.
+ */
+
+unsigned char ins_get_pending(struct instream const* ins, size_t* bit_count)
+{
+    *bit_count = ins->bufsize;
+    return ins->buffer >> (BITS_IN(ins->buffer) - CHAR_BIT);
+}
+
+/*
+ * ins_set_pending: Replace the contents of the buffer, clearing the bits
+ *                  past bit_count.
+ */
+
+void ins_set_pending(struct instream* ins, unsigned char bits,
+        size_t bit_count)
+{
+    if (bit_count >= CHAR_BIT) {
+        // a whole byte is never left unread
+        return;
+    }
+
+    unsigned char const used_bits = bits & ~(UCHAR_MAX >> bit_count);
+
+    ins->buffer = (uint64_t) used_bits << (BITS_IN(ins->buffer) - CHAR_BIT);
+    ins->bufsize = bit_count;
+}
+
+/*
+ * ins_read_phased: Read the bits a short code would have, then one more if
+ *                  they turn out to start a long one.
+ */
+
+int64_t ins_read_phased(struct instream* ins, uint64_t range,
+        size_t bit_count)
+{
+    size_t const width = phased_width(range, bit_count);
+    uint64_t const short_count = ((uint64_t) 1 << width) - range;
+
+    if (short_count == 0) {
+        return ins_read_bits(ins, width);
+    }
+
+    int64_t const high = ins_read_bits(ins, width - 1);
+
+    if (high == EOF || (uint64_t) high < short_count) {
+        return high;
+    }
+
+    int64_t const low = ins_read_bits(ins, 1);
+
+    if (low == EOF) {
+        return EOF;
+    }
+
+    return ((high << 1) | low) - (int64_t) short_count;
+}
+
+/*
+ * ins_bytes_read: Get the number of bytes taken from read_bits so far.
+ */
+
+unsigned long long ins_bytes_read(struct instream const* ins)
+{
+    return ins->read_count;
+}
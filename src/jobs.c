@@ -0,0 +1,322 @@
+#include "jobs.h"
+#include "fileio.h"
+#include "lzw.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The work shared by every worker. Files are handed out in order through
+ * next, which the workers advance atomically.
+ */
+
+struct job_pool {
+    char* const* paths;
+    size_t path_count;
+    size_t next;
+
+    bool decode;
+    unsigned int start_bits;
+    unsigned int max_bits;
+};
+
+/*
+ * A worker thread, along with the coder it keeps between files and its
+ * share of the totals.
+ */
+
+struct worker {
+    struct job_pool* pool;
+    pthread_t thread;
+
+    struct source in;
+    struct sink out;
+    struct lzw_encoder* enc;
+
+    size_t files;
+    size_t failures;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+};
+
+/*
+ * count_read: Read a byte of the current input, counting it.
+ */
+
+static int count_read(void* ctx)
+{
+    struct worker* w = ctx;
+    int const c = source_read_byte(&w->in);
+
+    if (c != EOF) {
+        ++w->bytes_in;
+    }
+
+    return c;
+}
+
+/*
+ * count_write: Write a byte to the current output, counting it.
+ */
+
+static void count_write(unsigned char c, void* ctx)
+{
+    struct worker* w = ctx;
+
+    ++w->bytes_out;
+    sink_write_byte(c, &w->out);
+}
+
+/*
+ * output_path: Get the name of the file to write the given input to, or
+ *              NULL if a decoder input doesn't have the expected suffix or
+ *              allocation fails. The result must be freed.
+ */
+
+static char* output_path(char const* path, bool decode)
+{
+    size_t const length = strlen(path);
+    size_t const suffix_length = strlen(JOBS_SUFFIX);
+
+    if (decode) {
+        if (length <= suffix_length
+                || strcmp(path + length - suffix_length, JOBS_SUFFIX) != 0) {
+            return NULL;
+        }
+
+        char* out_path = malloc(length - suffix_length + 1);
+
+        if (out_path != NULL) {
+            memcpy(out_path, path, length - suffix_length);
+            out_path[length - suffix_length] = '\0';
+        }
+
+        return out_path;
+    }
+
+    char* out_path = malloc(length + suffix_length + 1);
+
+    if (out_path != NULL) {
+        memcpy(out_path, path, length);
+        memcpy(out_path + length, JOBS_SUFFIX, suffix_length + 1);
+    }
+
+    return out_path;
+}
+
+/*
+ * encode_file: Encode the current input with the worker's encoder.
+ */
+
+static bool encode_file(struct worker* w)
+{
+    if (!lzw_encoder_reset(w->enc)) {
+        return false;
+    }
+
+    unsigned char const* block;
+    size_t length;
+    bool success = true;
+
+    while (success && (length = source_next_block(&w->in, &block)) > 0) {
+        w->bytes_in += length;
+        success = lzw_encoder_write(w->enc, block, length);
+    }
+
+    return lzw_encoder_finish(w->enc) && success;
+}
+
+/*
+ * code_file: Open a file and its output and code it, reporting any errors.
+ */
+
+static bool code_file(struct worker* w, char const* path)
+{
+    bool const decode = w->pool->decode;
+    char* out_path = output_path(path, decode);
+
+    if (out_path == NULL) {
+        fprintf(stderr, "%s: %s\n", path, decode ?
+                "missing " JOBS_SUFFIX " suffix" :
+                "out of memory");
+        return false;
+    }
+
+    if (!source_open(&w->in, path)) {
+        perror(path);
+        free(out_path);
+        return false;
+    }
+
+    if (!sink_open(&w->out, out_path)) {
+        perror(out_path);
+        source_close(&w->in);
+        free(out_path);
+        return false;
+    }
+
+    bool success = decode ?
+        lzw_decode(w->pool->start_bits, w->pool->max_bits,
+                   count_read, count_write, w) :
+        encode_file(w);
+
+    success = source_close(&w->in) && success;
+    success = sink_close(&w->out) && success;
+
+    if (!success) {
+        fprintf(stderr, "%s: failed to %s\n", path,
+                decode ? "decode" : "encode");
+    }
+
+    free(out_path);
+    return success;
+}
+
+/*
+ * run_worker: Body of a worker thread: take files from the pool until none
+ *             are left.
+ */
+
+static void* run_worker(void* arg)
+{
+    struct worker* w = arg;
+    struct job_pool* pool = w->pool;
+
+    while (true) {
+        size_t const i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+
+        if (i >= pool->path_count) {
+            break;
+        }
+
+        ++w->files;
+
+        if (!code_file(w, pool->paths[i])) {
+            ++w->failures;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * seconds_since: Get the time elapsed since start.
+ */
+
+static double seconds_since(struct timespec const* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec)
+        + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * report: Print the totals of every worker. Throughput is measured on the
+ *         uncompressed side in both directions.
+ */
+
+static void report(struct worker const* workers, size_t worker_count,
+        bool decode, double seconds)
+{
+    size_t files = 0;
+    size_t failures = 0;
+    unsigned long long bytes_in = 0;
+    unsigned long long bytes_out = 0;
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        files += workers[i].files;
+        failures += workers[i].failures;
+        bytes_in += workers[i].bytes_in;
+        bytes_out += workers[i].bytes_out;
+    }
+
+    double const mb_in = bytes_in / 1e6;
+    double const mb_out = bytes_out / 1e6;
+    double const mb_plain = decode ? mb_out : mb_in;
+
+    fprintf(stderr, "%zu files (%zu failed) on %zu threads: "
+            "%.1f MB in, %.1f MB out in %.2f s (%.1f MB/s)\n",
+            files, failures, worker_count, mb_in, mb_out, seconds,
+            (seconds > 0) ? mb_plain / seconds : 0.0);
+}
+
+/*
+ * jobs_run: Start the workers, wait for them and report.
+ */
+
+bool jobs_run(char* const* paths, size_t path_count, unsigned int worker_count,
+        bool decode, unsigned int start_bits, unsigned int max_bits)
+{
+    if (worker_count == 0) {
+        return false;
+    }
+
+    if (worker_count > path_count) {
+        worker_count = (path_count > 0) ? path_count : 1;
+    }
+
+    struct job_pool pool = {
+        .paths = paths,
+        .path_count = path_count,
+        .next = 0,
+        .decode = decode,
+        .start_bits = start_bits,
+        .max_bits = max_bits
+    };
+
+    struct worker* workers = calloc(worker_count, sizeof(*workers));
+
+    if (workers == NULL) {
+        return false;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    bool success = true;
+    size_t started = 0;
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        struct worker* const w = &workers[i];
+
+        w->pool = &pool;
+
+        if (!decode) {
+            w->enc = lzw_encoder_init(start_bits, max_bits, count_write, w);
+
+            if (w->enc == NULL) {
+                success = false;
+                break;
+            }
+        }
+
+        if (pthread_create(&w->thread, NULL, run_worker, w) != 0) {
+            lzw_encoder_destroy(w->enc);
+            success = false;
+            break;
+        }
+
+        ++started;
+    }
+
+    // the workers that did start still finish every file between them
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        lzw_encoder_destroy(workers[i].enc);
+
+        success = success && workers[i].failures == 0;
+    }
+
+    success = success && started > 0;
+    report(workers, started, decode, seconds_since(&start));
+    free(workers);
+
+    return success;
+}
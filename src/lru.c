@@ -0,0 +1,229 @@
+#include "lru.h"
+#include "table.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string.h>
+
+/*
+ * The state of a single code. older and newer link the entries from the
+ * least to the most recently used, with -1 at either end.
+ */
+
+struct lru_node {
+    code_t older;
+    code_t newer;
+    code_t prefix;
+    uint16_t children;
+    unsigned char c;
+};
+
+struct lru {
+    // indexed by code, including the single bytes, which are never linked
+    struct lru_node* nodes;
+    size_t capacity;
+
+    code_t oldest;
+    code_t newest;
+    size_t count;
+
+    unsigned long long allocated;
+};
+
+/*
+ * lru_init: Initialize an empty order. The arrays grow as codes are added.
+ */
+
+struct lru* lru_init(void)
+{
+    struct lru* lru = malloc(sizeof(*lru));
+
+    if (lru == NULL) {
+        return NULL;
+    }
+
+    lru->capacity = 2 * LZW_CHAR_RANGE;
+    lru->nodes = table_alloc(sizeof(*lru->nodes) * lru->capacity);
+    lru->allocated = sizeof(*lru->nodes) * lru->capacity;
+    lru->oldest = -1;
+    lru->newest = -1;
+    lru->count = 0;
+
+    if (lru->nodes == NULL) {
+        free(lru);
+        return NULL;
+    }
+
+    memset(lru->nodes, 0, sizeof(*lru->nodes) * lru->capacity);
+
+    return lru;
+}
+
+/*
+ * lru_destroy: Free the structure allocated by lru_init().
+ */
+
+void lru_destroy(struct lru* lru)
+{
+    if (lru == NULL) {
+        return;
+    }
+
+    table_free(lru->nodes, sizeof(*lru->nodes) * lru->capacity);
+    free(lru);
+}
+
+/*
+ * lru_clear: Empty the list. Only the single bytes' child counts outlive
+ *            their entries, so they're the only ones to reset.
+ */
+
+void lru_clear(struct lru* lru)
+{
+    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
+        lru->nodes[i].children = 0;
+    }
+
+    lru->oldest = -1;
+    lru->newest = -1;
+    lru->count = 0;
+}
+
+/*
+ * lru_memory: Get the size of the arrays and the total size allocated.
+ */
+
+size_t lru_memory(struct lru const* lru, unsigned long long* allocated)
+{
+    *allocated = lru->allocated + sizeof(*lru);
+
+    return sizeof(*lru) + sizeof(*lru->nodes) * lru->capacity;
+}
+
+/*
+ * unlink_node: Take a code off the list.
+ */
+
+static void unlink_node(struct lru* lru, code_t code)
+{
+    struct lru_node* const node = &lru->nodes[code];
+
+    if (node->older >= 0) {
+        lru->nodes[node->older].newer = node->newer;
+    } else {
+        lru->oldest = node->newer;
+    }
+
+    if (node->newer >= 0) {
+        lru->nodes[node->newer].older = node->older;
+    } else {
+        lru->newest = node->older;
+    }
+}
+
+/*
+ * link_newest: Put a code at the most recently used end of the list.
+ */
+
+static void link_newest(struct lru* lru, code_t code)
+{
+    struct lru_node* const node = &lru->nodes[code];
+
+    node->older = lru->newest;
+    node->newer = -1;
+
+    if (lru->newest >= 0) {
+        lru->nodes[lru->newest].newer = code;
+    } else {
+        lru->oldest = code;
+    }
+
+    lru->newest = code;
+}
+
+/*
+ * lru_add: Link the new entry in as the newest and count it as a child of
+ *          its prefix.
+ */
+
+bool lru_add(struct lru* lru, code_t code, code_t prefix, unsigned char c)
+{
+    if ((size_t) code >= lru->capacity) {
+        size_t new_capacity = lru->capacity;
+
+        while (new_capacity <= (size_t) code) {
+            new_capacity *= 2;
+        }
+
+        struct lru_node* new_nodes = table_resize(lru->nodes,
+            sizeof(*new_nodes) * lru->capacity,
+            sizeof(*new_nodes) * new_capacity);
+
+        if (new_nodes == NULL) {
+            return false;
+        }
+
+        lru->nodes = new_nodes;
+        lru->capacity = new_capacity;
+        lru->allocated += sizeof(*new_nodes) * new_capacity;
+    }
+
+    struct lru_node* const node = &lru->nodes[code];
+
+    node->prefix = prefix;
+    node->c = c;
+    node->children = 0;
+    ++lru->nodes[prefix].children;
+
+    link_newest(lru, code);
+    ++lru->count;
+
+    return true;
+}
+
+/*
+ * lru_touch: Move an entry to the most recently used end.
+ */
+
+void lru_touch(struct lru* lru, code_t code)
+{
+    if (code < LZW_CHAR_RANGE || code == lru->newest) {
+        return;
+    }
+
+    unlink_node(lru, code);
+    link_newest(lru, code);
+}
+
+/*
+ * lru_evict: Walk from the least recently used end to the first leaf
+ *            other than keep, giving every entry passed over another
+ *            round. Each entry is looked at once at most, so a table with
+ *            no such leaf is left in the same order it was found in.
+ */
+
+code_t lru_evict(struct lru* lru, code_t keep, code_t* prefix,
+        unsigned char* c)
+{
+    for (size_t i = 0; i < lru->count; ++i) {
+        code_t const code = lru->oldest;
+        struct lru_node const* const node = &lru->nodes[code];
+
+        unlink_node(lru, code);
+
+        if (node->children == 0 && code != keep) {
+            --lru->nodes[node->prefix].children;
+            --lru->count;
+
+            *prefix = node->prefix;
+            *c = node->c;
+
+            return code;
+        }
+
+        link_newest(lru, code);
+    }
+
+    return -1;
+}
@@ -1,16 +1,13 @@
 #include "lzw.h"
-#include "trie.h"
+#include "decoder.h"
 
-#include "lzwcontext.h"
 #include "config.h"
 
 #include <stdbool.h>
-#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#include <limits.h>
-#include <string.h>
+#define ENCODE_BLOCK_SIZE 4096
 
 /*
  * verify_params: Ensure that the given parameters are valid.
@@ -27,42 +24,42 @@ static bool verify_params(unsigned int start_bits, unsigned int max_bits,
 }
 
 /*
- * create_trie: Initialize the trie to be used in the LZW compression algorithm.
+ * encode_all: Feed the encoder everything read via read_byte, then finish
+ *             and destroy it, first filling in stats if given.
  */
 
-static struct trie* create_trie(void)
+static bool encode_all(struct lzw_encoder* enc, int (*read_byte)(void*),
+        void* stream_ctx, struct lzw_stats* stats)
 {
-    struct trie* trie = trie_init(-1);
+    if (enc == NULL) {
+        return false;
+    }
 
-    // set every child to hold its index's corresponding character value
-    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
-        char key = (char) i;
+    // read the input in blocks so the encoder can work on runs of bytes
+    unsigned char buffer[ENCODE_BLOCK_SIZE];
+    bool success = true;
+    int next = 0;
 
-        if (!trie_insert(trie, &key, 1, i)) {
-            trie_destroy(trie);
-            return NULL;
-        }
-    }
+    while (success && next != EOF) {
+        size_t length = 0;
 
-    return trie;
-}
+        while (length < sizeof(buffer)
+                && (next = read_byte(stream_ctx)) != EOF) {
+            buffer[length++] = next;
+        }
 
-/*
- * write_char_code: Looks up the string (i.e., sequence) in the trie and
- *                  writes its code if found. Returns false if not found.
- */
+        success = lzw_encoder_write(enc, buffer, length);
+    }
 
-static bool write_char_code(struct lzwcontext* ctx, struct trie* trie,
-        unsigned int cur_bits, char const* str, size_t length)
-{
-    code_t* code = trie_lookup(trie, str, length);
+    success = success && lzw_encoder_finish(enc);
 
-    if (code == NULL) {
-        return false;
+    if (stats != NULL) {
+        lzw_encoder_stats(enc, stats);
     }
 
-    outs_write_bits(ctx->outs, *code, cur_bits);
-    return true;
+    lzw_encoder_destroy(enc);
+
+    return success;
 }
 
 /*
@@ -81,144 +78,174 @@ bool lzw_encode(unsigned int start_bits, unsigned int max_bits,
         return false;
     }
 
-    size_t const init_seq_size = 1;
-    struct lzwcontext* ctx = ctx_init(init_seq_size, stream_ctx,
-                                      read_byte, write_byte);
-    struct trie* trie = create_trie();
+    return encode_all(lzw_encoder_init(start_bits, max_bits, write_byte,
+                                       stream_ctx),
+                      read_byte, stream_ctx, NULL);
+}
 
-    if (ctx == NULL || trie == NULL) {
-        ctx_destroy(ctx);
-        trie_destroy(trie);
+/*
+ * lzw_encode_stats: Same as lzw_encode(), filling in stats at the end.
+ */
 
+bool lzw_encode_stats(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* stream_ctx, struct lzw_stats* stats)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
         return false;
     }
 
-    int next;
-    code_t next_code = LZW_CHAR_RANGE;
-
-    char* cur_str = NULL;
-    unsigned int cur_bits = start_bits;
-
-    while ((next = ins_read_bits(ctx->ins, CHAR_BIT)) != EOF) {
-        seq_push(ctx->seq, next);
-        cur_str = seq_to_cstr(ctx->seq);
+    return encode_all(lzw_encoder_init(start_bits, max_bits, write_byte,
+                                       stream_ctx),
+                      read_byte, stream_ctx, stats);
+}
 
-        // if sequence isn't found, write everything but the last character and
-        // assign the full sequence a new character code if possible
-        if (!trie_contains(trie, cur_str, seq_length(ctx->seq))) {
-            size_t const prefix_len = seq_length(ctx->seq) - 1;
+/*
+ * lzw_encode_phased: Same as lzw_encode(), writing phase-in codes.
+ */
 
-            if (!write_char_code(ctx, trie, cur_bits, cur_str, prefix_len)) {
-                return false;
-            }
+bool lzw_encode_phased(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* stream_ctx)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
+    }
 
-            int32_t const current_code_max = (1 << cur_bits) - 1;
-            bool code_needs_expand = next_code >= current_code_max;
-            bool code_can_expand = cur_bits < max_bits;
+    struct lzw_encoder* enc = lzw_encoder_init(start_bits, max_bits,
+                                               write_byte, stream_ctx);
 
-            if (!code_needs_expand || code_can_expand) {
-                if (code_needs_expand) {
-                    ++cur_bits;
-                }
+    // a new encoder can always switch
+    if (enc != NULL) {
+        lzw_encoder_enable_phase_in(enc);
+    }
 
-                // add the full sequence to the trie and move to the next code
-                trie_insert(trie, cur_str, seq_length(ctx->seq), next_code);
-                ++next_code;
-            }
+    return encode_all(enc, read_byte, stream_ctx, NULL);
+}
 
-            // restart sequence at current character
-            seq_clear(ctx->seq);
-            seq_push(ctx->seq, next);
-        }
+/*
+ * lzw_encode_lru: Same as lzw_encode(), replacing entries once the table
+ *                 is full.
+ */
 
-        free(cur_str);
+bool lzw_encode_lru(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* stream_ctx)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
     }
 
-    // do one last code write before returning
-    char* final_str = seq_to_cstr(ctx->seq);
-    size_t const final_len = seq_length(ctx->seq);
+    struct lzw_encoder* enc = lzw_encoder_init(start_bits, max_bits,
+                                               write_byte, stream_ctx);
 
-    if (!write_char_code(ctx, trie, cur_bits, final_str, final_len)) {
+    if (enc != NULL && !lzw_encoder_enable_lru(enc)) {
+        lzw_encoder_destroy(enc);
         return false;
     }
 
-    free(final_str);
-    trie_destroy(trie);
-    ctx_destroy(ctx);
-
-    return true;
+    return encode_all(enc, read_byte, stream_ctx, NULL);
 }
 
 /*
- * destroy_table: Free memory allocated in create_table().
+ * lzw_encode_growth: Same as lzw_encode(), growing the table under the
+ *                    given policy.
  */
 
-static void destroy_table(struct sequence** table, size_t table_size)
+bool lzw_encode_growth(unsigned int start_bits, unsigned int max_bits,
+        enum lzw_growth policy,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* stream_ctx)
 {
-    for (size_t i = 0; i < table_size; ++i) {
-        seq_destroy(table[i]);
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
     }
 
-    free(table);
+    struct lzw_encoder* enc = lzw_encoder_init(start_bits, max_bits,
+                                               write_byte, stream_ctx);
+
+    if (enc != NULL && !lzw_encoder_set_growth(enc, policy)) {
+        lzw_encoder_destroy(enc);
+        return false;
+    }
+
+    return encode_all(enc, read_byte, stream_ctx, NULL);
 }
 
 /*
- * create_table: Create a sequence table for decoding. This table is structured
- *               to hold the indices' corresponding ASCII character in the first
- *               LZW_CHAR_RANGE entries.
+ * lzw_encode_lookahead: Same as lzw_encode(), looking ahead to choose each
+ *                       match.
  */
 
-static struct sequence** create_table(size_t table_size)
+bool lzw_encode_lookahead(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* stream_ctx)
 {
-    struct sequence** table = malloc(sizeof(*table) * table_size);
-
-    if (table == NULL) {
-        return NULL;
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
     }
 
-    // initialize everything to null to prevent garbage data if allocation fails
-    for (size_t i = 0; i < table_size; ++i) {
-        table[i] = NULL;
+    struct lzw_encoder* enc = lzw_encoder_init(start_bits, max_bits,
+                                               write_byte, stream_ctx);
+
+    if (enc != NULL && !lzw_encoder_enable_lookahead(enc)) {
+        lzw_encoder_destroy(enc);
+        return false;
     }
 
-    // initialize the first LZW_CHAR_RANGE entries to their respective
-    // characters
-    for (size_t i = 0; i < LZW_CHAR_RANGE; ++i) {
-        struct sequence* seq = seq_init(1);
-        char c = (char) i;
+    return encode_all(enc, read_byte, stream_ctx, NULL);
+}
 
-        if (seq == NULL || !seq_push(seq, c)) {
-            // clean up table instead of trying to recover on failure
-            destroy_table(table, table_size);
-            return NULL;
-        }
+/*
+ * lzw_encode_seeded: Same as lzw_encode(), starting from a trained
+ *                    dictionary.
+ */
 
-        table[i] = seq;
+bool lzw_encode_seeded(unsigned int start_bits, unsigned int max_bits,
+        struct lzw_dictionary const* dict,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* stream_ctx)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
     }
 
-    return table;
+    return encode_all(lzw_encoder_init_seeded(start_bits, max_bits, dict,
+                                              write_byte, stream_ctx),
+                      read_byte, stream_ctx, NULL);
 }
 
 /*
- * output_sequence: Output the given sequence to the output bitstream by
- *                  converting it to a string of bytes. Returns true on
- *                  successful write, or else false.
+ * decode_all: Write out every string the decoder produces, then destroy it,
+ *             first filling in stats if given.
  */
 
-static bool output_sequence(struct lzwcontext* ctx, struct sequence* seq)
+static bool decode_all(struct decoder* dec,
+        void (*write_byte)(unsigned char, void*), void* context,
+        struct lzw_stats* stats)
 {
-    char* str = seq_to_cstr(seq);
+    enum decoder_status status;
+    unsigned char const* string;
+    size_t length;
 
-    if (str == NULL) {
-        return false;
+    while ((status = decoder_next(dec, &string, &length)) == DECODER_OK) {
+        for (size_t i = 0; i < length; ++i) {
+            write_byte(string[i], context);
+        }
     }
 
-    for (size_t i = 0; i < seq_length(seq); ++i) {
-        outs_write_bits(ctx->outs, str[i], CHAR_BIT);
+    if (stats != NULL) {
+        decoder_stats(dec, stats);
     }
 
-    free(str);
-    return true;
+    decoder_destroy(dec);
+    return status == DECODER_EOF;
 }
 
 /*
@@ -237,76 +264,151 @@ bool lzw_decode(unsigned int start_bits, unsigned int max_bits,
         return false;
     }
 
-    struct lzwcontext* ctx = ctx_init(1, context, read_byte, write_byte);
+    struct decoder* dec = decoder_init(start_bits, max_bits,
+                                       read_byte, context);
 
-    if (ctx == NULL) {
+    if (dec == NULL) {
         return false;
     }
 
-    unsigned int cur_bits = start_bits;
+    return decode_all(dec, write_byte, context, NULL);
+}
 
-    // track the max values for the current and max bits for adjusting code
-    // width
-    int32_t const code_max = (1 << max_bits) - 1;
-    int32_t current_code_max = (1 << cur_bits) - 1;
+/*
+ * lzw_decode_stats: Same as lzw_decode(), filling in stats at the end.
+ */
+
+bool lzw_decode_stats(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context, struct lzw_stats* stats)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
+    }
 
-    // create a table large enough to hold all potential codes
-    ssize_t next_index = LZW_CHAR_RANGE;
-    struct sequence** table = create_table(code_max);
+    struct decoder* dec = decoder_init(start_bits, max_bits,
+                                       read_byte, context);
 
-    if (table == NULL) {
+    if (dec == NULL) {
         return false;
     }
 
-    // read a single code, output it, and check the code width
-    code_t cur_code;
-    code_t prev_code = ins_read_bits(ctx->ins, cur_bits);
+    return decode_all(dec, write_byte, context, stats);
+}
 
-    if (!output_sequence(ctx, table[prev_code])) {
+/*
+ * lzw_decode_phased: Same as lzw_decode(), reading phase-in codes.
+ */
+
+bool lzw_decode_phased(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
         return false;
     }
 
-    if (next_index >= current_code_max) {
-        ++cur_bits;
+    struct decoder* dec = decoder_init(start_bits, max_bits,
+                                       read_byte, context);
+
+    if (dec == NULL) {
+        return false;
     }
 
-    while ((cur_code = ins_read_bits(ctx->ins, cur_bits)) != EOF) {
-        bool const table_has_code = cur_code < code_max;
-        struct sequence* const current_seq = table_has_code ?
-            table[cur_code] :
-            table[prev_code];
+    // a new decoder can always switch
+    decoder_enable_phase_in(dec);
 
-        char c = seq_first(current_seq);
+    return decode_all(dec, write_byte, context, NULL);
+}
 
-        if (next_index < code_max) {
-            // table is not full; add new entry
-            struct sequence* const new_entry = seq_copy(table[prev_code]);
+/*
+ * lzw_decode_lru: Same as lzw_decode(), replacing entries once the table
+ *                 is full.
+ */
+
+bool lzw_decode_lru(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
+    }
 
-            if (new_entry == NULL) {
-                return false;
-            }
+    struct decoder* dec = decoder_init(start_bits, max_bits,
+                                       read_byte, context);
 
-            seq_push(new_entry, c);
-            table[next_index] = new_entry;
-            ++next_index;
-        }
+    if (dec == NULL) {
+        return false;
+    }
 
-        if (!output_sequence(ctx, table[cur_code])) {
-            return false;
-        }
+    if (!decoder_enable_lru(dec)) {
+        decoder_destroy(dec);
+        return false;
+    }
 
-        prev_code = cur_code;
-        current_code_max = (1 << cur_bits) - 1;
+    return decode_all(dec, write_byte, context, NULL);
+}
 
-        // expand code width if needed
-        if (next_index >= current_code_max) {
-            ++cur_bits;
-        }
+/*
+ * lzw_decode_growth: Same as lzw_decode(), growing the table under the
+ *                    given policy.
+ */
+
+bool lzw_decode_growth(unsigned int start_bits, unsigned int max_bits,
+        enum lzw_growth policy,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)) {
+        return false;
+    }
+
+    struct decoder* dec = decoder_init(start_bits, max_bits,
+                                       read_byte, context);
+
+    if (dec == NULL) {
+        return false;
+    }
+
+    if (!decoder_set_growth(dec, policy)) {
+        decoder_destroy(dec);
+        return false;
+    }
+
+    return decode_all(dec, write_byte, context, NULL);
+}
+
+/*
+ * lzw_decode_seeded: Same as lzw_decode(), starting from a trained
+ *                    dictionary.
+ */
+
+bool lzw_decode_seeded(unsigned int start_bits, unsigned int max_bits,
+        struct lzw_dictionary const* dict,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (!verify_params(start_bits, max_bits, read_byte, write_byte)
+            || dict == NULL) {
+        return false;
+    }
 
+    struct decoder* dec = decoder_init(start_bits, max_bits,
+                                       read_byte, context);
+
+    if (dec == NULL) {
+        return false;
     }
 
-    ctx_destroy(ctx);
-    destroy_table(table, code_max);
+    if (!decoder_seed(dec, dict)) {
+        decoder_destroy(dec);
+        return false;
+    }
 
-    return true;
+    return decode_all(dec, write_byte, context, NULL);
 }
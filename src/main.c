@@ -1,60 +1,570 @@
 #include "lzw.h"
+#include "fileio.h"
+#include "jobs.h"
+#include "pipeline.h"
+#include "uring.h"
+#include "config.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <limits.h>
+#include <string.h>
 #include <unistd.h>
 
 #define INIT_BITS   8
-#define MAX_BITS    24
+
+// the widest codes unless -b says otherwise
+#define DEFAULT_MAX_BITS 24
+
+// entries kept by -T, which keeps the codes of seeded streams short
+#define TRAIN_ENTRIES 4096
 
 static char const* program_name;
+static unsigned int max_bits = DEFAULT_MAX_BITS;
+
+/*
+ * The input and output of a single run, passed as the context of the
+ * read/write callbacks.
+ */
+
+struct files {
+    struct source in;
+    struct sink out;
+};
+
+/*
+ * The sample files read by -T, one after another, and the dictionary
+ * written from them.
+ */
+
+struct samples {
+    char* const* paths;
+    size_t count;
+    size_t next;
+
+    struct files files;
+    bool open;
+    bool ok;
+};
+
+/*
+ * The files searched by -g, and the number of lines found so far.
+ */
+
+struct search {
+    struct files files;
+    unsigned long long lines;
+};
 
 static void usage(FILE* stream)
 {
     fprintf(stream, "Usage:\n");
-    fprintf(stream, "\t%s (-d | -e)\n", program_name);
+    fprintf(stream, "\t%s (-d | -e) [-p | -t | -u] [-b BITS] [-F] [-f] [-s]\n"
+                    "\t\t[-D DICT | -G GROWTH | -L | -P] "
+                    "[IN_PATH [OUT_PATH]]\n", program_name);
+    fprintf(stream, "\t%s (-d | -e) -E [-b BITS] [-u] [IN_PATH [OUT_PATH]]\n",
+            program_name);
+    fprintf(stream, "\t%s (-d | -e) -j N [-b BITS] FILE...\n", program_name);
+    fprintf(stream, "\t%s -T DICT [FILE...]\n", program_name);
+    fprintf(stream, "\t%s -g PATTERN [-b BITS] [IN_PATH [OUT_PATH]]\n",
+            program_name);
     fprintf(stream, "\n");
 
     fprintf(stream, "Options:\n");
     fprintf(stream, "\t-d\tDecode IN_PATH and store the result in OUT_PATH\n");
     fprintf(stream, "\t-e\tEncode IN_PATH and store the result in OUT_PATH\n");
+    fprintf(stream, "\t-p\tRead, code and write on separate threads\n");
+    fprintf(stream, "\t-b BITS\tLet codes grow to BITS bits, from %d to %d "
+                    "(default %d);\n\t\tsuch output can only be decoded "
+                    "with the same -b\n", INIT_BITS + 1, LZW_MAXIMUM_BITS,
+            DEFAULT_MAX_BITS);
+    fprintf(stream, "\t-D DICT\tStart from the dictionary trained "
+                    "into DICT\n");
+    fprintf(stream, "\t-E\tEntropy code the codes, which is slower "
+                    "but smaller;\n\t\tsuch output can only be decoded "
+                    "with -E\n");
+    fprintf(stream, "\t-F\tWhen encoding, look ahead to choose each match, "
+                    "which is\n\t\tslower but smaller; the output is "
+                    "decoded as usual\n");
+    fprintf(stream, "\t-G GROWTH\n\t\tGrow the table by whole matches, "
+                    "where GROWTH is lzmw\n\t\t(the previous match plus "
+                    "the current one) or lzap (the\n\t\tprevious match plus "
+                    "each prefix of the current one);\n\t\tsuch output can "
+                    "only be decoded with the same -G\n");
+    fprintf(stream, "\t-L\tOnce the table is full, replace the least "
+                    "recently used\n\t\tstrings instead of freezing it; "
+                    "such output can only\n\t\tbe decoded with -L\n");
+    fprintf(stream, "\t-P\tWrite or read codes as phase-in codes, "
+                    "which are smaller\n\t\tbut can only be decoded "
+                    "with -P\n");
+    fprintf(stream, "\t-T DICT\tTrain a dictionary on the FILEs "
+                    "and store it in DICT\n");
+    fprintf(stream, "\t-g, --grep PATTERN\n\t\tWrite the lines of the "
+                    "compressed IN_PATH that contain\n\t\tPATTERN, a fixed "
+                    "string, without decompressing the\n\t\trest. Exits "
+                    "with 1 if there are none, 2 on error\n");
+    fprintf(stream, "\t-f\tFlush the output whenever the input stalls, "
+                    "so that a\n\t\tstream can be decoded as it arrives\n");
+    fprintf(stream, "\t-j N\tCode each FILE on a pool of N threads, "
+                    "writing FILE" JOBS_SUFFIX "\n\t\twhen encoding and "
+                    "stripping " JOBS_SUFFIX " when decoding\n");
+    fprintf(stream, "\t-s, --stats\n\t\tPrint statistics about the coding "
+                    "to stderr\n");
+    fprintf(stream, "\t-t\tPack or unpack codes on a separate thread\n");
+    fprintf(stream, "\t-u\tKeep several reads and writes in flight with "
+                    "io_uring,\n\t\tif available\n");
     fprintf(stream, "\n");
 
-    fprintf(stream, "Encode or decode the bytes read from stdin using LZW\n");
-    fprintf(stream, "compression and print the result to stdout.\n");
+    fprintf(stream, "IN_PATH and OUT_PATH default to stdin and stdout,\n");
+    fprintf(stream, "which can also be given as -.\n");
 }
 
 static int read_byte(void* ctx)
 {
-    return fgetc(ctx);
+    struct files* files = ctx;
+    return source_read_byte(&files->in);
 }
 
 static void print_byte(unsigned char byte, void* ctx)
 {
-    (void) ctx;
-    putchar(byte);
+    struct files* files = ctx;
+    sink_write_byte(byte, &files->out);
+}
+
+/*
+ * read_byte_flushing: Like read_byte(), but flushes the output before
+ *                     waiting for more input.
+ */
+
+static int read_byte_flushing(void* ctx)
+{
+    struct files* files = ctx;
+
+    if (files->in.position == files->in.length) {
+        sink_flush(&files->out);
+    }
+
+    return source_read_byte(&files->in);
+}
+
+static void flush_files(void* ctx)
+{
+    struct files* files = ctx;
+    sink_flush(&files->out);
+}
+
+/*
+ * read_sample: Read the next byte of the samples, moving on to the next
+ *              file at the end of each one. Files that can't be opened are
+ *              reported and make training fail.
+ */
+
+static int read_sample(void* ctx)
+{
+    struct samples* samples = ctx;
+
+    while (true) {
+        if (samples->open) {
+            int const c = source_read_byte(&samples->files.in);
+
+            if (c != EOF) {
+                return c;
+            }
+
+            samples->ok = source_close(&samples->files.in) && samples->ok;
+            samples->open = false;
+        }
+
+        if (samples->next == samples->count) {
+            return EOF;
+        }
+
+        char const* path = samples->paths[samples->next++];
+
+        if (!source_open(&samples->files.in, path)) {
+            perror(path);
+            samples->ok = false;
+            continue;
+        }
+
+        samples->open = true;
+    }
+}
+
+static void write_sample(unsigned char byte, void* ctx)
+{
+    struct samples* samples = ctx;
+    sink_write_byte(byte, &samples->files.out);
+}
+
+/*
+ * train: Train a dictionary on the given files, or stdin if there are none.
+ */
+
+static bool train(char const* dict_path, char* const* paths, size_t count)
+{
+    static char* const std_paths[] = { "-" };
+    struct samples samples = {
+        .paths = (count > 0) ? paths : std_paths,
+        .count = (count > 0) ? count : 1,
+        .next = 0,
+        .open = false,
+        .ok = true
+    };
+
+    if (!sink_open(&samples.files.out, dict_path)) {
+        perror(dict_path);
+        return false;
+    }
+
+    bool success = lzw_dictionary_train(TRAIN_ENTRIES, read_sample,
+                                        write_sample, &samples);
+
+    if (samples.open) {
+        source_close(&samples.files.in);
+    }
+
+    success = sink_close(&samples.files.out) && success;
+    return success && samples.ok;
+}
+
+/*
+ * print_line: Write a line found by the search.
+ */
+
+static void print_line(unsigned char const* line, size_t length,
+        unsigned long long offset, void* ctx)
+{
+    struct search* search = ctx;
+
+    (void) offset;
+
+    for (size_t i = 0; i < length; ++i) {
+        sink_write_byte(line[i], &search->files.out);
+    }
+
+    sink_write_byte('\n', &search->files.out);
+    ++search->lines;
+}
+
+/*
+ * grep: Search a compressed file for the lines containing a pattern.
+ *       Returns the exit status: 0 if any were found, 1 if none were, or 2
+ *       on error, as grep does.
+ */
+
+static int grep(char const* pattern, char const* in_path,
+        char const* out_path)
+{
+    size_t const length = strlen(pattern);
+
+    if (length == 0 || length > LZW_GREP_MAX_PATTERN) {
+        fprintf(stderr, "%s: the pattern must be 1 to %d bytes long\n",
+                program_name, LZW_GREP_MAX_PATTERN);
+        return 2;
+    }
+
+    struct search search = { .lines = 0 };
+
+    if (!source_open(&search.files.in, in_path)) {
+        perror(in_path != NULL ? in_path : "stdin");
+        return 2;
+    }
+
+    if (!sink_open(&search.files.out, out_path)) {
+        perror(out_path != NULL ? out_path : "stdout");
+        source_close(&search.files.in);
+        return 2;
+    }
+
+    bool success = lzw_grep(INIT_BITS, max_bits,
+                            (unsigned char const*) pattern, length,
+                            read_byte, print_line, &search);
+
+    success = source_close(&search.files.in) && success;
+    success = sink_close(&search.files.out) && success;
+
+    if (!success) {
+        return 2;
+    }
+
+    return (search.lines > 0) ? 0 : 1;
+}
+
+/*
+ * parse_number: Read an option's argument as a decimal number, returning
+ *               false unless it's all digits and between min and max.
+ */
+
+static bool parse_number(char const* text, unsigned long min,
+        unsigned long max, unsigned long* number)
+{
+    char* end;
+
+    // strtoul() would skip spaces and take a sign
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+
+    *number = strtoul(text, &end, 10);
+    return *end == '\0' && *number >= min && *number <= max;
+}
+
+/*
+ * print_stats: Describe the coding on stderr.
+ */
+
+static void print_stats(struct lzw_stats const* stats)
+{
+    fprintf(stderr, "input:    %llu bytes\n", stats->bytes_in);
+    fprintf(stderr, "output:   %llu bytes\n", stats->bytes_out);
+    fprintf(stderr, "codes:    %llu, %.2f bytes each on average\n",
+            stats->codes, stats->average_match);
+
+    for (size_t i = 0; i < LZW_STATS_WIDTHS; ++i) {
+        if (stats->codes_by_width[i] > 0) {
+            fprintf(stderr, "  %2zu bits: %llu\n", i,
+                    stats->codes_by_width[i]);
+        }
+    }
+
+    fprintf(stderr, "widths:   %u to %u bits, %u change%s\n",
+            stats->start_bits, stats->final_bits, stats->width_changes,
+            (stats->width_changes == 1) ? "" : "s");
+    fprintf(stderr, "table:    %llu of %llu entries (%.1f%%)\n",
+            stats->entries, stats->max_entries,
+            (stats->max_entries > 0) ?
+                100.0 * stats->entries / stats->max_entries :
+                0.0);
+
+    if (stats->frozen) {
+        fprintf(stderr, "          full after %llu codes, %llu bytes into "
+                "the compressed data\n", stats->freeze_codes,
+                stats->freeze_offset);
+    }
+
+    if (stats->replaced > 0) {
+        fprintf(stderr, "          %llu entries replaced since\n",
+                stats->replaced);
+    }
+
+    if (stats->lookups > 0) {
+        fprintf(stderr, "lookups:  %llu, %llu missed (%.1f%%)\n",
+                stats->lookups, stats->misses,
+                100.0 * stats->misses / stats->lookups);
+    }
+
+    fprintf(stderr, "memory:   %llu bytes allocated, %llu at peak\n",
+            stats->bytes_allocated, stats->peak_memory);
+}
+
+/*
+ * long_options: Replace the long forms of options with the short ones that
+ *               getopt() understands, stopping at "--".
+ */
+
+static void long_options(int argc, char** argv)
+{
+    static char short_stats[] = "-s";
+    static char short_grep[] = "-g";
+
+    for (int i = 1; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            argv[i] = short_stats;
+        } else if (strcmp(argv[i], "--grep") == 0) {
+            argv[i] = short_grep;
+
+            // the pattern may look like an option
+            ++i;
+        }
+    }
+}
+
+static size_t next_block(void* ctx, unsigned char const** block)
+{
+    struct files* files = ctx;
+    return source_next_block(&files->in, block);
+}
+
+static size_t uring_next_block(void* ctx, unsigned char const** block)
+{
+    return uring_io_next_block(ctx, block);
+}
+
+/*
+ * parse_growth: Get the growth policy with the given name.
+ */
+
+static bool parse_growth(char const* name, enum lzw_growth* policy)
+{
+    if (strcmp(name, "lzmw") == 0) {
+        *policy = LZW_GROWTH_LZMW;
+    } else if (strcmp(name, "lzap") == 0) {
+        *policy = LZW_GROWTH_LZAP;
+    } else if (strcmp(name, "lzw") == 0) {
+        *policy = LZW_GROWTH_LZW;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * encode_blocks: Encode the input a block at a time, as handed out by
+ *                next_block. A mapped input file is a single block, so the
+ *                encoder reads it in place. The statistics are stored in
+ *                stats. The other options:
+ *                 - flush, if given, syncs the encoder and flushes the
+ *                     output after every block.
+ *                 - preset, if given, seeds the encoder.
+ *                 - phased writes phase-in codes.
+ *                 - lru replaces entries once the table is full.
+ *                 - lookahead parses with lookahead.
+ *                 - growth is the policy the table grows under.
+ */
+
+static bool encode_blocks(size_t (*next_block)(void*, unsigned char const**),
+        void (*write_byte)(unsigned char, void*), void (*flush)(void*),
+        struct lzw_dictionary const* preset, bool phased, bool lru,
+        bool lookahead, enum lzw_growth growth, void* context,
+        struct lzw_stats* stats)
+{
+    struct lzw_encoder* enc = (preset != NULL) ?
+        lzw_encoder_init_seeded(INIT_BITS, max_bits, preset, write_byte,
+                                context) :
+        lzw_encoder_init(INIT_BITS, max_bits, write_byte, context);
+
+    if (enc == NULL) {
+        return false;
+    }
+
+    if ((phased && !lzw_encoder_enable_phase_in(enc))
+            || (lru && !lzw_encoder_enable_lru(enc))
+            || (lookahead && !lzw_encoder_enable_lookahead(enc))
+            || (growth != LZW_GROWTH_LZW
+                && !lzw_encoder_set_growth(enc, growth))) {
+        lzw_encoder_destroy(enc);
+        return false;
+    }
+
+    unsigned char const* block;
+    size_t length;
+    bool success = true;
+
+    while (success && (length = next_block(context, &block)) > 0) {
+        success = lzw_encoder_write(enc, block, length);
+
+        if (success && flush != NULL) {
+            success = lzw_encoder_sync(enc);
+            flush(context);
+        }
+    }
+
+    success = success && lzw_encoder_finish(enc);
+    lzw_encoder_stats(enc, stats);
+    lzw_encoder_destroy(enc);
+
+    return success;
 }
 
 int main(int argc, char** argv) {
     program_name = argv[0];
 
-    if (argc != 2) {
+    if (argc < 2) {
         usage(stderr);
         return EXIT_FAILURE;
     }
 
     enum { ENCODE, DECODE } mode = ENCODE;
+    bool pipelined = false;
+    bool threaded = false;
+    bool use_uring = false;
+    bool flush = false;
+    bool show_stats = false;
+    bool phased = false;
+    bool entropy = false;
+    bool lru = false;
+    bool lookahead = false;
+    enum lzw_growth growth = LZW_GROWTH_LZW;
+    unsigned int jobs = 0;
+    unsigned long number;
+    char const* preset_path = NULL;
+    char const* train_path = NULL;
+    char const* pattern = NULL;
     int opt;
 
-    while ((opt = getopt(argc, argv, "deh")) != -1) {
+    long_options(argc, argv);
+
+    while ((opt = getopt(argc, argv, "D:EFG:LPT:b:defg:hj:pstu")) != -1) {
         switch (opt) {
+        case 'D':
+            preset_path = optarg;
+            break;
+        case 'E':
+            entropy = true;
+            break;
+        case 'F':
+            lookahead = true;
+            break;
+        case 'G':
+            if (!parse_growth(optarg, &growth)) {
+                usage(stderr);
+                return EXIT_FAILURE;
+            }
+
+            break;
+        case 'L':
+            lru = true;
+            break;
+        case 'P':
+            phased = true;
+            break;
+        case 'T':
+            train_path = optarg;
+            break;
+        case 'b':
+            if (!parse_number(optarg, INIT_BITS + 1, LZW_MAXIMUM_BITS,
+                              &number)) {
+                usage(stderr);
+                return EXIT_FAILURE;
+            }
+
+            max_bits = number;
+            break;
         case 'd':
             mode = DECODE;
             break;
         case 'e':
             mode = ENCODE;
             break;
+        case 'f':
+            flush = true;
+            break;
+        case 'g':
+            pattern = optarg;
+            break;
+        case 'j':
+            if (!parse_number(optarg, 1, UINT_MAX, &number)) {
+                usage(stderr);
+                return EXIT_FAILURE;
+            }
+
+            jobs = number;
+            break;
+        case 'p':
+            pipelined = true;
+            break;
+        case 's':
+            show_stats = true;
+            break;
+        case 't':
+            threaded = true;
+            break;
+        case 'u':
+            use_uring = true;
+            break;
         case 'h':
             usage(stdout);
             return EXIT_SUCCESS;
@@ -64,15 +574,213 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (train_path != NULL) {
+        bool const success = train(train_path, argv + optind, argc - optind);
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // searching reads the plain stream, one file at a time
+    if (pattern != NULL) {
+        if (jobs > 0 || pipelined || threaded || preset_path != NULL
+                || phased || entropy || lru || lookahead
+                || growth != LZW_GROWTH_LZW
+                || show_stats || argc - optind > 2) {
+            usage(stderr);
+            return 2;
+        }
+
+        return grep(pattern, (optind < argc) ? argv[optind] : NULL,
+                    (optind + 1 < argc) ? argv[optind + 1] : NULL);
+    }
+
+    // seeded coding is only done on the main thread, one file at a time
+    if (preset_path != NULL && (jobs > 0 || pipelined || threaded)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // entropy coding works on whole streams, without any other options, and
+    // its format has no room for the widest codes
+    if (entropy && (jobs > 0 || pipelined || threaded || flush || show_stats
+                || max_bits > LZW_ENTROPY_MAX_BITS
+                || preset_path != NULL || phased || lru || lookahead
+                || growth != LZW_GROWTH_LZW)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // as are phase-in codes, which aren't combined with a preset
+    if (phased && (jobs > 0 || pipelined || threaded || preset_path != NULL)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // and LRU replacement, which can't be flushed either
+    if (lru && (jobs > 0 || pipelined || threaded || preset_path != NULL
+                || phased || flush)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // and the growth policies, which don't mix with either
+    if (growth != LZW_GROWTH_LZW
+            && (jobs > 0 || pipelined || threaded || preset_path != NULL
+                || phased || lru || flush)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // lookahead only changes how the input is parsed, so it's for encoding
+    // on the main thread, and the table grows the usual way under it
+    if (lookahead && (mode == DECODE || jobs > 0 || pipelined || threaded
+                || lru || growth != LZW_GROWTH_LZW)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // and so are statistics, which only plain decoding gathers
+    if (show_stats && (jobs > 0 || pipelined || threaded
+                || (mode == DECODE
+                    && (preset_path != NULL || phased || lru
+                        || growth != LZW_GROWTH_LZW)))) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // flushing is only done with the coding and I/O on one thread
+    if (flush && (jobs > 0 || pipelined || threaded || use_uring)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // the jobs code whole files on their own threads
+    if (jobs > 0 && (pipelined || threaded || use_uring)) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    // the pipeline has threads of its own for reading and writing, and the
+    // threaded coders read and write on different threads, which can't share
+    // a ring
+    if (pipelined && threaded) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    if ((pipelined || threaded) && use_uring) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (jobs > 0) {
+        if (optind == argc) {
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+
+        bool const success = jobs_run(argv + optind, argc - optind, jobs,
+                                      mode == DECODE, INIT_BITS, max_bits);
+
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc - optind > 2) {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    char const* in_path = (optind < argc) ? argv[optind] : NULL;
+    char const* out_path = (optind + 1 < argc) ? argv[optind + 1] : NULL;
+    struct lzw_dictionary* preset = NULL;
+    struct files files;
+
+    if (preset_path != NULL
+            && (preset = lzw_dictionary_load(preset_path)) == NULL) {
+        fprintf(stderr, "%s: not a valid dictionary\n", preset_path);
+        return EXIT_FAILURE;
+    }
+
+    if (!source_open(&files.in, in_path)) {
+        perror(in_path != NULL ? in_path : "stdin");
+        lzw_dictionary_unload(preset);
+        return EXIT_FAILURE;
+    }
+
+    if (!sink_open(&files.out, out_path)) {
+        perror(out_path != NULL ? out_path : "stdout");
+        source_close(&files.in);
+        lzw_dictionary_unload(preset);
+        return EXIT_FAILURE;
+    }
+
+    // the callbacks and their context, which are switched over to io_uring
+    // if it was asked for and is available
+    int (*in)(void*) = read_byte;
+    void (*out)(unsigned char, void*) = print_byte;
+    size_t (*blocks)(void*, unsigned char const**) = next_block;
+    void (*flusher)(void*) = NULL;
+    void* context = &files;
+    struct uring_io* uring = NULL;
+
+    if (flush) {
+        in = read_byte_flushing;
+        flusher = flush_files;
+    }
+
+    if (use_uring) {
+        uring = uring_io_init(files.in.fd, files.out.fd);
+    }
+
+    if (uring != NULL) {
+        in = uring_io_read_byte;
+        out = uring_io_write_byte;
+        blocks = uring_next_block;
+        context = uring;
+    }
+
+    struct lzw_stats stats;
     bool success;
 
-    switch (mode) {
-    case ENCODE:
-        success = lzw_encode(INIT_BITS, MAX_BITS, read_byte, print_byte, stdin);
-        break;
-    case DECODE:
-        success = lzw_decode(INIT_BITS, MAX_BITS, read_byte, print_byte, stdin);
-        break;
+    if (pipelined) {
+        success = (mode == ENCODE) ?
+            pipeline_encode(files.in.fd, files.out.fd, INIT_BITS, max_bits) :
+            pipeline_decode(files.in.fd, files.out.fd, INIT_BITS, max_bits);
+    } else if (threaded) {
+        success = (mode == ENCODE) ?
+            lzw_encode_threaded(INIT_BITS, max_bits, in, out, context) :
+            lzw_decode_threaded(INIT_BITS, max_bits, in, out, context);
+    } else if (entropy) {
+        success = (mode == ENCODE) ?
+            lzw_encode_entropy(INIT_BITS, max_bits, in, out, context) :
+            lzw_decode_entropy(INIT_BITS, max_bits, in, out, context);
+    } else if (mode == ENCODE) {
+        success = encode_blocks(blocks, out, flusher, preset, phased, lru,
+                                lookahead, growth, context, &stats);
+    } else if (growth != LZW_GROWTH_LZW) {
+        success = lzw_decode_growth(INIT_BITS, max_bits, growth, in, out,
+                                    context);
+    } else if (lru) {
+        success = lzw_decode_lru(INIT_BITS, max_bits, in, out, context);
+    } else if (phased) {
+        success = lzw_decode_phased(INIT_BITS, max_bits, in, out, context);
+    } else if (preset != NULL) {
+        success = lzw_decode_seeded(INIT_BITS, max_bits, preset, in, out,
+                                    context);
+    } else {
+        success = lzw_decode_stats(INIT_BITS, max_bits, in, out, context,
+                                   &stats);
+    }
+
+    if (uring != NULL) {
+        success = uring_io_finish(uring) && success;
+    }
+
+    success = source_close(&files.in) && success;
+    success = sink_close(&files.out) && success;
+    lzw_dictionary_unload(preset);
+
+    if (show_stats) {
+        print_stats(&stats);
     }
 
     return success ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -12,6 +12,8 @@ struct outstream {
 
     unsigned char buffer;
     uint8_t bufsize;
+
+    unsigned long long written;
 };
 
 /*
@@ -32,6 +34,7 @@ struct outstream* outs_init(void* context,
 
     outs->buffer = 0;
     outs->bufsize = 0;
+    outs->written = 0;
 
     return outs;
 }
@@ -82,6 +85,25 @@ void outs_write_bits(struct outstream* outs, uint32_t bits, size_t bit_count)
     }
 }
 
+/*
+ * outs_write_phased: Write the short codes as they are, and the long ones
+ *                    shifted past them, so that the first n - 1 bits tell
+ *                    a reader whether there is another.
+ */
+
+void outs_write_phased(struct outstream* outs, uint32_t value,
+        uint64_t range, size_t bit_count)
+{
+    size_t const width = phased_width(range, bit_count);
+    uint64_t const short_count = ((uint64_t) 1 << width) - range;
+
+    if (value < short_count) {
+        outs_write_bits(outs, value, width - 1);
+    } else {
+        outs_write_bits(outs, value + short_count, width);
+    }
+}
+
 /*
  * outs_flush: Flush the buffer of the output bitstream.
  *             Since outs_write_bits() ensures the buffer is properly zeroed,
@@ -95,7 +117,60 @@ void outs_flush(struct outstream* outs)
     }
 
     (outs->write)(outs->buffer, outs->context);
+    ++outs->written;
+
+    outs->buffer = 0;
+    outs->bufsize = 0;
+}
+
+/*
+ * outs_redirect: Switch the stream to another output and start it over.
+ */
+
+void outs_redirect(struct outstream* outs, void* context,
+        void (*write_byte)(unsigned char c, void* context))
+{
+    outs->write = write_byte;
+    outs->context = context;
 
     outs->buffer = 0;
     outs->bufsize = 0;
+    outs->written = 0;
+}
+
+/*
+ * outs_get_pending: Get the contents of the buffer.
+ */
+
+unsigned char outs_get_pending(struct outstream const* outs,
+        size_t* bit_count)
+{
+    *bit_count = outs->bufsize;
+    return outs->buffer;
+}
+
+/*
+ * outs_set_pending: Replace the contents of the buffer, clearing the bits
+ *                   past bit_count.
+ */
+
+void outs_set_pending(struct outstream* outs, unsigned char bits,
+        size_t bit_count)
+{
+    if (bit_count >= CHAR_BIT) {
+        // a full byte would have been flushed already
+        return;
+    }
+
+    outs->buffer = bits & ~(UCHAR_MAX >> bit_count);
+    outs->bufsize = bit_count;
+}
+
+/*
+ * outs_bytes_written: Get the number of bytes passed to write_byte so far.
+ */
+
+unsigned long long outs_bytes_written(struct outstream const* outs)
+{
+    return outs->written;
 }
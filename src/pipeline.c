@@ -0,0 +1,290 @@
+#include "pipeline.h"
+#include "ring.h"
+#include "lzw.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define PIPELINE_BLOCKS     8
+#define PIPELINE_BLOCK_SIZE (256 * 1024)
+
+struct pipeline {
+    int in_fd;
+    int out_fd;
+
+    // raw input from the reader, and coded output for the writer
+    struct ring* input;
+    struct ring* output;
+
+    // the coding thread's position in the current blocks of each ring
+    unsigned char const* in_block;
+    size_t in_length;
+    size_t in_pos;
+
+    unsigned char* out_block;
+    size_t out_length;
+
+    bool read_ok;
+    bool code_ok;
+    bool write_ok;
+};
+
+/*
+ * read_stage: Fill blocks from the input file until it runs out or the
+ *             coding thread stops listening.
+ */
+
+static void* read_stage(void* arg)
+{
+    struct pipeline* p = arg;
+    unsigned char* block;
+
+    while ((block = ring_acquire(p->input)) != NULL) {
+        ssize_t n = read(p->in_fd, block, ring_block_size(p->input));
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            p->read_ok = false;
+            break;
+        } else if (n == 0) {
+            break;
+        }
+
+        ring_publish(p->input, n);
+    }
+
+    ring_close(p->input);
+    return NULL;
+}
+
+/*
+ * write_all: Write the whole buffer, retrying on short writes.
+ */
+
+static bool write_all(int fd, unsigned char const* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return false;
+        }
+
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+/*
+ * write_stage: Write out blocks as the coding thread finishes them.
+ */
+
+static void* write_stage(void* arg)
+{
+    struct pipeline* p = arg;
+    unsigned char const* block;
+    size_t length;
+
+    while ((block = ring_peek(p->output, &length)) != NULL) {
+        if (!write_all(p->out_fd, block, length)) {
+            // stop the coding thread, which in turn stops the reader
+            p->write_ok = false;
+            ring_close(p->output);
+            break;
+        }
+
+        ring_release(p->output);
+    }
+
+    return NULL;
+}
+
+/*
+ * take_byte: read_byte() callback that pulls from the input ring.
+ */
+
+static int take_byte(void* context)
+{
+    struct pipeline* p = context;
+
+    if (p->in_pos == p->in_length) {
+        if (p->in_block != NULL) {
+            ring_release(p->input);
+        }
+
+        p->in_block = ring_peek(p->input, &p->in_length);
+        p->in_pos = 0;
+
+        if (p->in_block == NULL) {
+            return EOF;
+        }
+    }
+
+    return p->in_block[p->in_pos++];
+}
+
+/*
+ * flush_output: Publish the partially filled output block, if any.
+ */
+
+static void flush_output(struct pipeline* p)
+{
+    if (p->out_block != NULL) {
+        ring_publish(p->output, p->out_length);
+        p->out_block = NULL;
+    }
+}
+
+/*
+ * put_byte: write_byte() callback that fills blocks of the output ring.
+ */
+
+static void put_byte(unsigned char c, void* context)
+{
+    struct pipeline* p = context;
+
+    if (p->out_block == NULL) {
+        p->out_block = ring_acquire(p->output);
+        p->out_length = 0;
+
+        if (p->out_block == NULL) {
+            // the writer gave up
+            p->code_ok = false;
+            return;
+        }
+    }
+
+    p->out_block[p->out_length++] = c;
+
+    if (p->out_length == ring_block_size(p->output)) {
+        flush_output(p);
+    }
+}
+
+/*
+ * encode_stage: Encode the input blocks as they arrive.
+ */
+
+static bool encode_stage(struct pipeline* p,
+        unsigned int start_bits, unsigned int max_bits)
+{
+    struct lzw_encoder* enc = lzw_encoder_init(start_bits, max_bits,
+                                               put_byte, p);
+
+    if (enc == NULL) {
+        return false;
+    }
+
+    unsigned char const* block;
+    size_t length;
+    bool success = true;
+
+    while (success && (block = ring_peek(p->input, &length)) != NULL) {
+        success = lzw_encoder_write(enc, block, length) && p->code_ok;
+        ring_release(p->input);
+    }
+
+    success = success && lzw_encoder_finish(enc);
+    lzw_encoder_destroy(enc);
+
+    return success;
+}
+
+/*
+ * run_stages: Start the reader and writer threads, run the coding stage on
+ *             the calling thread, then wait for the others to finish.
+ */
+
+static bool run_stages(struct pipeline* p, bool encode,
+        unsigned int start_bits, unsigned int max_bits)
+{
+    pthread_t reader;
+    pthread_t writer;
+
+    if (pthread_create(&reader, NULL, read_stage, p) != 0) {
+        return false;
+    }
+
+    if (pthread_create(&writer, NULL, write_stage, p) != 0) {
+        ring_close(p->input);
+        pthread_join(reader, NULL);
+
+        return false;
+    }
+
+    bool const success = encode ?
+        encode_stage(p, start_bits, max_bits) :
+        lzw_decode(start_bits, max_bits, take_byte, put_byte, p);
+
+    flush_output(p);
+    ring_close(p->output);
+
+    // if coding stopped early, the reader may be waiting for space
+    ring_close(p->input);
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+
+    return success && p->read_ok && p->code_ok && p->write_ok;
+}
+
+/*
+ * run: Set up the rings between the stages and run the pipeline.
+ */
+
+static bool run(int in_fd, int out_fd, bool encode,
+        unsigned int start_bits, unsigned int max_bits)
+{
+    struct pipeline p = {
+        .in_fd = in_fd,
+        .out_fd = out_fd,
+        .input = ring_init(PIPELINE_BLOCKS, PIPELINE_BLOCK_SIZE),
+        .output = ring_init(PIPELINE_BLOCKS, PIPELINE_BLOCK_SIZE),
+        .in_block = NULL,
+        .in_length = 0,
+        .in_pos = 0,
+        .out_block = NULL,
+        .out_length = 0,
+        .read_ok = true,
+        .code_ok = true,
+        .write_ok = true,
+    };
+
+    bool const success = p.input != NULL && p.output != NULL
+        && run_stages(&p, encode, start_bits, max_bits);
+
+    ring_destroy(p.input);
+    ring_destroy(p.output);
+
+    return success;
+}
+
+/*
+ * pipeline_encode: Encode in_fd to out_fd using three threads.
+ */
+
+bool pipeline_encode(int in_fd, int out_fd,
+        unsigned int start_bits, unsigned int max_bits)
+{
+    return run(in_fd, out_fd, true, start_bits, max_bits);
+}
+
+/*
+ * pipeline_decode: Decode in_fd to out_fd using three threads.
+ */
+
+bool pipeline_decode(int in_fd, int out_fd,
+        unsigned int start_bits, unsigned int max_bits)
+{
+    return run(in_fd, out_fd, false, start_bits, max_bits);
+}
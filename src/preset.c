@@ -0,0 +1,375 @@
+// mmap() is outside of C99
+#define _POSIX_C_SOURCE 200809L
+
+#include "preset.h"
+#include "lzw.h"
+#include "dict.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the training table grows to this many times the entries kept
+#define TRAIN_FACTOR 8
+
+struct lzw_dictionary {
+    unsigned char const* image;
+    size_t image_size;
+    size_t entry_count;
+
+    // set if the image is mapped from a file
+    bool mapped;
+};
+
+/*
+ * read_u32: Decode a little-endian 32-bit integer.
+ */
+
+static uint32_t read_u32(unsigned char const* p)
+{
+    return (uint32_t) p[0]
+        | (uint32_t) p[1] << 8
+        | (uint32_t) p[2] << 16
+        | (uint32_t) p[3] << 24;
+}
+
+/*
+ * write_u32: Write a little-endian 32-bit integer via write_byte.
+ */
+
+static void write_u32(uint32_t value,
+        void (*write_byte)(unsigned char c, void* context), void* context)
+{
+    for (int i = 0; i < 4; ++i) {
+        write_byte(value >> (8 * i), context);
+    }
+}
+
+/*
+ * preset_size: Get the number of trained entries.
+ */
+
+size_t preset_size(struct lzw_dictionary const* dict)
+{
+    return dict->entry_count;
+}
+
+/*
+ * preset_entry: Unpack entry i from the image.
+ */
+
+void preset_entry(struct lzw_dictionary const* dict, size_t i,
+        code_t* prefix, unsigned char* c)
+{
+    uint32_t const key = read_u32(dict->image + PRESET_HEADER_SIZE
+                                  + i * PRESET_ENTRY_SIZE);
+
+    *prefix = key >> 8;
+    *c = key & 0xFF;
+}
+
+/*
+ * lzw_dictionary_size: Get the number of trained entries.
+ */
+
+size_t lzw_dictionary_size(struct lzw_dictionary const* dict)
+{
+    return dict->entry_count;
+}
+
+/*
+ * check_image: Validate the header and make sure that every entry refers
+ *              to an earlier one, which is all the coders rely on.
+ */
+
+static bool check_image(unsigned char const* image, size_t size,
+        size_t* entry_count)
+{
+    if (size < PRESET_HEADER_SIZE
+            || memcmp(image, PRESET_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    size_t const count = read_u32(image + 4);
+
+    if (count > (size - PRESET_HEADER_SIZE) / PRESET_ENTRY_SIZE
+            || size != PRESET_HEADER_SIZE + count * PRESET_ENTRY_SIZE
+            || count >= ((size_t) 1 << PRESET_MAX_BITS) - LZW_CHAR_RANGE) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t const key = read_u32(image + PRESET_HEADER_SIZE
+                                      + i * PRESET_ENTRY_SIZE);
+
+        if ((key >> 8) >= LZW_CHAR_RANGE + i) {
+            return false;
+        }
+    }
+
+    *entry_count = count;
+    return true;
+}
+
+/*
+ * lzw_dictionary_wrap: Use an image that's already in memory.
+ */
+
+struct lzw_dictionary* lzw_dictionary_wrap(void const* image, size_t size)
+{
+    struct lzw_dictionary* dict = malloc(sizeof(*dict));
+
+    if (dict == NULL) {
+        return NULL;
+    }
+
+    if (!check_image(image, size, &dict->entry_count)) {
+        free(dict);
+        return NULL;
+    }
+
+    dict->image = image;
+    dict->image_size = size;
+    dict->mapped = false;
+
+    return dict;
+}
+
+/*
+ * lzw_dictionary_load: Map an image file in a single piece. The entries are
+ *                      used in place, so nothing is allocated per entry.
+ */
+
+struct lzw_dictionary* lzw_dictionary_load(char const* path)
+{
+    int const fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    void* image = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && st.st_size >= PRESET_HEADER_SIZE) {
+        image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    close(fd);
+
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct lzw_dictionary* dict = lzw_dictionary_wrap(image, st.st_size);
+
+    if (dict == NULL) {
+        munmap(image, st.st_size);
+        return NULL;
+    }
+
+    dict->mapped = true;
+    return dict;
+}
+
+/*
+ * lzw_dictionary_unload: Free the structure returned by load() or wrap().
+ */
+
+void lzw_dictionary_unload(struct lzw_dictionary* dict)
+{
+    if (dict == NULL) {
+        return;
+    }
+
+    if (dict->mapped) {
+        munmap((void*) dict->image, dict->image_size);
+    }
+
+    free(dict);
+}
+
+/*
+ * A candidate entry during training: its key and how often the samples
+ * matched through it.
+ */
+
+struct candidate {
+    uint32_t key;
+    code_t code;
+    unsigned long uses;
+};
+
+/*
+ * by_uses: Order candidates by descending use, then by ascending code.
+ *          A string is matched at least as often as any of its extensions,
+ *          and has a smaller code, so every prefix of a chosen entry is
+ *          chosen before it.
+ */
+
+static int by_uses(void const* a, void const* b)
+{
+    struct candidate const* x = a;
+    struct candidate const* y = b;
+
+    if (x->uses != y->uses) {
+        return (x->uses > y->uses) ? -1 : 1;
+    }
+
+    return (x->code > y->code) - (x->code < y->code);
+}
+
+/*
+ * by_code: Order candidates by ascending code.
+ */
+
+static int by_code(void const* a, void const* b)
+{
+    struct candidate const* x = a;
+    struct candidate const* y = b;
+
+    return (x->code > y->code) - (x->code < y->code);
+}
+
+/*
+ * learn: Run LZW over the samples, recording each entry as it's added and
+ *        counting the matches made through it. Returns false if allocation
+ *        fails.
+ */
+
+static bool learn(struct candidate* candidates, size_t limit, size_t* count_out,
+        int (*read_byte)(void* context), void* context)
+{
+    struct dict* dict = dict_init(limit);
+
+    if (dict == NULL) {
+        return false;
+    }
+
+    bool success = true;
+    size_t count = 0;
+    code_t prefix = -1;
+    int next;
+
+    while ((next = read_byte(context)) != EOF) {
+        unsigned char const c = next;
+
+        if (prefix < 0) {
+            prefix = c;
+            continue;
+        }
+
+        code_t const code = dict_lookup(dict, prefix, c);
+
+        if (code >= 0) {
+            ++candidates[code - LZW_CHAR_RANGE].uses;
+            prefix = code;
+            continue;
+        }
+
+        if (count < limit) {
+            struct candidate* const cand = &candidates[count];
+
+            cand->key = ((uint32_t) prefix << 8) | c;
+            cand->code = LZW_CHAR_RANGE + count;
+            cand->uses = 0;
+
+            if (!dict_insert(dict, prefix, c, cand->code)) {
+                success = false;
+                break;
+            }
+
+            ++count;
+        }
+
+        prefix = c;
+    }
+
+    dict_destroy(dict);
+    *count_out = count;
+
+    return success;
+}
+
+/*
+ * lzw_dictionary_train: Learn a larger table than needed, keep the entries
+ *                       that were matched the most, and renumber them in
+ *                       their original order so that prefixes still come
+ *                       first.
+ */
+
+bool lzw_dictionary_train(size_t max_entries,
+        int (*read_byte)(void* context),
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    size_t const max_codes = ((size_t) 1 << PRESET_MAX_BITS)
+        - LZW_CHAR_RANGE - 1;
+
+    if (read_byte == NULL || write_byte == NULL || max_entries > max_codes) {
+        return false;
+    }
+
+    size_t limit = max_entries * TRAIN_FACTOR;
+
+    if (limit > max_codes || limit / TRAIN_FACTOR != max_entries) {
+        limit = max_codes;
+    }
+
+    struct candidate* candidates = malloc(sizeof(*candidates) * (limit + 1));
+    code_t* renumbered = malloc(sizeof(*renumbered) * (limit + 1));
+
+    if (candidates == NULL || renumbered == NULL) {
+        free(candidates);
+        free(renumbered);
+        return false;
+    }
+
+    size_t count = 0;
+
+    if (!learn(candidates, limit, &count, read_byte, context)) {
+        free(candidates);
+        free(renumbered);
+        return false;
+    }
+
+    if (count > max_entries) {
+        qsort(candidates, count, sizeof(*candidates), by_uses);
+        count = max_entries;
+        qsort(candidates, count, sizeof(*candidates), by_code);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        renumbered[candidates[i].code - LZW_CHAR_RANGE] = LZW_CHAR_RANGE + i;
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+        write_byte(PRESET_MAGIC[i], context);
+    }
+
+    write_u32(count, write_byte, context);
+
+    for (size_t i = 0; i < count; ++i) {
+        code_t prefix = candidates[i].key >> 8;
+
+        if (prefix >= LZW_CHAR_RANGE) {
+            prefix = renumbered[prefix - LZW_CHAR_RANGE];
+        }
+
+        write_u32(((uint32_t) prefix << 8) | (candidates[i].key & 0xFF),
+                  write_byte, context);
+    }
+
+    free(candidates);
+    free(renumbered);
+
+    return true;
+}
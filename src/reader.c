@@ -0,0 +1,279 @@
+// fopencookie() is a GNU extension
+#define _GNU_SOURCE
+
+#include "lzw.h"
+#include "decoder.h"
+#include "checkpoint.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+
+struct lzw_reader {
+    struct decoder* dec;
+    enum decoder_status status;
+
+    // the most recently decoded string and how much of it has been read
+    unsigned char const* string;
+    size_t length;
+    size_t position;
+};
+
+/*
+ * create_reader: Wrap a reader around a decoder, which it takes over.
+ */
+
+static struct lzw_reader* create_reader(struct decoder* dec)
+{
+    struct lzw_reader* reader = malloc(sizeof(*reader));
+
+    if (reader == NULL) {
+        decoder_destroy(dec);
+        return NULL;
+    }
+
+    reader->dec = dec;
+    reader->status = DECODER_OK;
+    reader->string = NULL;
+    reader->length = 0;
+    reader->position = 0;
+
+    return reader;
+}
+
+/*
+ * lzw_reader_open: Initialize a reader that decodes the bytes read via
+ *                  read_byte on demand.
+ */
+
+struct lzw_reader* lzw_reader_open(unsigned int start_bits,
+        unsigned int max_bits,
+        int (*read_byte)(void* context),
+        void* context)
+{
+    if (start_bits < LZW_MINIMUM_BITS || max_bits > LZW_MAXIMUM_BITS
+            || read_byte == NULL) {
+        return NULL;
+    }
+
+    struct decoder* dec = decoder_init(start_bits, max_bits, read_byte,
+                                       context);
+
+    return (dec != NULL) ? create_reader(dec) : NULL;
+}
+
+/*
+ * lzw_reader_close: Free the structure allocated by lzw_reader_open().
+ */
+
+void lzw_reader_close(struct lzw_reader* reader)
+{
+    if (reader == NULL) {
+        return;
+    }
+
+    decoder_destroy(reader->dec);
+    free(reader);
+}
+
+/*
+ * lzw_reader_read: Copy out the rest of the current string, then decode
+ *                  more strings until length bytes have been copied or the
+ *                  input ends.
+ */
+
+size_t lzw_reader_read(struct lzw_reader* reader, void* buffer, size_t length)
+{
+    unsigned char* out = buffer;
+    size_t done = 0;
+
+    while (done < length) {
+        if (reader->position == reader->length) {
+            if (reader->status != DECODER_OK) {
+                break;
+            }
+
+            reader->status = decoder_next(reader->dec, &reader->string,
+                                          &reader->length);
+            reader->position = 0;
+
+            if (reader->status != DECODER_OK) {
+                reader->length = 0;
+                break;
+            }
+        }
+
+        size_t chunk = reader->length - reader->position;
+
+        if (chunk > length - done) {
+            chunk = length - done;
+        }
+
+        memcpy(out + done, reader->string + reader->position, chunk);
+        reader->position += chunk;
+        done += chunk;
+    }
+
+    return done;
+}
+
+/*
+ * lzw_reader_error: Check if decoding has failed.
+ */
+
+bool lzw_reader_error(struct lzw_reader const* reader)
+{
+    return reader->status == DECODER_ERROR;
+}
+
+/*
+ * lzw_reader_checkpoint: Write the decoder's state followed by how much of
+ *                        the current string has been read. The string
+ *                        itself is expanded again on resuming.
+ */
+
+bool lzw_reader_checkpoint(struct lzw_reader const* reader,
+        void (*write_byte)(unsigned char c, void* context),
+        void* context)
+{
+    if (reader->status != DECODER_OK || write_byte == NULL) {
+        return false;
+    }
+
+    struct checkpoint_writer w = { write_byte, context };
+
+    if (!decoder_checkpoint(reader->dec, &w)) {
+        return false;
+    }
+
+    checkpoint_put(&w, reader->position, 4);
+    return true;
+}
+
+/*
+ * lzw_reader_resume: Create a reader from the state in a checkpoint.
+ */
+
+struct lzw_reader* lzw_reader_resume(int (*read_checkpoint)(void* context),
+        void* checkpoint,
+        int (*read_byte)(void* context),
+        void* context)
+{
+    if (read_checkpoint == NULL || read_byte == NULL) {
+        return NULL;
+    }
+
+    struct checkpoint_reader r = { read_checkpoint, checkpoint, false };
+    struct decoder* dec = decoder_resume(&r, read_byte, context);
+
+    if (dec == NULL) {
+        return NULL;
+    }
+
+    size_t const position = checkpoint_get(&r, 4);
+    struct lzw_reader* reader = create_reader(dec);
+
+    if (reader == NULL) {
+        return NULL;
+    }
+
+    if (r.failed
+            || !decoder_current(dec, &reader->string, &reader->length)
+            || position > reader->length) {
+        lzw_reader_close(reader);
+        return NULL;
+    }
+
+    reader->position = position;
+    return reader;
+}
+
+#ifdef __linux__
+
+/*
+ * The state behind a FILE returned by lzw_fopen(): the compressed file and
+ * the reader decoding it.
+ */
+
+struct cookie {
+    FILE* file;
+    struct lzw_reader* reader;
+};
+
+static int read_file(void* context)
+{
+    return getc((FILE*) context);
+}
+
+static ssize_t cookie_read(void* c, char* buffer, size_t size)
+{
+    struct cookie* cookie = c;
+    size_t const n = lzw_reader_read(cookie->reader, buffer, size);
+
+    if (n == 0 && (lzw_reader_error(cookie->reader)
+                || ferror(cookie->file))) {
+        return -1;
+    }
+
+    return n;
+}
+
+static int cookie_close(void* c)
+{
+    struct cookie* cookie = c;
+    int const result = fclose(cookie->file);
+
+    lzw_reader_close(cookie->reader);
+    free(cookie);
+
+    return result;
+}
+
+/*
+ * lzw_fopen: Open the compressed file at path for reading its decoded
+ *            contents through stdio.
+ */
+
+FILE* lzw_fopen(char const* path, unsigned int start_bits,
+        unsigned int max_bits)
+{
+    struct cookie* cookie = malloc(sizeof(*cookie));
+
+    if (cookie == NULL) {
+        return NULL;
+    }
+
+    cookie->file = fopen(path, "rb");
+
+    if (cookie->file == NULL) {
+        free(cookie);
+        return NULL;
+    }
+
+    cookie->reader = lzw_reader_open(start_bits, max_bits, read_file,
+                                     cookie->file);
+
+    cookie_io_functions_t const io = {
+        .read = cookie_read,
+        .write = NULL,
+        .seek = NULL,
+        .close = cookie_close
+    };
+
+    FILE* stream = (cookie->reader != NULL) ?
+        fopencookie(cookie, "r", io) :
+        NULL;
+
+    if (stream == NULL) {
+        lzw_reader_close(cookie->reader);
+        fclose(cookie->file);
+        free(cookie);
+    }
+
+    return stream;
+}
+
+#endif
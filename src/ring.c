@@ -0,0 +1,164 @@
+#include "ring.h"
+
+#include <stdlib.h>
+
+#include <sched.h>
+
+/*
+ * The head and tail counters only ever increase; a block's slot is its
+ * counter modulo the block count. The producer owns head and the consumer
+ * owns tail, so each is written by a single thread and read by the other.
+ * Release stores on one side pair with acquire loads on the other, which
+ * makes the block contents visible before the counter that hands them over.
+ */
+
+struct ring {
+    unsigned char* data;
+    size_t* lengths;
+
+    size_t block_count;
+    size_t block_size;
+
+    size_t head;
+    size_t tail;
+    int closed;
+};
+
+#define LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+
+/*
+ * ring_init: Initialize a ring of block_count blocks of block_size bytes.
+ */
+
+struct ring* ring_init(size_t block_count, size_t block_size)
+{
+    if (block_count == 0 || block_size == 0) {
+        return NULL;
+    }
+
+    struct ring* ring = malloc(sizeof(*ring));
+
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->data = malloc(block_count * block_size);
+    ring->lengths = malloc(sizeof(*ring->lengths) * block_count);
+
+    if (ring->data == NULL || ring->lengths == NULL) {
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    ring->block_count = block_count;
+    ring->block_size = block_size;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->closed = 0;
+
+    return ring;
+}
+
+/*
+ * ring_destroy: Free the structure allocated by ring_init(). Neither side
+ *               may be using the ring anymore.
+ */
+
+void ring_destroy(struct ring* ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+
+    free(ring->data);
+    free(ring->lengths);
+    free(ring);
+}
+
+/*
+ * ring_block_size: Get the capacity of each block in bytes.
+ */
+
+size_t ring_block_size(struct ring const* ring)
+{
+    return ring->block_size;
+}
+
+/*
+ * ring_acquire: Wait until the block at the head is free.
+ */
+
+unsigned char* ring_acquire(struct ring* ring)
+{
+    size_t const head = ring->head;
+
+    while (head - LOAD(&ring->tail) == ring->block_count) {
+        if (LOAD(&ring->closed)) {
+            return NULL;
+        }
+
+        sched_yield();
+    }
+
+    if (LOAD(&ring->closed)) {
+        return NULL;
+    }
+
+    return ring->data + (head % ring->block_count) * ring->block_size;
+}
+
+/*
+ * ring_publish: Make the block at the head visible to the consumer.
+ */
+
+void ring_publish(struct ring* ring, size_t length)
+{
+    ring->lengths[ring->head % ring->block_count] = length;
+    STORE(&ring->head, ring->head + 1);
+}
+
+/*
+ * ring_peek: Wait until the block at the tail has been published.
+ */
+
+unsigned char const* ring_peek(struct ring* ring, size_t* length)
+{
+    size_t const tail = ring->tail;
+
+    while (LOAD(&ring->head) == tail) {
+        if (LOAD(&ring->closed)) {
+            // the producer may have published just before closing
+            if (LOAD(&ring->head) != tail) {
+                break;
+            }
+
+            return NULL;
+        }
+
+        sched_yield();
+    }
+
+    size_t const slot = tail % ring->block_count;
+
+    *length = ring->lengths[slot];
+    return ring->data + slot * ring->block_size;
+}
+
+/*
+ * ring_release: Hand the block at the tail back to the producer.
+ */
+
+void ring_release(struct ring* ring)
+{
+    STORE(&ring->tail, ring->tail + 1);
+}
+
+/*
+ * ring_close: Mark the ring as closed.
+ */
+
+void ring_close(struct ring* ring)
+{
+    STORE(&ring->closed, 1);
+}
@@ -0,0 +1,142 @@
+// mmap() and madvise() are outside of C99
+#define _DEFAULT_SOURCE
+
+#include "table.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+
+// tables this large or more are mapped, in whole huge pages
+#define HUGE_PAGE_SIZE ((size_t) 1 << 21)
+
+// asks for reserved huge pages of HUGE_PAGE_SIZE rather than the default
+// size, which may be larger
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_PAGES (MAP_HUGETLB | (21 << MAP_HUGE_SHIFT))
+#endif
+
+/*
+ * is_mapped: Tell whether a table of the given size is mapped.
+ */
+
+static bool is_mapped(size_t size)
+{
+    return size >= HUGE_PAGE_SIZE;
+}
+
+/*
+ * mapped_size: Round a size up to a whole number of huge pages.
+ */
+
+static size_t mapped_size(size_t size)
+{
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/*
+ * map_table: Map a table from the reserved huge pages, or failing that,
+ *            from ordinary pages that the kernel is asked to back with
+ *            transparent huge pages. The advice is only a hint, so it's
+ *            fine for it to fail.
+ */
+
+static void* map_table(size_t size)
+{
+    size_t const length = mapped_size(size);
+    void* table;
+
+#ifdef MAP_HUGE_PAGES
+    table = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGE_PAGES, -1, 0);
+
+    if (table != MAP_FAILED) {
+        return table;
+    }
+#endif
+
+    table = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        return NULL;
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(table, length, MADV_HUGEPAGE);
+#endif
+
+    return table;
+}
+
+#else
+
+static bool is_mapped(size_t size)
+{
+    (void) size;
+    return false;
+}
+
+#endif
+
+/*
+ * table_alloc: Allocate an uninitialized table of size bytes.
+ */
+
+void* table_alloc(size_t size)
+{
+#ifdef __linux__
+    if (is_mapped(size)) {
+        return map_table(size);
+    }
+#endif
+
+    return malloc(size);
+}
+
+/*
+ * table_free: Free a table allocated by table_alloc() or table_resize().
+ */
+
+void table_free(void* table, size_t size)
+{
+    if (table == NULL) {
+        return;
+    }
+
+#ifdef __linux__
+    if (is_mapped(size)) {
+        munmap(table, mapped_size(size));
+        return;
+    }
+#endif
+
+    free(table);
+}
+
+/*
+ * table_resize: Let realloc() move tables that stay small. A mapped table
+ *               is copied into a new mapping instead, which the doubling
+ *               of every table here makes up for.
+ */
+
+void* table_resize(void* table, size_t old_size, size_t new_size)
+{
+    if (!is_mapped(old_size) && !is_mapped(new_size)) {
+        return realloc(table, new_size);
+    }
+
+    void* new_table = table_alloc(new_size);
+
+    if (new_table == NULL) {
+        return NULL;
+    }
+
+    memcpy(new_table, table, (old_size < new_size) ? old_size : new_size);
+    table_free(table, old_size);
+
+    return new_table;
+}
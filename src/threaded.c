@@ -0,0 +1,400 @@
+#include "lzw.h"
+#include "encoder.h"
+#include "decoder.h"
+#include "codewidth.h"
+#include "instream.h"
+#include "outstream.h"
+#include "ring.h"
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#define QUEUE_BLOCKS 8
+#define QUEUE_BLOCK_CODES 4096
+#define READ_BLOCK_SIZE 4096
+
+/*
+ * A code as it's passed between the two threads.
+ */
+
+struct coded {
+    code_t code;
+    unsigned int bits;
+};
+
+/*
+ * One end of a ring of coded blocks, along with the thread's position in
+ * its current block.
+ */
+
+struct code_queue {
+    struct ring* ring;
+    struct coded* block;
+    size_t length;
+    size_t position;
+};
+
+/*
+ * Everything the packing or unpacking thread needs.
+ */
+
+struct worker {
+    struct code_queue queue;
+    struct codewidth cw;
+
+    int (*read_byte)(void* context);
+    void (*write_byte)(unsigned char c, void* context);
+    void* context;
+
+    bool success;
+};
+
+/*
+ * queue_init: Set up both ends of a queue around a new ring.
+ */
+
+static bool queue_init(struct code_queue* producer, struct code_queue* consumer)
+{
+    struct ring* ring = ring_init(QUEUE_BLOCKS,
+                                  QUEUE_BLOCK_CODES * sizeof(struct coded));
+
+    producer->ring = ring;
+    producer->block = NULL;
+    producer->length = 0;
+    producer->position = 0;
+    *consumer = *producer;
+
+    return ring != NULL;
+}
+
+/*
+ * queue_push: Add a code to the producer's block, publishing it when full.
+ *             Returns false if the consumer has stopped.
+ */
+
+static bool queue_push(struct code_queue* queue, code_t code,
+        unsigned int bits)
+{
+    if (queue->block == NULL) {
+        queue->block = (struct coded*) ring_acquire(queue->ring);
+        queue->length = 0;
+
+        if (queue->block == NULL) {
+            return false;
+        }
+    }
+
+    queue->block[queue->length].code = code;
+    queue->block[queue->length].bits = bits;
+    ++queue->length;
+
+    if (queue->length == QUEUE_BLOCK_CODES) {
+        ring_publish(queue->ring, queue->length * sizeof(struct coded));
+        queue->block = NULL;
+    }
+
+    return true;
+}
+
+/*
+ * queue_close: Publish the producer's partial block and close the ring.
+ */
+
+static void queue_close(struct code_queue* queue)
+{
+    if (queue->block != NULL) {
+        ring_publish(queue->ring, queue->length * sizeof(struct coded));
+        queue->block = NULL;
+    }
+
+    ring_close(queue->ring);
+}
+
+/*
+ * queue_pop: Take the next code from the consumer's block, moving on to the
+ *            next block as needed. Returns NULL once the queue is drained.
+ */
+
+static struct coded const* queue_pop(struct code_queue* queue)
+{
+    if (queue->position == queue->length) {
+        if (queue->block != NULL) {
+            ring_release(queue->ring);
+        }
+
+        size_t bytes = 0;
+        queue->block = (struct coded*) ring_peek(queue->ring, &bytes);
+        queue->length = bytes / sizeof(struct coded);
+        queue->position = 0;
+
+        if (queue->block == NULL) {
+            return NULL;
+        }
+
+        if (queue->length == 0) {
+            return queue_pop(queue);
+        }
+    }
+
+    return &queue->block[queue->position++];
+}
+
+/*
+ * pack_codes: Body of the packing thread: pack the queued codes into bytes
+ *             and write them out.
+ */
+
+static void* pack_codes(void* arg)
+{
+    struct worker* w = arg;
+    struct outstream* outs = outs_init(w->context, w->write_byte);
+    struct coded const* coded;
+
+    if (outs == NULL) {
+        w->success = false;
+        ring_close(w->queue.ring);
+
+        return NULL;
+    }
+
+    while ((coded = queue_pop(&w->queue)) != NULL) {
+        outs_write_bits(outs, coded->code, coded->bits);
+    }
+
+    outs_destroy(outs);
+    return NULL;
+}
+
+/*
+ * push_code: Encoder sink that queues codes for the packing thread.
+ */
+
+static void push_code(void* sink, code_t code, unsigned int bits)
+{
+    struct worker* w = sink;
+
+    if (!queue_push(&w->queue, code, bits)) {
+        w->success = false;
+    }
+}
+
+/*
+ * match_input: Run the encoder over the input on the calling thread.
+ */
+
+static bool match_input(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*), void* context, struct worker* sink)
+{
+    struct lzw_encoder* enc = encoder_init_sink(start_bits, max_bits,
+                                                push_code, sink);
+
+    if (enc == NULL) {
+        return false;
+    }
+
+    unsigned char buffer[READ_BLOCK_SIZE];
+    bool success = true;
+    int next = 0;
+
+    while (success && next != EOF) {
+        size_t length = 0;
+
+        while (length < sizeof(buffer)
+                && (next = read_byte(context)) != EOF) {
+            buffer[length++] = next;
+        }
+
+        success = lzw_encoder_write(enc, buffer, length) && sink->success;
+    }
+
+    success = success && lzw_encoder_finish(enc) && sink->success;
+    lzw_encoder_destroy(enc);
+
+    return success;
+}
+
+/*
+ * lzw_encode_threaded: Same as lzw_encode(), but with the bit packing and
+ *                      writing done on a second thread.
+ */
+
+bool lzw_encode_threaded(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (read_byte == NULL || write_byte == NULL) {
+        return false;
+    }
+
+    struct worker producer;
+    struct worker packer;
+    pthread_t thread;
+
+    producer.success = true;
+    packer.write_byte = write_byte;
+    packer.context = context;
+    packer.success = true;
+
+    if (!queue_init(&producer.queue, &packer.queue)) {
+        return false;
+    }
+
+    if (pthread_create(&thread, NULL, pack_codes, &packer) != 0) {
+        ring_destroy(producer.queue.ring);
+        return false;
+    }
+
+    bool const success = match_input(start_bits, max_bits, read_byte,
+                                     context, &producer);
+
+    queue_close(&producer.queue);
+    pthread_join(thread, NULL);
+    ring_destroy(producer.queue.ring);
+
+    return success && packer.success;
+}
+
+/*
+ * unpack_codes: Body of the unpacking thread: read the input and split it
+ *               into codes, tracking the code width the same way the
+ *               decoder does.
+ */
+
+static void* unpack_codes(void* arg)
+{
+    struct worker* w = arg;
+    struct instream* ins = ins_init(w->context, w->read_byte);
+    bool first = true;
+    code_t code;
+
+    if (ins == NULL) {
+        w->success = false;
+        ring_close(w->queue.ring);
+
+        return NULL;
+    }
+
+    while ((code = ins_read_bits(ins, w->cw.cur_bits)) != EOF) {
+        // sync flush markers and their padding never reach the decoder
+        if (!first && code == cw_sync_marker(&w->cw)) {
+            ins_align(ins);
+            continue;
+        }
+
+        first = false;
+
+        if (!queue_push(&w->queue, code, w->cw.cur_bits)) {
+            // the decoder gave up
+            break;
+        }
+
+        cw_advance(&w->cw);
+    }
+
+    queue_close(&w->queue);
+    ins_destroy(ins);
+
+    return NULL;
+}
+
+/*
+ * pop_code: Decoder source that takes codes from the unpacking thread.
+ *           A width mismatch means the two threads disagree about the
+ *           stream, which is reported as the end of the input.
+ */
+
+static code_t pop_code(void* source, unsigned int bits)
+{
+    struct worker* w = source;
+    struct coded const* coded = queue_pop(&w->queue);
+
+    if (coded == NULL) {
+        return EOF;
+    }
+
+    if (coded->bits != bits) {
+        w->success = false;
+        return EOF;
+    }
+
+    return coded->code;
+}
+
+/*
+ * expand_codes: Run the decoder over the queued codes on the calling thread.
+ */
+
+static bool expand_codes(unsigned int start_bits, unsigned int max_bits,
+        void (*write_byte)(unsigned char, void*), void* context,
+        struct worker* source)
+{
+    struct decoder* dec = decoder_init_source(start_bits, max_bits,
+                                              pop_code, source);
+
+    if (dec == NULL) {
+        return false;
+    }
+
+    enum decoder_status status;
+    unsigned char const* string;
+    size_t length;
+
+    while ((status = decoder_next(dec, &string, &length)) == DECODER_OK) {
+        for (size_t i = 0; i < length; ++i) {
+            write_byte(string[i], context);
+        }
+    }
+
+    decoder_destroy(dec);
+    return status == DECODER_EOF && source->success;
+}
+
+/*
+ * lzw_decode_threaded: Same as lzw_decode(), but with the reading and bit
+ *                      unpacking done on a second thread.
+ */
+
+bool lzw_decode_threaded(unsigned int start_bits, unsigned int max_bits,
+        int (*read_byte)(void*),
+        void (*write_byte)(unsigned char, void*),
+        void* context)
+{
+    if (start_bits < LZW_MINIMUM_BITS || max_bits > LZW_MAXIMUM_BITS
+            || read_byte == NULL || write_byte == NULL) {
+        return false;
+    }
+
+    struct worker unpacker;
+    struct worker consumer;
+    pthread_t thread;
+
+    unpacker.read_byte = read_byte;
+    unpacker.context = context;
+    unpacker.success = true;
+    cw_init(&unpacker.cw, start_bits, max_bits);
+    consumer.success = true;
+
+    if (!queue_init(&unpacker.queue, &consumer.queue)) {
+        return false;
+    }
+
+    if (pthread_create(&thread, NULL, unpack_codes, &unpacker) != 0) {
+        ring_destroy(unpacker.queue.ring);
+        return false;
+    }
+
+    bool const success = expand_codes(start_bits, max_bits, write_byte,
+                                      context, &consumer);
+
+    // stop the unpacker if decoding ended early
+    ring_close(consumer.queue.ring);
+    pthread_join(thread, NULL);
+    ring_destroy(unpacker.queue.ring);
+
+    return success && unpacker.success;
+}
@@ -0,0 +1,654 @@
+// syscall() and the io_uring definitions are outside of POSIX
+#define _DEFAULT_SOURCE
+
+#include "uring.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define IO_BLOCK_SIZE (256 * 1024)
+#define BLOCK_ALIGNMENT 4096
+#define READ_SLOTS 4
+#define WRITE_SLOTS 4
+#define QUEUE_DEPTH (READ_SLOTS + WRITE_SLOTS)
+
+// user_data of a write request, or'd with the slot index
+#define WRITE_TAG 0x100
+
+/*
+ * A buffer along with the request that fills or drains it. Requests on
+ * files carry explicit offsets, so short transfers can be resumed without
+ * disturbing the order of the blocks. Pipes and the like read or write at
+ * their current position, so only one request may be in flight on them,
+ * though another buffer can still be filled or consumed meanwhile.
+ */
+
+struct slot {
+    unsigned char* data;
+    size_t length;
+    size_t done;
+    uint64_t offset;
+    bool busy;
+};
+
+struct uring_io {
+    int ring_fd;
+
+    // submission queue
+    void* sq_map;
+    size_t sq_map_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    // completion queue, which may share the submission queue's mapping
+    void* cq_map;
+    size_t cq_map_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    int in_fd;
+    bool in_seekable;
+    struct slot reads[READ_SLOTS];
+    unsigned read_slots;
+    unsigned next_read;
+    uint64_t read_offset;
+    bool read_eof;
+
+    // the block being handed out by uring_io_read_byte()
+    struct slot* current;
+    size_t position;
+
+    int out_fd;
+    bool out_seekable;
+    struct slot writes[WRITE_SLOTS];
+    struct slot* filling;
+    uint64_t write_offset;
+
+    bool ok;
+};
+
+#define LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+
+/*
+ * is_seekable: Check if a descriptor refers to a regular file, which can be
+ *              read or written at explicit offsets.
+ */
+
+static bool is_seekable(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/*
+ * map_rings: Set up an io_uring instance and map its queues.
+ */
+
+static bool map_rings(struct uring_io* io)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    io->ring_fd = syscall(__NR_io_uring_setup, QUEUE_DEPTH, &p);
+
+    if (io->ring_fd < 0) {
+        return false;
+    }
+
+    io->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    io->cq_map_size = p.cq_off.cqes
+        + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_map_size > io->sq_map_size) {
+            io->sq_map_size = io->cq_map_size;
+        }
+    }
+
+    io->sq_map = mmap(NULL, io->sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, io->ring_fd,
+                      IORING_OFF_SQ_RING);
+
+    if (io->sq_map == MAP_FAILED) {
+        io->sq_map = NULL;
+        return false;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        io->cq_map = io->sq_map;
+    } else {
+        io->cq_map = mmap(NULL, io->cq_map_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, io->ring_fd,
+                          IORING_OFF_CQ_RING);
+
+        if (io->cq_map == MAP_FAILED) {
+            io->cq_map = NULL;
+            return false;
+        }
+    }
+
+    io->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_SQES);
+
+    if (io->sqes == MAP_FAILED) {
+        io->sqes = NULL;
+        return false;
+    }
+
+    unsigned char* const sq = io->sq_map;
+    unsigned char* const cq = io->cq_map;
+
+    io->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    io->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+    io->sq_array = (unsigned*) (sq + p.sq_off.array);
+    io->cq_head = (unsigned*) (cq + p.cq_off.head);
+    io->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    io->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+    return true;
+}
+
+/*
+ * unmap_rings: Undo map_rings(), however far it got.
+ */
+
+static void unmap_rings(struct uring_io* io)
+{
+    if (io->sqes != NULL) {
+        munmap(io->sqes, io->sqes_size);
+    }
+
+    if (io->cq_map != NULL && io->cq_map != io->sq_map) {
+        munmap(io->cq_map, io->cq_map_size);
+    }
+
+    if (io->sq_map != NULL) {
+        munmap(io->sq_map, io->sq_map_size);
+    }
+
+    if (io->ring_fd >= 0) {
+        close(io->ring_fd);
+    }
+}
+
+/*
+ * submit: Queue a read or write of the unfinished part of a slot and hand
+ *         it to the kernel.
+ */
+
+static void submit(struct uring_io* io, struct slot* slot, bool is_write)
+{
+    unsigned const tail = *io->sq_tail;
+    unsigned const index = tail & *io->sq_mask;
+    struct io_uring_sqe* const sqe = &io->sqes[index];
+    bool const seekable = is_write ? io->out_seekable : io->in_seekable;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = is_write ? io->out_fd : io->in_fd;
+    sqe->addr = (uintptr_t) (slot->data + slot->done);
+    sqe->len = slot->length - slot->done;
+    sqe->off = seekable ? slot->offset + slot->done : (uint64_t) -1;
+    sqe->user_data = is_write ?
+        (WRITE_TAG | (uint64_t) (slot - io->writes)) :
+        (uint64_t) (slot - io->reads);
+
+    io->sq_array[index] = index;
+    STORE(io->sq_tail, tail + 1);
+    slot->busy = true;
+
+    while (syscall(__NR_io_uring_enter, io->ring_fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR) {
+            // the request can't be made, so report it as failed
+            io->ok = false;
+            slot->busy = false;
+            return;
+        }
+    }
+}
+
+/*
+ * complete_read: Handle the result of a read. Short reads from a file are
+ *                resumed, since the next slot is already reading the data
+ *                that follows this one.
+ */
+
+static void complete_read(struct uring_io* io, struct slot* slot, int res)
+{
+    if (res == -EINTR || res == -EAGAIN) {
+        submit(io, slot, false);
+        return;
+    }
+
+    slot->busy = false;
+
+    if (res < 0) {
+        io->ok = false;
+        return;
+    }
+
+    slot->done += res;
+
+    if (res > 0 && io->in_seekable && slot->done < slot->length) {
+        submit(io, slot, false);
+    }
+}
+
+/*
+ * complete_write: Handle the result of a write, resuming short writes.
+ */
+
+static void complete_write(struct uring_io* io, struct slot* slot, int res)
+{
+    if (res == -EINTR || res == -EAGAIN) {
+        submit(io, slot, true);
+        return;
+    }
+
+    slot->busy = false;
+
+    if (res <= 0) {
+        io->ok = false;
+        return;
+    }
+
+    slot->done += res;
+
+    if (slot->done < slot->length) {
+        submit(io, slot, true);
+    }
+}
+
+/*
+ * reap: Wait for at least one request to complete and handle every
+ *       completion that has arrived.
+ */
+
+static void reap(struct uring_io* io)
+{
+    unsigned head = *io->cq_head;
+
+    while (head == LOAD(io->cq_tail)) {
+        long const n = syscall(__NR_io_uring_enter, io->ring_fd, 0, 1,
+                               IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if (n < 0 && errno != EINTR) {
+            io->ok = false;
+            return;
+        }
+    }
+
+    while (head != LOAD(io->cq_tail)) {
+        struct io_uring_cqe const cqe = io->cqes[head & *io->cq_mask];
+
+        STORE(io->cq_head, ++head);
+
+        if (cqe.user_data & WRITE_TAG) {
+            complete_write(io, &io->writes[cqe.user_data & ~WRITE_TAG],
+                           cqe.res);
+        } else {
+            complete_read(io, &io->reads[cqe.user_data], cqe.res);
+        }
+
+        head = *io->cq_head;
+    }
+}
+
+/*
+ * start_read: Start reading the block that follows the last one requested.
+ */
+
+static void start_read(struct uring_io* io, struct slot* slot)
+{
+    slot->length = IO_BLOCK_SIZE;
+    slot->done = 0;
+    slot->offset = io->read_offset;
+    io->read_offset += IO_BLOCK_SIZE;
+
+    submit(io, slot, false);
+}
+
+/*
+ * start_write: Start writing out a filled slot. Without offsets, writes
+ *              have to go one at a time to keep them in order.
+ */
+
+static void start_write(struct uring_io* io, struct slot* slot)
+{
+    if (!io->out_seekable) {
+        for (size_t i = 0; i < WRITE_SLOTS; ++i) {
+            while (io->ok && io->writes[i].busy) {
+                reap(io);
+            }
+        }
+    }
+
+    slot->done = 0;
+    slot->offset = io->write_offset;
+    io->write_offset += slot->length;
+
+    submit(io, slot, true);
+}
+
+/*
+ * free_slot: Find a write slot that isn't in use, waiting for one if
+ *            needed. Returns NULL if waiting failed.
+ */
+
+static struct slot* free_slot(struct uring_io* io)
+{
+    while (io->ok) {
+        for (size_t i = 0; i < WRITE_SLOTS; ++i) {
+            if (!io->writes[i].busy && &io->writes[i] != io->filling) {
+                return &io->writes[i];
+            }
+        }
+
+        reap(io);
+    }
+
+    return NULL;
+}
+
+/*
+ * drain: Wait until no requests are in flight.
+ */
+
+static void drain(struct uring_io* io)
+{
+    for (size_t i = 0; i < READ_SLOTS; ++i) {
+        while (io->ok && io->reads[i].busy) {
+            reap(io);
+        }
+    }
+
+    for (size_t i = 0; i < WRITE_SLOTS; ++i) {
+        while (io->ok && io->writes[i].busy) {
+            reap(io);
+        }
+    }
+}
+
+/*
+ * destroy: Free everything, assuming nothing is in flight.
+ */
+
+static void destroy(struct uring_io* io)
+{
+    unmap_rings(io);
+
+    for (size_t i = 0; i < READ_SLOTS; ++i) {
+        free(io->reads[i].data);
+    }
+
+    for (size_t i = 0; i < WRITE_SLOTS; ++i) {
+        free(io->writes[i].data);
+    }
+
+    free(io);
+}
+
+/*
+ * alloc_slots: Allocate aligned buffers for a set of slots.
+ */
+
+static bool alloc_slots(struct slot* slots, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        void* data;
+
+        if (posix_memalign(&data, BLOCK_ALIGNMENT, IO_BLOCK_SIZE) != 0) {
+            return false;
+        }
+
+        slots[i].data = data;
+    }
+
+    return true;
+}
+
+/*
+ * uring_io_init: Set up the ring and start the first reads.
+ */
+
+struct uring_io* uring_io_init(int in_fd, int out_fd)
+{
+    struct uring_io* io = calloc(1, sizeof(*io));
+
+    if (io == NULL) {
+        return NULL;
+    }
+
+    io->ring_fd = -1;
+
+    if (!map_rings(io) || !alloc_slots(io->reads, READ_SLOTS)
+            || !alloc_slots(io->writes, WRITE_SLOTS)) {
+        destroy(io);
+        return NULL;
+    }
+
+    io->in_fd = in_fd;
+    io->in_seekable = is_seekable(in_fd);
+    io->read_slots = io->in_seekable ? READ_SLOTS : 2;
+    io->out_fd = out_fd;
+    io->out_seekable = is_seekable(out_fd);
+    io->ok = true;
+
+    // appending writes ignore the offset, so they can't be reordered safely
+    if (io->out_seekable && (fcntl(out_fd, F_GETFL) & O_APPEND)) {
+        io->out_seekable = false;
+    }
+
+    if (io->out_seekable) {
+        off_t const start = lseek(out_fd, 0, SEEK_CUR);
+        io->write_offset = (start > 0) ? start : 0;
+    }
+
+    if (io->in_seekable) {
+        off_t const start = lseek(in_fd, 0, SEEK_CUR);
+        io->read_offset = (start > 0) ? start : 0;
+    }
+
+    for (size_t i = 0; i < io->read_slots && io->ok; ++i) {
+        start_read(io, &io->reads[i]);
+
+        if (!io->in_seekable) {
+            break;
+        }
+    }
+
+    if (!io->ok) {
+        drain(io);
+        destroy(io);
+        return NULL;
+    }
+
+    return io;
+}
+
+/*
+ * uring_io_finish: Flush the partly filled block and wait for everything.
+ */
+
+bool uring_io_finish(struct uring_io* io)
+{
+    if (io->filling != NULL && io->filling->length > 0 && io->ok) {
+        start_write(io, io->filling);
+    }
+
+    // outstanding reads own their buffers until they complete, so wait for
+    // them even if something has already failed
+    bool const ok = io->ok;
+    io->ok = true;
+    drain(io);
+
+    bool const success = ok && io->ok;
+    destroy(io);
+
+    return success;
+}
+
+/*
+ * uring_io_next_block: Recycle the previous block for a read further ahead
+ *                      and wait for the next one. Without offsets, the
+ *                      following read can only start once this one is done.
+ */
+
+size_t uring_io_next_block(struct uring_io* io, unsigned char const** block)
+{
+    if (io->current != NULL) {
+        if (io->in_seekable && !io->read_eof && io->ok) {
+            start_read(io, io->current);
+        }
+
+        io->next_read = (io->next_read + 1) % io->read_slots;
+        io->current = NULL;
+    }
+
+    if (io->read_eof || !io->ok) {
+        return 0;
+    }
+
+    struct slot* const slot = &io->reads[io->next_read];
+
+    while (io->ok && slot->busy) {
+        reap(io);
+    }
+
+    if (!io->ok || slot->done == 0) {
+        io->read_eof = true;
+        return 0;
+    }
+
+    if (!io->in_seekable) {
+        start_read(io, &io->reads[(io->next_read + 1) % io->read_slots]);
+    }
+
+    io->current = slot;
+    io->position = slot->done;
+    *block = slot->data;
+
+    return slot->done;
+}
+
+/*
+ * uring_io_read_byte: Return the next input byte, or EOF.
+ */
+
+int uring_io_read_byte(void* context)
+{
+    struct uring_io* io = context;
+
+    if (io->current == NULL || io->position == io->current->done) {
+        unsigned char const* block;
+
+        if (uring_io_next_block(io, &block) == 0) {
+            return EOF;
+        }
+
+        io->position = 0;
+    }
+
+    return io->current->data[io->position++];
+}
+
+/*
+ * uring_io_write_byte: Buffer a single output byte, starting the write once
+ *                      the block is full.
+ */
+
+void uring_io_write_byte(unsigned char c, void* context)
+{
+    struct uring_io* io = context;
+
+    if (io->filling == NULL) {
+        io->filling = free_slot(io);
+
+        if (io->filling == NULL) {
+            return;
+        }
+
+        io->filling->length = 0;
+    }
+
+    io->filling->data[io->filling->length++] = c;
+
+    if (io->filling->length == IO_BLOCK_SIZE) {
+        struct slot* const full = io->filling;
+
+        io->filling = NULL;
+        start_write(io, full);
+    }
+}
+
+#else
+
+/*
+ * Without io_uring, uring_io_init() always fails and the caller falls back
+ * to its usual I/O. The remaining functions can't be reached.
+ */
+
+struct uring_io* uring_io_init(int in_fd, int out_fd)
+{
+    (void) in_fd;
+    (void) out_fd;
+
+    return NULL;
+}
+
+bool uring_io_finish(struct uring_io* io)
+{
+    (void) io;
+    return false;
+}
+
+size_t uring_io_next_block(struct uring_io* io, unsigned char const** block)
+{
+    (void) io;
+    (void) block;
+
+    return 0;
+}
+
+int uring_io_read_byte(void* context)
+{
+    (void) context;
+    return EOF;
+}
+
+void uring_io_write_byte(unsigned char c, void* context)
+{
+    (void) c;
+    (void) context;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "dict.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <assert.h>
+
+void test_init(void) {
+    struct dict* dict = dict_init(0);
+    assert(dict != NULL);
+    assert(dict_size(dict) == 0);
+    dict_destroy(dict);
+}
+
+void test_insert(void) {
+    struct dict* dict = dict_init(0);
+
+    assert(dict != NULL);
+
+    assert( dict_insert(dict, 'f', 'o', 256) );
+    assert( dict_insert(dict, 256, 'o', 257) );
+    assert( dict_insert(dict, 'b', 'a', 258) );
+    assert( dict_insert(dict, 0, 0, 259) );
+    assert( dict_insert(dict, 255, 255, 260) );
+
+    assert( !dict_insert(dict, 'f', 'o', 261) );
+    assert( !dict_insert(dict, 0, 0, 262) );
+    assert( dict_size(dict) == 5 );
+
+    dict_destroy(dict);
+}
+
+void test_lookup(void) {
+    struct dict* dict = dict_init(0);
+
+    dict_insert(dict, 'f', 'o', 256);
+    dict_insert(dict, 256, 'o', 257);
+    dict_insert(dict, 255, 255, 258);
+
+    assert( dict_lookup(dict, 'f', 'o') == 256 );
+    assert( dict_lookup(dict, 256, 'o') == 257 );
+    assert( dict_lookup(dict, 255, 255) == 258 );
+
+    assert( dict_lookup(dict, 'o', 'f') == -1 );
+    assert( dict_lookup(dict, 257, 'o') == -1 );
+
+    dict_destroy(dict);
+}
+
+void test_grow(void) {
+    struct dict* dict = dict_init(0);
+    code_t const count = 1 << 16;
+
+    // enough entries to force several rehashes
+    for (code_t i = 0; i < count; ++i) {
+        assert( dict_insert(dict, i, i % 251, i + 256) );
+    }
+
+    for (code_t i = 0; i < count; ++i) {
+        assert( dict_lookup(dict, i, i % 251) == i + 256 );
+        assert( dict_lookup(dict, i, i % 251 + 1) == -1 );
+    }
+
+    assert( dict_size(dict) == (size_t) count );
+    dict_destroy(dict);
+}
+
+void test_clear(void) {
+    struct dict* dict = dict_init(0);
+
+    // large enough for the table to be shrunk rather than cleared
+    for (code_t i = 0; i < 1 << 16; ++i) {
+        assert( dict_insert(dict, i, 'x', i + 256) );
+    }
+
+    assert( dict_lookup(dict, 5, 'x') == 5 + 256 );
+    assert( dict_clear(dict) );
+    assert( dict_size(dict) == 0 );
+    assert( dict_lookup(dict, 5, 'x') == -1 );
+
+    assert( dict_insert(dict, 5, 'x', 300) );
+    assert( dict_lookup(dict, 5, 'x') == 300 );
+    assert( dict_clear(dict) );
+    assert( dict_lookup(dict, 5, 'x') == -1 );
+
+    dict_destroy(dict);
+}
+
+void test_remove(void) {
+    struct dict* dict = dict_init(0);
+    code_t const count = 1 << 12;
+
+    for (code_t i = 0; i < count; ++i) {
+        assert( dict_insert(dict, i, i % 7, i + 256) );
+    }
+
+    assert( dict_lookup(dict, 2, 2) == 258 );
+
+    // removing every other entry must leave the rest reachable, however
+    // their probe sequences overlapped
+    for (code_t i = 0; i < count; i += 2) {
+        assert( dict_remove(dict, i, i % 7) );
+    }
+
+    assert( !dict_remove(dict, 0, 0) );
+    assert( dict_size(dict) == (size_t) count / 2 );
+
+    for (code_t i = 0; i < count; ++i) {
+        assert( dict_lookup(dict, i, i % 7) == ((i % 2 == 0) ? -1 : i + 256) );
+    }
+
+    // and the freed entries can be added again
+    assert( dict_insert(dict, 0, 0, 300) );
+    assert( dict_lookup(dict, 0, 0) == 300 );
+
+    dict_destroy(dict);
+}
+
+void test_large(void) {
+    struct dict* dict = dict_init(0);
+    code_t const count = 1 << 18;
+
+    // past the size at which the slots are mapped rather than malloc'd
+    for (code_t i = 0; i < count; ++i) {
+        assert( dict_insert(dict, i, 'x', i + 256) );
+    }
+
+    for (code_t i = 0; i < count; ++i) {
+        assert( dict_lookup(dict, i, 'x') == i + 256 );
+    }
+
+#if LZW_MAXIMUM_BITS > 24
+    // prefixes that differ only above bit 24 must not collide
+    code_t const high = (code_t) 1 << 30;
+
+    assert( dict_lookup(dict, high + 5, 'x') == -1 );
+    assert( dict_insert(dict, high + 5, 'x', high) );
+    assert( dict_lookup(dict, high + 5, 'x') == high );
+    assert( dict_lookup(dict, 5, 'x') == 5 + 256 );
+#endif
+
+    assert( dict_clear(dict) );
+    assert( dict_lookup(dict, 5, 'x') == -1 );
+
+    dict_destroy(dict);
+}
+
+int main(void) {
+    test_init();
+    test_insert();
+    test_lookup();
+    test_grow();
+    test_clear();
+    test_remove();
+    test_large();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1339 @@
+#include "lzw.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include <assert.h>
+#include <string.h>
+
+#define INIT_BITS 8
+#define MAX_BITS 16
+
+/*
+ * An in-memory stream: bytes are read from input and written to output.
+ */
+
+struct buffer {
+    unsigned char const* input;
+    size_t input_length;
+    size_t position;
+
+    unsigned char* output;
+    size_t output_length;
+    size_t output_capacity;
+};
+
+static int read_buffer(void* context)
+{
+    struct buffer* buf = context;
+
+    if (buf->position == buf->input_length) {
+        return EOF;
+    }
+
+    return buf->input[buf->position++];
+}
+
+static void write_buffer(unsigned char c, void* context)
+{
+    struct buffer* buf = context;
+
+    if (buf->output_length == buf->output_capacity) {
+        buf->output_capacity = buf->output_capacity * 2 + 64;
+        buf->output = realloc(buf->output, buf->output_capacity);
+        assert(buf->output != NULL);
+    }
+
+    buf->output[buf->output_length++] = c;
+}
+
+static struct buffer make_buffer(unsigned char const* input, size_t length)
+{
+    struct buffer buf = { input, length, 0, NULL, 0, 0 };
+    return buf;
+}
+
+/*
+ * Sample inputs covering text, binary data and long repeats.
+ */
+
+static unsigned char* make_input(size_t length, unsigned int seed)
+{
+    unsigned char* input = malloc(length);
+    assert(input != NULL);
+
+    for (size_t i = 0; i < length; ++i) {
+        seed = seed * 1103515245 + 12345;
+
+        switch (seed % 3) {
+        case 0:
+            input[i] = "the quick brown fox "[i % 20];
+            break;
+        case 1:
+            input[i] = seed >> 16;
+            break;
+        default:
+            input[i] = 0;
+            break;
+        }
+    }
+
+    return input;
+}
+
+static struct buffer encode_bits(unsigned char const* input, size_t length,
+        unsigned int max_bits)
+{
+    struct buffer buf = make_buffer(input, length);
+    bool success = lzw_encode(INIT_BITS, max_bits, read_buffer, write_buffer,
+                              &buf);
+
+    assert(success);
+    return buf;
+}
+
+static struct buffer encode(unsigned char const* input, size_t length)
+{
+    return encode_bits(input, length, MAX_BITS);
+}
+
+/*
+ * check_round_trip: Encode then decode the input, checking that the result
+ *                   matches. Returns the encoded size.
+ */
+
+static size_t check_round_trip(unsigned char const* input, size_t length,
+        unsigned int max_bits)
+{
+    struct buffer encoded = encode_bits(input, length, max_bits);
+    struct buffer decoded = make_buffer(encoded.output, encoded.output_length);
+
+    assert( lzw_decode(INIT_BITS, max_bits, read_buffer, write_buffer,
+                       &decoded) );
+
+    assert(decoded.output_length == length);
+    assert(length == 0 || memcmp(decoded.output, input, length) == 0);
+
+    free(encoded.output);
+    free(decoded.output);
+
+    return encoded.output_length;
+}
+
+/*
+ * write_in_pieces: Write the input to the encoder in pieces of uneven
+ *                  sizes. If synced is given, the encoder is flushed after
+ *                  every piece, and synced, the buffer it writes to, must
+ *                  then decode at max_bits to all the input written so far.
+ */
+
+static void write_in_pieces(struct lzw_encoder* enc,
+        unsigned char const* input, size_t length,
+        struct buffer const* synced, unsigned int max_bits)
+{
+    size_t written = 0;
+    size_t step = 1;
+
+    while (written < length) {
+        size_t const n = (length - written < step) ? length - written : step;
+
+        assert( lzw_encoder_write(enc, input + written, n) );
+        written += n;
+        step = step * 3 + 1;
+
+        if (synced == NULL) {
+            continue;
+        }
+
+        assert( lzw_encoder_sync(enc) );
+        assert( lzw_encoder_sync(enc) );
+
+        struct buffer decoded = make_buffer(synced->output,
+                                            synced->output_length);
+
+        assert( lzw_decode(INIT_BITS, max_bits, read_buffer, write_buffer,
+                           &decoded) );
+        assert(decoded.output_length == written);
+        assert(memcmp(decoded.output, input, written) == 0);
+        free(decoded.output);
+    }
+}
+
+void test_encoder_matches(void) {
+    size_t const length = 100000;
+    unsigned char* input = make_input(length, 1);
+    struct buffer expected = encode(input, length);
+    struct buffer actual = make_buffer(NULL, 0);
+
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, MAX_BITS,
+                                               write_buffer, &actual);
+    assert(enc != NULL);
+
+    write_in_pieces(enc, input, length, NULL, MAX_BITS);
+    assert( lzw_encoder_finish(enc) );
+    lzw_encoder_destroy(enc);
+
+    assert(actual.output_length == expected.output_length);
+    assert(memcmp(actual.output, expected.output, actual.output_length) == 0);
+
+    free(expected.output);
+    free(actual.output);
+    free(input);
+}
+
+void test_reset(void) {
+    size_t const lengths[] = { 200000, 1000, 0, 5000 };
+    struct buffer actual = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, MAX_BITS,
+                                               write_buffer, &actual);
+    assert(enc != NULL);
+
+    // a reused encoder must code each input as if it were fresh
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        unsigned char* input = make_input(lengths[i], 10 + i);
+        struct buffer expected = encode(input, lengths[i]);
+
+        actual.output_length = 0;
+        assert( lzw_encoder_reset(enc) );
+        assert( lzw_encoder_write(enc, input, lengths[i]) );
+        assert( lzw_encoder_finish(enc) );
+
+        assert(actual.output_length == expected.output_length);
+        assert(actual.output_length == 0
+               || memcmp(actual.output, expected.output,
+                         actual.output_length) == 0);
+
+        free(expected.output);
+        free(input);
+    }
+
+    lzw_encoder_destroy(enc);
+    free(actual.output);
+}
+
+/*
+ * decode_all: Decode the whole of an encoded buffer.
+ */
+
+static struct buffer decode_all(unsigned char const* encoded, size_t length)
+{
+    struct buffer buf = make_buffer(encoded, length);
+
+    assert( lzw_decode(INIT_BITS, MAX_BITS, read_buffer, write_buffer,
+                       &buf) );
+    return buf;
+}
+
+void test_sync(void) {
+    size_t const length = 200000;
+    unsigned char* input = make_input(length, 4);
+    struct buffer encoded = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, MAX_BITS,
+                                               write_buffer, &encoded);
+    assert(enc != NULL);
+
+    // flushing before anything is written must not write anything
+    assert( lzw_encoder_sync(enc) );
+    assert(encoded.output_length == 0);
+
+    // everything written so far must be decodable right away
+    write_in_pieces(enc, input, length, &encoded, MAX_BITS);
+
+    assert( lzw_encoder_write(enc, input, length) );
+    assert( lzw_encoder_finish(enc) );
+
+    struct buffer decoded = decode_all(encoded.output, encoded.output_length);
+
+    assert(decoded.output_length == 2 * length);
+    assert(memcmp(decoded.output, input, length) == 0);
+    assert(memcmp(decoded.output + length, input, length) == 0);
+
+    free(decoded.output);
+
+    // the threaded decoder must skip the markers as well
+    decoded = make_buffer(encoded.output, encoded.output_length);
+    assert( lzw_decode_threaded(INIT_BITS, MAX_BITS, read_buffer,
+                                write_buffer, &decoded) );
+    assert(decoded.output_length == 2 * length);
+    assert(memcmp(decoded.output + length, input, length) == 0);
+
+    lzw_encoder_destroy(enc);
+    free(decoded.output);
+    free(encoded.output);
+    free(input);
+}
+
+void test_reader(void) {
+    size_t const length = 300000;
+    unsigned char* input = make_input(length, 5);
+    struct buffer encoded = encode(input, length);
+    struct buffer source = make_buffer(encoded.output, encoded.output_length);
+    unsigned char* output = malloc(length);
+    assert(output != NULL);
+
+    struct lzw_reader* reader = lzw_reader_open(INIT_BITS, MAX_BITS,
+                                                read_buffer, &source);
+    assert(reader != NULL);
+
+    // read sizes that cut through strings at every point
+    size_t done = 0;
+    size_t step = 0;
+
+    while (done < length) {
+        size_t const n = lzw_reader_read(reader, output + done, step % 97);
+
+        assert(n == step % 97 || done + n == length);
+        done += n;
+        ++step;
+    }
+
+    assert(done == length);
+    assert(memcmp(output, input, length) == 0);
+    assert(lzw_reader_read(reader, output, 1) == 0);
+    assert( !lzw_reader_error(reader) );
+    lzw_reader_close(reader);
+
+    // a second code past the end of the table is reported as corrupt
+    encoded.output[0] = 0xFF;
+    encoded.output[1] = 0xFF;
+    encoded.output[2] &= 0x7F;
+    source.position = 0;
+    reader = lzw_reader_open(INIT_BITS, MAX_BITS, read_buffer, &source);
+    assert(reader != NULL);
+
+    while (lzw_reader_read(reader, output, length) > 0) {
+        continue;
+    }
+
+    assert( lzw_reader_error(reader) );
+    lzw_reader_close(reader);
+
+    free(output);
+    free(encoded.output);
+    free(input);
+}
+
+/*
+ * make_message: Write a small JSON-like record into out.
+ */
+
+static size_t make_message(char* out, size_t size, unsigned int i)
+{
+    int const n = snprintf(out, size,
+        "{\"id\":%u,\"user\":\"user%u\",\"status\":\"%s\","
+        "\"tags\":[\"alpha\",\"beta\"],\"score\":%u}",
+        i, i * 7 % 100, (i % 3) ? "active" : "inactive", i * 31 % 1000);
+
+    assert(n > 0 && (size_t) n < size);
+    return n;
+}
+
+void test_seeded(void) {
+    // train on a corpus of messages
+    size_t const sample_count = 500;
+    struct buffer samples = make_buffer(NULL, 0);
+    char message[256];
+
+    for (unsigned int i = 0; i < sample_count; ++i) {
+        size_t const n = make_message(message, sizeof(message), i);
+
+        for (size_t j = 0; j < n; ++j) {
+            write_buffer(message[j], &samples);
+        }
+    }
+
+    struct buffer image = make_buffer(samples.output, samples.output_length);
+    assert( lzw_dictionary_train(1000, read_buffer, write_buffer, &image) );
+
+    struct lzw_dictionary* dict = lzw_dictionary_wrap(image.output,
+                                                      image.output_length);
+    assert(dict != NULL);
+    assert(lzw_dictionary_size(dict) == 1000);
+
+    // too narrow for the trained entries
+    assert(lzw_encoder_init_seeded(INIT_BITS, 9, dict, write_buffer,
+                                   &samples) == NULL);
+
+    // messages outside the corpus round-trip, and shrink a lot more
+    size_t plain_total = 0;
+    size_t seeded_total = 0;
+
+    for (unsigned int i = 1000; i < 1100; ++i) {
+        size_t const n = make_message(message, sizeof(message), i);
+        unsigned char const* input = (unsigned char const*) message;
+        struct buffer plain = encode(input, n);
+        struct buffer seeded = make_buffer(input, n);
+
+        assert( lzw_encode_seeded(INIT_BITS, MAX_BITS, dict, read_buffer,
+                                  write_buffer, &seeded) );
+
+        struct buffer decoded = make_buffer(seeded.output,
+                                            seeded.output_length);
+
+        assert( lzw_decode_seeded(INIT_BITS, MAX_BITS, dict, read_buffer,
+                                  write_buffer, &decoded) );
+        assert(decoded.output_length == n);
+        assert(memcmp(decoded.output, message, n) == 0);
+
+        plain_total += plain.output_length;
+        seeded_total += seeded.output_length;
+
+        free(plain.output);
+        free(seeded.output);
+        free(decoded.output);
+    }
+
+    assert(seeded_total * 2 < plain_total);
+
+    // an entry whose prefix comes after it is rejected, as is a short image
+    image.output[image.output_length - 1] = 0xFF;
+    assert(lzw_dictionary_wrap(image.output, image.output_length) == NULL);
+    assert(lzw_dictionary_wrap(image.output, 3) == NULL);
+
+    lzw_dictionary_unload(dict);
+    free(image.output);
+    free(samples.output);
+}
+
+void test_snapshot(void) {
+    size_t const preamble_length = 50000;
+    size_t const tail_length = 20000;
+    unsigned char* input = make_input(preamble_length + 2 * tail_length, 6);
+    unsigned char const* tails[2] = {
+        input + preamble_length,
+        input + preamble_length + tail_length
+    };
+
+    struct buffer base = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, MAX_BITS,
+                                               write_buffer, &base);
+    assert(enc != NULL);
+    assert( lzw_encoder_write(enc, input, preamble_length) );
+
+    struct lzw_snapshot* snap = lzw_encoder_snapshot(enc);
+    assert(snap != NULL);
+
+    struct buffer forked = make_buffer(NULL, 0);
+    struct lzw_encoder* fork = lzw_snapshot_fork(snap, write_buffer, &forked);
+    assert(fork != NULL);
+
+    // each tail, and a reset fork, must match encoding the whole message
+    for (int round = 0; round < 3; ++round) {
+        unsigned char const* tail = tails[round % 2];
+        unsigned char* message = malloc(preamble_length + tail_length);
+        assert(message != NULL);
+
+        memcpy(message, input, preamble_length);
+        memcpy(message + preamble_length, tail, tail_length);
+
+        struct buffer expected = encode(message, preamble_length
+                                        + tail_length);
+
+        forked.output_length = 0;
+        assert( lzw_encoder_write(fork, tail, tail_length) );
+        assert( lzw_encoder_finish(fork) );
+
+        assert(base.output_length + forked.output_length
+               == expected.output_length);
+        assert(memcmp(base.output, expected.output,
+                      base.output_length) == 0);
+        assert(memcmp(forked.output, expected.output + base.output_length,
+                      forked.output_length) == 0);
+
+        assert( lzw_encoder_reset(fork) );
+
+        free(expected.output);
+        free(message);
+    }
+
+    lzw_encoder_destroy(fork);
+
+    // destroying the snapshot must not write the held back bits
+    size_t const base_length = base.output_length;
+    lzw_snapshot_destroy(snap);
+    assert(base.output_length == base_length);
+
+    free(forked.output);
+    free(base.output);
+    free(input);
+}
+
+void test_checkpoint(void) {
+    size_t const length = 60000;
+    size_t const split = 25001;
+    unsigned int const widths[2] = { 9, MAX_BITS };
+    unsigned char* input = make_input(length, 7);
+
+    for (size_t i = 0; i < 2; ++i) {
+        struct buffer expected = encode_bits(input, length, widths[i]);
+        struct buffer out = make_buffer(NULL, 0);
+        struct buffer saved = make_buffer(NULL, 0);
+        struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, widths[i],
+                                                   write_buffer, &out);
+        assert(enc != NULL);
+        assert( lzw_encoder_write(enc, input, split) );
+        assert( lzw_encoder_checkpoint(enc, write_buffer, &saved) );
+
+        // drop whatever the encoder writes after the checkpoint
+        size_t const kept = out.output_length;
+        lzw_encoder_destroy(enc);
+        out.output_length = kept;
+
+        struct buffer checkpoint = make_buffer(saved.output,
+                                               saved.output_length);
+        enc = lzw_encoder_resume(read_buffer, &checkpoint, write_buffer,
+                                 &out);
+        assert(enc != NULL);
+        assert( lzw_encoder_write(enc, input + split, length - split) );
+        assert( lzw_encoder_finish(enc) );
+        lzw_encoder_destroy(enc);
+
+        assert(out.output_length == expected.output_length);
+        assert(memcmp(out.output, expected.output, out.output_length) == 0);
+
+        // a truncated checkpoint is rejected
+        checkpoint = make_buffer(saved.output, saved.output_length - 1);
+        assert(lzw_encoder_resume(read_buffer, &checkpoint, write_buffer,
+                                  &out) == NULL);
+
+        free(expected.output);
+        free(out.output);
+        free(saved.output);
+    }
+
+    struct buffer encoded = encode(input, length);
+    struct buffer in = make_buffer(encoded.output, encoded.output_length);
+    struct buffer saved = make_buffer(NULL, 0);
+    unsigned char* decoded = malloc(length);
+    assert(decoded != NULL);
+
+    struct lzw_reader* reader = lzw_reader_open(INIT_BITS, MAX_BITS,
+                                                read_buffer, &in);
+    assert(reader != NULL);
+    assert(lzw_reader_read(reader, decoded, split) == split);
+    assert( lzw_reader_checkpoint(reader, write_buffer, &saved) );
+    lzw_reader_close(reader);
+
+    // the input carries on from where the first reader left it
+    struct buffer checkpoint = make_buffer(saved.output, saved.output_length);
+    reader = lzw_reader_resume(read_buffer, &checkpoint, read_buffer, &in);
+    assert(reader != NULL);
+    assert(lzw_reader_read(reader, decoded + split, length)
+           == length - split);
+    assert(!lzw_reader_error(reader));
+    lzw_reader_close(reader);
+
+    assert(memcmp(decoded, input, length) == 0);
+
+    free(decoded);
+    free(saved.output);
+    free(encoded.output);
+    free(input);
+}
+
+void test_round_trip(void) {
+    size_t const length = 300000;
+    unsigned char* input = make_input(length, 3);
+
+    check_round_trip(input, length, MAX_BITS);
+
+    // small widths fill the dictionary, which then stops growing
+    check_round_trip(input, length, 9);
+    check_round_trip(input, length, 12);
+    check_round_trip(input, length, LZW_MAXIMUM_BITS);
+    check_round_trip((unsigned char const*) "a", 1, MAX_BITS);
+    check_round_trip(NULL, 0, MAX_BITS);
+
+    free(input);
+}
+
+#if LZW_MAXIMUM_BITS > 24
+void test_wide_codes(void) {
+    size_t const length = 100000;
+    unsigned char* input = make_input(length, 5);
+
+    // codes that start past 24 bits go through the 64-bit stream buffers,
+    // and at 32 bits the all-ones sync marker only fits a wide code_t
+    unsigned int const widths[] = { 26, LZW_MAXIMUM_BITS };
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        unsigned int const start_bits = widths[i];
+        struct buffer encoded = make_buffer(input, length);
+        assert( lzw_encode(start_bits, LZW_MAXIMUM_BITS, read_buffer,
+                           write_buffer, &encoded) );
+
+        struct buffer decoded = make_buffer(encoded.output,
+                                            encoded.output_length);
+        assert( lzw_decode(start_bits, LZW_MAXIMUM_BITS, read_buffer,
+                           write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+
+        free(decoded.output);
+        free(encoded.output);
+
+        encoded = make_buffer(input, length);
+        assert( lzw_encode_phased(start_bits, LZW_MAXIMUM_BITS, read_buffer,
+                                  write_buffer, &encoded) );
+
+        decoded = make_buffer(encoded.output, encoded.output_length);
+        assert( lzw_decode_phased(start_bits, LZW_MAXIMUM_BITS, read_buffer,
+                                  write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+
+        free(decoded.output);
+        free(encoded.output);
+
+        // a sync point must be readable at these widths too
+        encoded = make_buffer(NULL, 0);
+        struct lzw_encoder* enc = lzw_encoder_init(start_bits,
+                                                   LZW_MAXIMUM_BITS,
+                                                   write_buffer, &encoded);
+        assert(enc != NULL);
+        assert( lzw_encoder_write(enc, input, length / 2) );
+        assert( lzw_encoder_sync(enc) );
+
+        decoded = make_buffer(encoded.output, encoded.output_length);
+        assert( lzw_decode(start_bits, LZW_MAXIMUM_BITS, read_buffer,
+                           write_buffer, &decoded) );
+        assert(decoded.output_length == length / 2);
+        assert(memcmp(decoded.output, input, length / 2) == 0);
+        free(decoded.output);
+
+        assert( lzw_encoder_write(enc, input + length / 2,
+                                  length - length / 2) );
+        assert( lzw_encoder_finish(enc) );
+        lzw_encoder_destroy(enc);
+
+        decoded = make_buffer(encoded.output, encoded.output_length);
+        assert( lzw_decode(start_bits, LZW_MAXIMUM_BITS, read_buffer,
+                           write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+
+        free(decoded.output);
+        free(encoded.output);
+    }
+
+    free(input);
+}
+#endif
+
+void test_runs(void) {
+    size_t const length = 1 << 22;
+    unsigned char* input = calloc(length, 1);
+    assert(input != NULL);
+
+    // long runs of a few bytes, broken up by short runs and stray bytes
+    for (size_t i = length / 4; i < length / 2; ++i) {
+        input[i] = 'x';
+    }
+
+    for (size_t i = length / 2; i < length; i += 1 + i % 97) {
+        input[i] = i;
+    }
+
+    // the fast path must write what byte-at-a-time encoding would
+    struct buffer expected = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, MAX_BITS,
+                                               write_buffer, &expected);
+    assert(enc != NULL);
+
+    for (size_t i = 0; i < length; ++i) {
+        assert( lzw_encoder_write(enc, &input[i], 1) );
+    }
+
+    assert( lzw_encoder_finish(enc) );
+    lzw_encoder_destroy(enc);
+
+    struct buffer actual = encode(input, length);
+
+    assert(actual.output_length == expected.output_length);
+    assert(memcmp(actual.output, expected.output, actual.output_length) == 0);
+
+    check_round_trip(input, length, MAX_BITS);
+    check_round_trip(input, length, 9);
+
+    free(expected.output);
+    free(actual.output);
+    free(input);
+}
+
+void test_threaded(void) {
+    size_t const length = 300000;
+    unsigned char* input = make_input(length, 4);
+    struct buffer expected = encode(input, length);
+    struct buffer encoded = make_buffer(input, length);
+
+    assert( lzw_encode_threaded(INIT_BITS, MAX_BITS, read_buffer,
+                                write_buffer, &encoded) );
+
+    assert(encoded.output_length == expected.output_length);
+    assert(memcmp(encoded.output, expected.output,
+                  expected.output_length) == 0);
+
+    struct buffer decoded = make_buffer(encoded.output,
+                                        encoded.output_length);
+
+    assert( lzw_decode_threaded(INIT_BITS, MAX_BITS, read_buffer,
+                                write_buffer, &decoded) );
+
+    assert(decoded.output_length == length);
+    assert(memcmp(decoded.output, input, length) == 0);
+
+    free(expected.output);
+    free(encoded.output);
+    free(decoded.output);
+    free(input);
+}
+
+void test_empty(void) {
+    struct buffer buf = encode(NULL, 0);
+
+    assert(buf.output_length == 0);
+    free(buf.output);
+}
+
+void test_batch(void) {
+    size_t const count = 20;
+    struct buffer buffers[20];
+    struct lzw_stream streams[20];
+    unsigned char* inputs[20];
+
+    for (size_t i = 0; i < count; ++i) {
+        // vary the lengths so that streams finish at different times, and
+        // there are more streams than encoders, so the encoders are reused
+        size_t const length = (i * 7919) % 90000;
+
+        inputs[i] = make_input(length, i);
+        buffers[i] = make_buffer(inputs[i], length);
+
+        streams[i].read_byte = read_buffer;
+        streams[i].write_byte = write_buffer;
+        streams[i].context = &buffers[i];
+    }
+
+    // a long run once the table is large enough for the streams to be
+    // interleaved
+    memset(inputs[11] + 50000, 'x', 20000);
+
+    assert( lzw_encode_batch(INIT_BITS, MAX_BITS, streams, count) );
+
+    for (size_t i = 0; i < count; ++i) {
+        struct buffer expected = encode(inputs[i], buffers[i].input_length);
+
+        assert(buffers[i].output_length == expected.output_length);
+        assert(expected.output_length == 0
+               || memcmp(buffers[i].output, expected.output,
+                         expected.output_length) == 0);
+
+        free(expected.output);
+        free(buffers[i].output);
+        free(inputs[i]);
+    }
+
+    assert( lzw_encode_batch(INIT_BITS, MAX_BITS, streams, 0) );
+}
+
+void test_stats(void) {
+    size_t const length = 200000;
+    unsigned char* input = make_input(length, 7);
+    struct buffer encoded = make_buffer(input, length);
+    struct lzw_stats stats;
+
+    assert( lzw_encode_stats(INIT_BITS, 9, read_buffer, write_buffer,
+                             &encoded, &stats) );
+
+    assert(stats.bytes_in == length);
+    assert(stats.bytes_out == encoded.output_length);
+    assert(stats.frozen && stats.entries == stats.max_entries);
+    assert(stats.start_bits == INIT_BITS && stats.final_bits == 9);
+
+    unsigned long long codes = 0;
+
+    for (size_t i = 0; i < LZW_STATS_WIDTHS; ++i) {
+        codes += stats.codes_by_width[i];
+    }
+
+    assert(codes == stats.codes);
+
+    struct buffer decoded = make_buffer(encoded.output,
+                                        encoded.output_length);
+    struct lzw_stats decoded_stats;
+
+    assert( lzw_decode_stats(INIT_BITS, 9, read_buffer, write_buffer,
+                             &decoded, &decoded_stats) );
+
+    assert(decoded_stats.codes == stats.codes);
+    assert(decoded_stats.bytes_in == encoded.output_length);
+    assert(decoded_stats.bytes_out == length);
+    assert(decoded_stats.freeze_codes == stats.freeze_codes);
+
+    free(encoded.output);
+    free(decoded.output);
+    free(input);
+}
+
+/*
+ * The expected results of a search: each reported line is checked against
+ * the input, which must start with the stream being searched.
+ */
+
+struct grep_check {
+    struct buffer buf;
+    unsigned char const* text;
+    size_t text_length;
+    unsigned char const* pattern;
+    size_t pattern_length;
+
+    size_t lines;
+    unsigned long long next_offset;
+};
+
+static bool contains(unsigned char const* bytes, size_t length,
+        unsigned char const* pattern, size_t pattern_length)
+{
+    for (size_t i = 0; i + pattern_length <= length; ++i) {
+        if (memcmp(bytes + i, pattern, pattern_length) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void check_found(unsigned char const* line, size_t length,
+        unsigned long long offset, void* context)
+{
+    struct grep_check* check = context;
+
+    // lines are reported in order, each starting after a newline
+    assert(offset >= check->next_offset);
+    assert(offset == 0 || check->text[offset - 1] == '\n');
+    assert(offset + length <= check->text_length);
+    assert(memcmp(check->text + offset, line, length) == 0);
+    assert(offset + length == check->text_length
+           || check->text[offset + length] == '\n');
+    assert(contains(line, length, check->pattern, check->pattern_length));
+
+    ++check->lines;
+    check->next_offset = offset + length;
+}
+
+/*
+ * check_grep: Search the compressed text and compare with a plain search.
+ */
+
+static void check_grep(unsigned char const* text, size_t length,
+        char const* pattern, unsigned int max_bits)
+{
+    struct buffer encoded = encode_bits(text, length, max_bits);
+    size_t const pattern_length = strlen(pattern);
+    size_t expected = 0;
+    size_t start = 0;
+
+    for (size_t i = 0; i <= length; ++i) {
+        if (i == length || text[i] == '\n') {
+            expected += contains(text + start, i - start,
+                                 (unsigned char const*) pattern,
+                                 pattern_length);
+            start = i + 1;
+        }
+    }
+
+    struct grep_check check = {
+        make_buffer(encoded.output, encoded.output_length), text, length,
+        (unsigned char const*) pattern, pattern_length, 0, 0
+    };
+
+    assert( lzw_grep(INIT_BITS, max_bits, check.pattern, pattern_length,
+                     read_buffer, check_found, &check) );
+    assert(check.lines == expected);
+
+    free(encoded.output);
+}
+
+void test_grep(void) {
+    size_t const length = 200000;
+    unsigned char* text = malloc(length);
+    unsigned int seed = 5;
+
+    assert(text != NULL);
+
+    // a small alphabet, so that matches often cross code boundaries
+    for (size_t i = 0; i < length; ++i) {
+        seed = seed * 1103515245 + 12345;
+        text[i] = "aab\nabba"[(seed >> 16) % 8];
+    }
+
+    char const* const patterns[] = {
+        "a", "ab", "aba", "abab", "aaaa", "bbab", "baabbaab", "abaabaaba"
+    };
+
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+        check_grep(text, length, patterns[i], 9);
+        check_grep(text, length, patterns[i], MAX_BITS);
+    }
+
+    free(text);
+
+    text = make_input(length, 6);
+    check_grep(text, length, "quick brown", MAX_BITS);
+    check_grep(text, length, "fox the", 12);
+    check_grep(text, 0, "fox", MAX_BITS);
+    free(text);
+
+    // no patterns with newlines, or that are empty
+    struct buffer empty = make_buffer(NULL, 0);
+
+    assert(!lzw_grep(INIT_BITS, MAX_BITS, (unsigned char const*) "a\nb", 3,
+                     read_buffer, check_found, &empty));
+    assert(!lzw_grep(INIT_BITS, MAX_BITS, (unsigned char const*) "", 0,
+                     read_buffer, check_found, &empty));
+}
+
+void test_phase_in(void) {
+    size_t const length = 300000;
+    unsigned char* input = make_input(length, 9);
+    unsigned int const widths[] = { 9, 12, MAX_BITS, 24 };
+
+    // a stream that starts with the byte whose code is the first marker
+    input[0] = 255;
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        struct buffer plain = encode_bits(input, length, widths[i]);
+        struct buffer encoded = make_buffer(NULL, 0);
+        struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, widths[i],
+                                                   write_buffer, &encoded);
+        assert(enc != NULL);
+        assert( lzw_encoder_enable_phase_in(enc) );
+
+        // sync flushes write markers, which must map to phase-in codes too
+        size_t written = 0;
+        size_t step = 1;
+
+        while (written < length) {
+            size_t const n = (length - written < step) ?
+                length - written :
+                step;
+
+            assert( lzw_encoder_write(enc, input + written, n) );
+            assert( lzw_encoder_sync(enc) );
+            written += n;
+            step = step * 5 + 1;
+        }
+
+        // once a code has been written, it's too late to switch
+        assert( !lzw_encoder_enable_phase_in(enc) );
+        assert( lzw_encoder_finish(enc) );
+        lzw_encoder_destroy(enc);
+
+        struct buffer decoded = make_buffer(encoded.output,
+                                            encoded.output_length);
+
+        assert( lzw_decode_phased(INIT_BITS, widths[i], read_buffer,
+                                  write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+        free(decoded.output);
+        free(encoded.output);
+
+        // without flushes, the codes are never longer and mostly shorter
+        encoded = make_buffer(input, length);
+        assert( lzw_encode_phased(INIT_BITS, widths[i], read_buffer,
+                                  write_buffer, &encoded) );
+        assert(encoded.output_length < plain.output_length);
+
+        decoded = make_buffer(encoded.output, encoded.output_length);
+        assert( lzw_decode_phased(INIT_BITS, widths[i], read_buffer,
+                                  write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+
+        free(decoded.output);
+        free(encoded.output);
+        free(plain.output);
+    }
+
+    free(input);
+}
+
+void test_entropy(void) {
+    size_t const length = 300000;
+    unsigned char* input = make_input(length, 10);
+    unsigned int const widths[] = { 9, 12, MAX_BITS, 24 };
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        struct buffer plain = encode_bits(input, length, widths[i]);
+        struct buffer encoded = make_buffer(input, length);
+
+        assert( lzw_encode_entropy(INIT_BITS, widths[i], read_buffer,
+                                   write_buffer, &encoded) );
+        assert(encoded.output_length < plain.output_length);
+
+        struct buffer decoded = make_buffer(encoded.output,
+                                            encoded.output_length);
+
+        assert( lzw_decode_entropy(INIT_BITS, widths[i], read_buffer,
+                                   write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+        free(decoded.output);
+
+        // a stream cut short must be caught, not decoded as if it ended
+        decoded = make_buffer(encoded.output, encoded.output_length - 1);
+        assert( !lzw_decode_entropy(INIT_BITS, widths[i], read_buffer,
+                                    write_buffer, &decoded) );
+
+        free(decoded.output);
+        free(encoded.output);
+        free(plain.output);
+    }
+
+    // an empty input is just the end of the stream
+    struct buffer encoded = make_buffer(NULL, 0);
+    assert( lzw_encode_entropy(INIT_BITS, MAX_BITS, read_buffer, write_buffer,
+                               &encoded) );
+
+    struct buffer decoded = make_buffer(encoded.output, encoded.output_length);
+    assert( lzw_decode_entropy(INIT_BITS, MAX_BITS, read_buffer, write_buffer,
+                               &decoded) );
+    assert(decoded.output_length == 0);
+
+    free(encoded.output);
+    free(input);
+}
+
+/*
+ * make_drifting_input: Words from a vocabulary that is replaced every
+ *                      segment, so that the strings worth keeping change
+ *                      as the input goes on.
+ */
+
+static unsigned char* make_drifting_input(size_t length, size_t segment)
+{
+    unsigned char* input = malloc(length);
+    unsigned int seed = 1;
+    assert(input != NULL);
+
+    for (size_t i = 0; i < length;) {
+        unsigned int const vocabulary = (unsigned int) (i / segment) * 64;
+
+        seed = seed * 1103515245 + 12345;
+
+        // a word of 3 to 8 letters, all picked by its number
+        unsigned int word = vocabulary + (seed >> 16) % 64;
+        size_t const word_length = 3 + word % 6;
+
+        for (size_t j = 0; j < word_length && i < length; ++j) {
+            word = word * 2654435761u + 1;
+            input[i++] = 'a' + (word >> 24) % 26;
+        }
+
+        if (i < length) {
+            input[i++] = ' ';
+        }
+    }
+
+    return input;
+}
+
+void test_lru(void) {
+    size_t const length = 1 << 20;
+    unsigned char* input = make_drifting_input(length, length / 16);
+    unsigned int const widths[] = { 9, 12, MAX_BITS, 24 };
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        struct buffer frozen = encode_bits(input, length, widths[i]);
+        struct buffer encoded = make_buffer(NULL, 0);
+        struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, widths[i],
+                                                   write_buffer, &encoded);
+        assert(enc != NULL);
+        assert( lzw_encoder_enable_lru(enc) );
+        assert( lzw_encoder_write(enc, input, length) );
+
+        // a replacing encoder can't be flushed or saved
+        assert( !lzw_encoder_sync(enc) );
+        assert( lzw_encoder_snapshot(enc) == NULL );
+        assert( !lzw_encoder_checkpoint(enc, write_buffer, &frozen) );
+        assert( lzw_encoder_finish(enc) );
+
+        struct lzw_stats stats;
+        lzw_encoder_stats(enc, &stats);
+        assert(stats.frozen == (stats.replaced > 0));
+        lzw_encoder_destroy(enc);
+
+        // the table fills at all but the largest width, and from then on
+        // replacing entries keeps up with the drift
+        if (widths[i] < 24) {
+            assert(stats.replaced > 0);
+            assert(encoded.output_length < frozen.output_length);
+        } else {
+            assert(encoded.output_length == frozen.output_length);
+        }
+
+        struct buffer decoded = make_buffer(encoded.output,
+                                            encoded.output_length);
+
+        assert( lzw_decode_lru(INIT_BITS, widths[i], read_buffer,
+                               write_buffer, &decoded) );
+        assert(decoded.output_length == length);
+        assert(memcmp(decoded.output, input, length) == 0);
+
+        free(decoded.output);
+        free(encoded.output);
+        free(frozen.output);
+    }
+
+    // random bytes fill the table with strings that are never used again,
+    // including long runs of leaves and prefixes
+    unsigned char* noise = make_input(length, 11);
+    check_round_trip(noise, length, 9);
+
+    struct buffer encoded = make_buffer(noise, length);
+    assert( lzw_encode_lru(INIT_BITS, 9, read_buffer, write_buffer,
+                           &encoded) );
+
+    struct buffer decoded = make_buffer(encoded.output, encoded.output_length);
+    assert( lzw_decode_lru(INIT_BITS, 9, read_buffer, write_buffer,
+                           &decoded) );
+    assert(decoded.output_length == length);
+    assert(memcmp(decoded.output, noise, length) == 0);
+
+    free(decoded.output);
+    free(encoded.output);
+    free(noise);
+    free(input);
+}
+
+/*
+ * check_growth: Encode the input in uneven pieces under a growth policy,
+ *               check that the output is the same as encoding it at once
+ *               and that it decodes, and return the number of codes.
+ */
+
+static unsigned long long check_growth(unsigned char const* input,
+        size_t length, unsigned int max_bits, enum lzw_growth policy)
+{
+    struct buffer encoded = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, max_bits,
+                                               write_buffer, &encoded);
+    assert(enc != NULL);
+    assert( lzw_encoder_set_growth(enc, policy) );
+
+    // a match can be given back across the end of a piece
+    write_in_pieces(enc, input, length, NULL, max_bits);
+
+    // the policy can't change once there's input, and the encoder can't be
+    // flushed or saved
+    assert(length == 0 || !lzw_encoder_set_growth(enc, LZW_GROWTH_LZW));
+    assert( !lzw_encoder_enable_lru(enc) );
+    assert( !lzw_encoder_sync(enc) );
+    assert( lzw_encoder_snapshot(enc) == NULL );
+    assert( !lzw_encoder_checkpoint(enc, write_buffer, &encoded) );
+    assert( lzw_encoder_finish(enc) );
+
+    struct lzw_stats stats;
+    lzw_encoder_stats(enc, &stats);
+    lzw_encoder_destroy(enc);
+
+    struct buffer whole = make_buffer(input, length);
+    assert( lzw_encode_growth(INIT_BITS, max_bits, policy, read_buffer,
+                              write_buffer, &whole) );
+    assert(whole.output_length == encoded.output_length);
+    assert(length == 0
+           || memcmp(whole.output, encoded.output, whole.output_length) == 0);
+
+    struct buffer decoded = make_buffer(encoded.output, encoded.output_length);
+    assert( lzw_decode_growth(INIT_BITS, max_bits, policy, read_buffer,
+                              write_buffer, &decoded) );
+    assert(decoded.output_length == length);
+    assert(length == 0 || memcmp(decoded.output, input, length) == 0);
+
+    free(decoded.output);
+    free(whole.output);
+    free(encoded.output);
+
+    return stats.codes;
+}
+
+void test_growth(void) {
+    size_t const length = 1 << 20;
+    unsigned char* input = make_drifting_input(length, length);
+    unsigned int const widths[] = { 9, 12, MAX_BITS, 24 };
+    enum lzw_growth const policies[] = { LZW_GROWTH_LZMW, LZW_GROWTH_LZAP };
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        struct lzw_stats stats;
+        struct buffer plain = make_buffer(input, length);
+        assert( lzw_encode_stats(INIT_BITS, widths[i], read_buffer,
+                                 write_buffer, &plain, &stats) );
+
+        for (size_t j = 0; j < sizeof(policies) / sizeof(policies[0]); ++j) {
+            unsigned long long const codes = check_growth(input, length,
+                                                          widths[i],
+                                                          policies[j]);
+
+            // a table with room to learn the words covers them in fewer
+            // codes
+            if (widths[i] >= MAX_BITS) {
+                assert(codes < stats.codes);
+            }
+        }
+
+        free(plain.output);
+    }
+
+    // noise, and a run long enough that its strings stop doubling at the
+    // length limit
+    size_t const run_length = 300000;
+    unsigned char* noise = make_input(length, 13);
+    unsigned char* run = malloc(run_length);
+    assert(run != NULL);
+    memset(run, 'a', run_length);
+
+    for (size_t j = 0; j < sizeof(policies) / sizeof(policies[0]); ++j) {
+        check_growth(noise, length, 9, policies[j]);
+        check_growth(run, run_length, 24, policies[j]);
+        check_growth(input, 0, 12, policies[j]);
+    }
+
+    // each policy is only chosen on its own
+    struct buffer encoded = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, 12, write_buffer,
+                                               &encoded);
+    assert(enc != NULL);
+    assert( lzw_encoder_enable_lru(enc) );
+    assert( !lzw_encoder_set_growth(enc, LZW_GROWTH_LZAP) );
+    lzw_encoder_destroy(enc);
+
+    free(run);
+    free(noise);
+    free(input);
+}
+
+/*
+ * check_lookahead: Encode the input in uneven pieces with lookahead, check
+ *                  that the output is the same as encoding it at once and
+ *                  that the plain decoder reads it, and return the encoded
+ *                  size. If sync is set, the encoder is flushed after every
+ *                  piece instead.
+ */
+
+static size_t check_lookahead(unsigned char const* input,
+        size_t length, unsigned int max_bits, bool sync)
+{
+    struct buffer encoded = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, max_bits,
+                                               write_buffer, &encoded);
+    assert(enc != NULL);
+    assert( lzw_encoder_enable_lookahead(enc) );
+
+    write_in_pieces(enc, input, length, sync ? &encoded : NULL, max_bits);
+
+    // the held back input can't be saved or forked
+    assert( !lzw_encoder_set_growth(enc, LZW_GROWTH_LZMW) );
+    assert( !lzw_encoder_enable_lru(enc) );
+    assert( lzw_encoder_snapshot(enc) == NULL );
+    assert( !lzw_encoder_checkpoint(enc, write_buffer, &encoded) );
+    assert( lzw_encoder_finish(enc) );
+    lzw_encoder_destroy(enc);
+
+    if (!sync) {
+        struct buffer whole = make_buffer(input, length);
+        assert( lzw_encode_lookahead(INIT_BITS, max_bits, read_buffer,
+                                     write_buffer, &whole) );
+        assert(whole.output_length == encoded.output_length);
+        assert(length == 0 || memcmp(whole.output, encoded.output,
+                                     whole.output_length) == 0);
+        free(whole.output);
+    }
+
+    struct buffer decoded = make_buffer(encoded.output, encoded.output_length);
+    assert( lzw_decode(INIT_BITS, max_bits, read_buffer, write_buffer,
+                       &decoded) );
+    assert(decoded.output_length == length);
+    assert(length == 0 || memcmp(decoded.output, input, length) == 0);
+
+    free(decoded.output);
+    free(encoded.output);
+
+    return encoded.output_length;
+}
+
+void test_lookahead(void) {
+    size_t const length = 1 << 20;
+    unsigned char* input = make_drifting_input(length, length / 4);
+
+    // at these widths the table fills up, and a shorter match can cost
+    // more than it saves, so only the coding is checked
+    unsigned int const widths[] = { 9, 12, MAX_BITS };
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        check_lookahead(input, length, widths[i], false);
+        check_lookahead(input, length / 8, widths[i], true);
+    }
+
+    // with room to learn every word, the parse takes less output than
+    // greedy parsing
+    unsigned int const roomy[] = { 17, 24 };
+
+    for (size_t i = 0; i < sizeof(roomy) / sizeof(roomy[0]); ++i) {
+        struct buffer plain = make_buffer(input, length);
+        assert( lzw_encode(INIT_BITS, roomy[i], read_buffer, write_buffer,
+                           &plain) );
+
+        size_t const size = check_lookahead(input, length, roomy[i], false);
+        assert(size < plain.output_length);
+
+        check_lookahead(input, length / 8, roomy[i], true);
+
+        free(plain.output);
+    }
+
+    unsigned char* noise = make_input(length, 13);
+    check_lookahead(noise, length, 12, false);
+    check_lookahead(input, 0, 12, false);
+
+    // lookahead only goes with the usual table growth
+    struct buffer encoded = make_buffer(NULL, 0);
+    struct lzw_encoder* enc = lzw_encoder_init(INIT_BITS, 12, write_buffer,
+                                               &encoded);
+    assert(enc != NULL);
+    assert( lzw_encoder_set_growth(enc, LZW_GROWTH_LZAP) );
+    assert( !lzw_encoder_enable_lookahead(enc) );
+    lzw_encoder_destroy(enc);
+
+    free(noise);
+    free(input);
+}
+
+int main(void) {
+    test_empty();
+    test_encoder_matches();
+    test_batch();
+    test_reset();
+    test_sync();
+    test_reader();
+    test_seeded();
+    test_snapshot();
+    test_checkpoint();
+    test_stats();
+    test_grep();
+    test_phase_in();
+    test_entropy();
+    test_lru();
+    test_growth();
+    test_lookahead();
+    test_round_trip();
+#if LZW_MAXIMUM_BITS > 24
+    test_wide_codes();
+#endif
+    test_runs();
+    test_threaded();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "ring.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <pthread.h>
+
+#define BLOCKS 3
+#define BLOCK_SIZE 64
+#define TOTAL 100000
+
+static void* produce(void* arg)
+{
+    struct ring* ring = arg;
+    uint32_t next = 0;
+    size_t round = 0;
+
+    while (next < TOTAL) {
+        unsigned char* block = ring_acquire(ring);
+        size_t length = 0;
+
+        assert(block != NULL);
+
+        // vary the block lengths, including empty blocks
+        size_t const want = round++ % (BLOCK_SIZE + 1);
+
+        while (length < want && next < TOTAL) {
+            block[length++] = next % 251;
+            ++next;
+        }
+
+        ring_publish(ring, length);
+    }
+
+    ring_close(ring);
+    return NULL;
+}
+
+void test_transfer(void) {
+    struct ring* ring = ring_init(BLOCKS, BLOCK_SIZE);
+    pthread_t producer;
+    uint32_t expected = 0;
+
+    assert(ring != NULL);
+    assert(ring_block_size(ring) == BLOCK_SIZE);
+    assert(pthread_create(&producer, NULL, produce, ring) == 0);
+
+    unsigned char const* block;
+    size_t length;
+
+    while ((block = ring_peek(ring, &length)) != NULL) {
+        assert(length <= BLOCK_SIZE);
+
+        for (size_t i = 0; i < length; ++i) {
+            assert(block[i] == expected % 251);
+            ++expected;
+        }
+
+        ring_release(ring);
+    }
+
+    assert(expected == TOTAL);
+    pthread_join(producer, NULL);
+    ring_destroy(ring);
+}
+
+void test_consumer_close(void) {
+    struct ring* ring = ring_init(BLOCKS, BLOCK_SIZE);
+
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        assert(ring_acquire(ring) != NULL);
+        ring_publish(ring, 0);
+    }
+
+    // a full ring must not block the producer once the consumer gives up
+    ring_close(ring);
+    assert(ring_acquire(ring) == NULL);
+
+    ring_destroy(ring);
+}
+
+int main(void) {
+    test_transfer();
+    test_consumer_close();
+
+    return EXIT_SUCCESS;
+}